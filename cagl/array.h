@@ -324,6 +324,115 @@ CAG_DEC_SET_EXACT_SIZE_ARRAY(function, container, iterator_type) \
              from, \
              to)
 
+/*! \brief Radix sort for arrays of primitive types.
+
+   Each element is mapped to an unsigned integer key of the same size whose
+   order is the order of the elements, and the keys are sorted with one
+   counting pass per CAG_RADIX_BITS bits (8 unless defined beforehand), least
+   significant digit first. All digits are counted in a single pass over the
+   keys, and passes over digits that are the same for every element are
+   skipped. The keys are then mapped
+   back to elements. Needs O(n) extra memory and returns NULL if it cannot be
+   allocated, leaving the array unchanged.
+
+   key_type is the unsigned integer type of the same size as type. to_key and
+   to_value are the matching pair of the CAG_RADIX_KEY and CAG_RADIX_VALUE
+   macros below: UNSIGNED for unsigned integers, SIGNED for two's complement
+   signed integers, whose sign bit is flipped, and FLOAT for IEEE floating
+   point numbers, whose other bits are also flipped if they are negative.
+*/
+
+#ifndef CAG_RADIX_BITS
+
+#define CAG_RADIX_BITS 8
+
+#endif
+
+#define CAG_P_RADIX_BUCKETS (1 << CAG_RADIX_BITS)
+
+#define CAG_P_RADIX_DIGITS(key_type) \
+    ((sizeof(key_type) * CHAR_BIT + CAG_RADIX_BITS - 1) / CAG_RADIX_BITS)
+
+#define CAG_P_RADIX_DIGIT(key, digit) \
+    ((size_t) ((key) >> ((digit) * CAG_RADIX_BITS)) & \
+     (CAG_P_RADIX_BUCKETS - 1))
+
+#define CAG_P_RADIX_TOP(key_type) \
+    ((key_type) 1 << (sizeof(key_type) * CHAR_BIT - 1))
+
+#define CAG_RADIX_KEY_UNSIGNED(type, key_type, value, key) \
+    key = (key_type) (value)
+
+#define CAG_RADIX_VALUE_UNSIGNED(type, key_type, key, value) \
+    value = (type) (key)
+
+#define CAG_RADIX_KEY_SIGNED(type, key_type, value, key) \
+    key = (key_type) (value) ^ CAG_P_RADIX_TOP(key_type)
+
+#define CAG_RADIX_VALUE_SIGNED(type, key_type, key, value) \
+do { \
+    key ^= CAG_P_RADIX_TOP(key_type); \
+    memcpy(&(value), &(key), sizeof(value)); \
+} while (0)
+
+#define CAG_RADIX_KEY_FLOAT(type, key_type, value, key) \
+do { \
+    memcpy(&(key), &(value), sizeof(key)); \
+    key ^= key & CAG_P_RADIX_TOP(key_type) ? ~(key_type) 0 \
+           : CAG_P_RADIX_TOP(key_type); \
+} while (0)
+
+#define CAG_RADIX_VALUE_FLOAT(type, key_type, key, value) \
+do { \
+    key ^= key & CAG_P_RADIX_TOP(key_type) ? CAG_P_RADIX_TOP(key_type) \
+           : ~(key_type) 0; \
+    memcpy(&(value), &(key), sizeof(value)); \
+} while (0)
+
+#define CAG_DEC_RADIX_SORT_ARRAY(function, iterator_type) \
+    iterator_type function(iterator_type from, iterator_type to)
+
+#define CAG_DEF_RADIX_SORT_ARRAY(function, iterator_type, type, key_type, \
+                                 to_key, to_value) \
+CAG_DEC_RADIX_SORT_ARRAY(function, iterator_type) \
+{ \
+    size_t counts[CAG_P_RADIX_DIGITS(key_type)][CAG_P_RADIX_BUCKETS]; \
+    size_t n = to - from, i, d, sum, c; \
+    key_type *keys, *src, *dst, *t; \
+    iterator_type it; \
+    if (n < 2) \
+        return from; \
+    if (!(keys = CAG_MALLOC(2 * n * sizeof(key_type)))) \
+        return NULL; \
+    memset(counts, 0, sizeof(counts)); \
+    for (i = 0, it = from; i < n; ++i, ++it) { \
+        to_key(type, key_type, it->value, keys[i]); \
+        for (d = 0; d < CAG_P_RADIX_DIGITS(key_type); ++d) \
+            ++counts[d][CAG_P_RADIX_DIGIT(keys[i], d)]; \
+    } \
+    src = keys; \
+    dst = keys + n; \
+    for (d = 0; d < CAG_P_RADIX_DIGITS(key_type); ++d) { \
+        size_t *count = counts[d]; \
+        if (count[CAG_P_RADIX_DIGIT(src[0], d)] == n) \
+            continue; \
+        for (i = 0, sum = 0; i < CAG_P_RADIX_BUCKETS; ++i) { \
+            c = count[i]; \
+            count[i] = sum; \
+            sum += c; \
+        } \
+        for (i = 0; i < n; ++i) \
+            dst[count[CAG_P_RADIX_DIGIT(src[i], d)]++] = src[i]; \
+        t = src; \
+        src = dst; \
+        dst = t; \
+    } \
+    for (i = 0, it = from; i < n; ++i, ++it) \
+        to_value(type, key_type, src[i], it->value); \
+    CAG_FREE(keys); \
+    return from; \
+}
+
 /*! \brief Algorithm and function declaration and definition to get the size of
     an array.
 
@@ -770,18 +879,12 @@ CAG_DEF_ALL_ARRAY(container, type, alloc_style, alloc_func, \
                               free_func) \
 CAG_DEF_ALL_ARRAY(container, type, \
                   alloc_style, alloc_func, free_func, val_adr); \
-CAG_DEF_STABLE_SORT(stable_sort_ ## container, \
-                    container, it_ ## container, \
-                    new_ ## container, free_ ## container, \
-                    begin_ ## container, end_ ## container, \
-                    next_ ## container, distance_ ## container, \
-                    appendp_ ## container, cmp_func, val_adr) \
-CAG_DEF_STABLE_SORT(rstable_sort_ ## container, \
-                    container, rit_ ## container, \
-                    new_ ## container, free_ ## container, \
-                    rbegin_ ## container, rend_ ## container, \
-                    rnext_ ## container, rdistance_ ## container, \
-                    prependp_ ## container, cmp_func, val_adr) \
+CAG_DEF_STABLE_SORT(stable_sort_ ## container, it_ ## container, \
+                    type, prev_ ## container, next_ ## container, \
+                    distance_ ## container, cmp_func, val_adr) \
+CAG_DEF_STABLE_SORT(rstable_sort_ ## container, rit_ ## container, \
+                    type, rprev_ ## container, rnext_ ## container, \
+                    rdistance_ ## container, cmp_func, val_adr) \
 CAG_DEF_CMP_REORDERABLE(container, type, cmp_func, val_adr) \
 CAG_DEF_CMP_RANDOMACCESS(container, type, cmp_func, val_adr) \
 typedef container CAG_P_CMB(container ## _cmp,  __LINE__)
@@ -805,6 +908,38 @@ typedef container CAG_P_CMB(container ## _cmp,  __LINE__)
                           CAG_NO_ALLOC_STYLE, CAG_NO_ALLOC_FUNC, \
                           CAG_NO_FREE_FUNC)
 
+/*! \brief Same as CAG_DEF_CMP_ARRAY but sort_C offers ranges shorter than
+   small_limit to small_sort(it, n) before insertion sorting them (see
+   CAG_SMALL_SORT). prim.c uses this to sort small ranges of int, float and
+   double with sorting networks.
+*/
+
+#define CAG_DEF_SMALL_SORT_CMP_ARRAY(container, type, cmp_func, small_sort, \
+                                     small_limit) \
+CAG_DEF_ALL_ARRAY(container, type, CAG_NO_ALLOC_STYLE, CAG_NO_ALLOC_FUNC, \
+                  CAG_NO_FREE_FUNC, CAG_BYVAL); \
+CAG_DEF_STABLE_SORT(stable_sort_ ## container, it_ ## container, \
+                    type, prev_ ## container, next_ ## container, \
+                    distance_ ## container, cmp_func, CAG_BYVAL) \
+CAG_DEF_STABLE_SORT(rstable_sort_ ## container, rit_ ## container, \
+                    type, rprev_ ## container, rnext_ ## container, \
+                    rdistance_ ## container, cmp_func, CAG_BYVAL) \
+CAG_DEF_SMALL_SORT(sort_ ## container, it_ ## container, type, \
+                   cmp_func, CAG_BYVAL, distance_ ## container, \
+                   prev_ ## container, next_ ## container, \
+                   at_ ## container, \
+                   lteq_it_ ## container, lt_it_ ## container, \
+                   swap_ ## container, CAG_VALUE, small_sort, small_limit) \
+CAG_DEF_SORT(rsort_ ## container, rit_ ## container, type, \
+             cmp_func, CAG_BYVAL, rdistance_ ## container, \
+             rprev_ ## container, rnext_ ## container, \
+             rat_ ## container, \
+             rlteq_it_ ## container, rlt_it_ ## container, \
+             rswap_ ## container, CAG_VALUE) \
+CAG_DEF_CMP_REORDERABLE_NO_SORT(container, type, cmp_func, CAG_BYVAL) \
+CAG_DEF_CMP_RANDOMACCESS(container, type, cmp_func, CAG_BYVAL) \
+typedef container CAG_P_CMB(container ## _cmp,  __LINE__)
+
 /*! \brief Same as CAG_DEF_CMP_ARRAY but cmp_fun takes parameters by address. */
 
 #define CAG_DEF_CMPP_ARRAY(container, type, cmp_func) \
@@ -853,4 +988,22 @@ CAG_DEF_ALL_CMP_ARRAY(container, type, cmp_func, \
     CAG_DEC_STR_ARRAY(container); \
     CAG_DEF_STR_ARRAY(container)
 
+/*! \brief Declare and define radix_sort_C and radix_sort_all_C for an array
+   of a primitive type. See CAG_DEF_RADIX_SORT_ARRAY for key_type, to_key and
+   to_value.
+*/
+
+#define CAG_DEC_RADIX_ARRAY(container) \
+    CAG_DEC_RADIX_SORT_ARRAY(radix_sort_ ## container, it_ ## container); \
+    CAG_DEC_APPLY_CONTAINER(radix_sort_all_ ## container, container, \
+                            it_ ## container)
+
+#define CAG_DEF_RADIX_ARRAY(container, type, key_type, to_key, to_value) \
+CAG_DEF_RADIX_SORT_ARRAY(radix_sort_ ## container, it_ ## container, type, \
+                         key_type, to_key, to_value) \
+CAG_DEF_APPLY_CONTAINER(radix_sort_all_ ## container, container, \
+                        it_ ## container, radix_sort_ ## container, \
+                        begin_ ## container, end_ ## container) \
+typedef container CAG_P_CMB(container ## _radix,  __LINE__)
+
 #endif /* CAG_ARRAY_H */
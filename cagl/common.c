@@ -8,9 +8,12 @@
 */
 
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cagl/common.h"
+
 /* Simple hash function from K&R, 2nd ed. p144 */
 
 size_t cag_kr_hash(const void *key, const size_t len)
@@ -52,6 +55,224 @@ size_t cag_int_hash(const int key, const size_t len)
 	return key;
 }
 
+
+/* Word-at-a-time hash and integer mixer.
+
+   The constants are the 64 bit ones from MurmurHash3 and xxHash when size_t
+   is 64 bits wide and the 32 bit ones otherwise. All arithmetic is done on
+   size_t, so the code is C89 and needs no 64 bit integer type.
+*/
+
+#define CAG_P_BITS (sizeof(size_t) * CHAR_BIT)
+#define CAG_P_WIDE(hi, lo, narrow) \
+	(sizeof(size_t) > 4 ? \
+	 ((((size_t) (hi) << 16) << 16) | (size_t) (lo)) : (size_t) (narrow))
+#define CAG_P_K1 CAG_P_WIDE(0x87C37B91UL, 0x114253D5UL, 0xCC9E2D51UL)
+#define CAG_P_K2 CAG_P_WIDE(0x4CF5AD43UL, 0x2745937FUL, 0x1B873593UL)
+#define CAG_P_M1 CAG_P_WIDE(0xFF51AFD7UL, 0xED558CCDUL, 0x85EBCA6BUL)
+#define CAG_P_M2 CAG_P_WIDE(0xC4CEB9FEUL, 0x1A85EC53UL, 0xC2B2AE35UL)
+#define CAG_P_ROTL(x, r) (((x) << (r)) | ((x) >> (CAG_P_BITS - (r))))
+
+size_t cag_hash_seed = 0;
+
+size_t cag_mix_hash(size_t x)
+{
+	x ^= x >> (CAG_P_BITS / 2 + 1);
+	x *= CAG_P_M1;
+	x ^= x >> (CAG_P_BITS / 2 + 1);
+	x *= CAG_P_M2;
+	x ^= x >> (CAG_P_BITS / 2 + 1);
+	return x;
+}
+
+size_t cag_mix_int_hash(const int key, const size_t len)
+{
+	(void) len;
+	return cag_mix_hash((size_t) key ^ cag_hash_seed);
+}
+
+size_t cag_fast_hash(const void *key, const size_t len)
+{
+	return cag_seeded_hash(key, len, cag_hash_seed);
+}
+
+/* cag_fast_hash with an explicit seed, for hash values that must not depend
+   on cag_hash_seed, e.g. those stored in files.
+*/
+
+size_t cag_seeded_hash(const void *key, const size_t len, const size_t seed)
+{
+	const unsigned char *p = key;
+	size_t h = seed ^ (len * CAG_P_K2);
+	size_t w, i, n = len;
+
+	while (n >= sizeof(size_t)) {
+		memcpy(&w, p, sizeof(w));
+		w *= CAG_P_K1;
+		w = CAG_P_ROTL(w, CAG_P_BITS / 2 - 1);
+		w *= CAG_P_K2;
+		h ^= w;
+		h = CAG_P_ROTL(h, CAG_P_BITS / 2 - 5) * 5 + CAG_P_K1;
+		p += sizeof(size_t);
+		n -= sizeof(size_t);
+	}
+	if (n) {
+		w = 0;
+		for (i = 0; i < n; ++i)
+			w |= (size_t) p[i] << (i * CHAR_BIT);
+		w *= CAG_P_K1;
+		w = CAG_P_ROTL(w, CAG_P_BITS / 2 - 1);
+		w *= CAG_P_K2;
+		h ^= w;
+	}
+	return cag_mix_hash(h ^ len);
+}
+
+/* A hash value and the index it was passed at, for sorting equal hash values
+   next to each other.
+*/
+
+struct cag_p_member {
+	size_t hash;
+	size_t index;
+};
+
+static int cag_p_cmp_member(const void *a, const void *b)
+{
+	const size_t x = ((const struct cag_p_member *) a)->hash;
+	const size_t y = ((const struct cag_p_member *) b)->hash;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Minimal perfect hash function construction. See common.h. On success the
+   displacement of every group is stored in disp, which must have groups
+   elements, and the slot of hashes[i] in slots[i]. Returns 0 if memory runs
+   out or some group cannot be placed.
+*/
+
+int cag_perfect_hash(const size_t *hashes, const size_t n, size_t *disp,
+		     const size_t groups, size_t *slots)
+{
+	size_t i, j, k, g, d, m, r, max = 0;
+	size_t *first, *order, *count = NULL, *slot = NULL;
+	struct cag_p_member *members, *member;
+	unsigned char *taken;
+	int ok, run, blocks;
+
+	first = calloc(groups + 1, sizeof(*first));
+	members = malloc((n ? n : 1) * sizeof(*members));
+	order = malloc(groups * sizeof(*order));
+	taken = calloc(n ? n : 1, 1);
+	ok = first && members && order && taken;
+	if (ok) {
+		/* Counting sort of the values by group. */
+		for (i = 0; i < n; ++i)
+			++first[CAG_P_FROZEN_GROUP(hashes[i], groups) + 1];
+		for (g = 0; g < groups; ++g) {
+			if (first[g + 1] > max)
+				max = first[g + 1];
+			first[g + 1] += first[g];
+		}
+		for (i = 0; i < n; ++i) {
+			member = &members[first[CAG_P_FROZEN_GROUP(hashes[i],
+								   groups)]++];
+			member->hash = hashes[i];
+			member->index = i;
+		}
+		for (g = groups; g > 0; --g)
+			first[g] = first[g - 1];
+		first[0] = 0;
+		count = calloc(2 * max + 3, sizeof(*count));
+		slot = malloc((max ? max : 1) * sizeof(*slot));
+		ok = count && slot;
+	}
+	if (ok) {
+		/* Mark the groups with equal hash values. Large groups are
+		   sorted so that only neighbours need comparing. */
+		for (g = 0; g < groups; ++g) {
+			m = first[g + 1] - first[g];
+			member = &members[first[g]];
+			if (m > CAG_P_FROZEN_SCAN)
+				qsort(member, m, sizeof(*member), cag_p_cmp_member);
+			for (j = 1, run = 0; !run && j < m; ++j)
+				for (i = m > CAG_P_FROZEN_SCAN ? j - 1 : 0;
+				     i < j; ++i)
+					if (member[i].hash == member[j].hash)
+						run = 1;
+			disp[g] = run ? CAG_P_FROZEN_RUN : 0;
+		}
+		/* Counting sort of the groups, those with equal values first,
+		   then largest first. */
+		for (g = 0; g < groups; ++g) {
+			r = (disp[g] ? 0 : max + 1) + max - (first[g + 1] -
+							      first[g]);
+			++count[r + 1];
+		}
+		for (r = 0; r <= 2 * max + 1; ++r)
+			count[r + 1] += count[r];
+		for (g = 0; g < groups; ++g) {
+			r = (disp[g] ? 0 : max + 1) + max - (first[g + 1] -
+							      first[g]);
+			order[count[r]++] = g;
+		}
+	}
+	/* If the blocks leave too few free slots for some group, every group
+	   is stored as a block instead, which cannot fail. */
+	for (blocks = 0; ok && blocks < 2; ++blocks) {
+		memset(taken, 0, n);
+		for (i = 0, k = 0; ok && i < groups; ++i) {
+			g = order[i];
+			m = first[g + 1] - first[g];
+			member = &members[first[g]];
+			run = (disp[g] & CAG_P_FROZEN_RUN) || (blocks && m > 1);
+			disp[g] = 0;
+			if (m == 0)
+				continue;
+			if (m == 1 || run) {
+				/* Stored directly. Blocks come first, so their
+				   members fill adjacent slots. */
+				while (taken[k])
+					++k;
+				for (j = 0; j < m; ++j) {
+					taken[k + j] = 1;
+					slots[member[j].index] = k + j;
+				}
+				disp[g] = k | CAG_P_FROZEN_DIRECT |
+					  (run ? CAG_P_FROZEN_RUN : 0);
+				continue;
+			}
+			for (d = 0; d < CAG_P_FROZEN_TRIES; ++d) {
+				for (j = 0; j < m; ++j) {
+					slot[j] = CAG_P_FROZEN_SLOT(
+						member[j].hash, d, n);
+					if (taken[slot[j]])
+						break;
+					taken[slot[j]] = 1;
+				}
+				if (j == m)
+					break;
+				while (j > 0)
+					taken[slot[--j]] = 0;
+			}
+			ok = d < CAG_P_FROZEN_TRIES;
+			disp[g] = d;
+			for (j = 0; j < m; ++j)
+				slots[member[j].index] = slot[j];
+		}
+		if (ok)
+			break;
+		ok = !blocks;
+	}
+	free(first);
+	free(members);
+	free(order);
+	free(taken);
+	free(count);
+	free(slot);
+	return ok;
+}
+
 /* Implementation of strdup which some C library implementations might not
    include.
 */
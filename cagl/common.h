@@ -86,6 +86,20 @@
 
 #endif
 
+/*! \brief Hint that the memory at address p will soon be read. Defaults to
+   nothing on compilers other than GCC and Clang.
+*/
+
+#ifndef CAG_PREFETCH
+
+#ifdef __GNUC__
+#define CAG_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define CAG_PREFETCH(p) ((void) (p))
+#endif
+
+#endif
+
 #ifndef CAG_RAND_RANGE
 
 /*! \brief Returns a random integer in the range [min, max).
@@ -159,6 +173,23 @@
 
 #define CAG_NO_FREE_FUNC(var)
 
+/*! \brief Inline strings. CAG_INLINE_STR_ALLOC_STYLE copies a C string into
+  the bytes that follow the element's node and points the element at the copy.
+  Containers use it together with CAG_INLINE_STR_EXTRA, the number of bytes to
+  allocate after the node, so that a node and its string take one allocation
+  and are freed together. Their insert functions set cag_node_end to the first
+  byte after the new node, taken from the node's allocation rather than from
+  the element, so that fortified string functions see the whole allocation.
+  Containers that store no such bytes use CAG_NO_NODE_EXTRA.
+*/
+
+#define CAG_INLINE_STR_ALLOC_STYLE(to, from, alloc_func, free_code) \
+    to = strcpy(cag_node_end, from)
+
+#define CAG_INLINE_STR_EXTRA(x) (strlen(x) + 1)
+
+#define CAG_NO_NODE_EXTRA(x) 0
+
 /*! All CAG container iterators can be dereferenced using this macro. */
 
 #define CAG_VALUE(it) (it)->value
@@ -1035,154 +1066,480 @@ CAG_DEC_ERASE_RANGE(function, container, iterator_type) \
     }
 
 
-/*! \brief Supporting private macros for CAG_SORT. */
+/*! \brief Supporting private macros for CAG_SORT. Ranges shorter than
+   CAG_P_INSERTION_SORT_LIMIT are insertion sorted and ranges longer than
+   CAG_P_NINTHER_LIMIT take the pivot as the median of three medians of three.
+   A partial insertion sort gives up after CAG_P_PARTIAL_INSERTION_LIMIT moves.
+   Elements no larger than CAG_P_BLOCK_PARTITION_SIZE bytes are partitioned in
+   blocks of CAG_P_PARTITION_BLOCK without branching on the comparisons.
+*/
 
 #define CAG_P_INSERTION_SORT_LIMIT 32
+#define CAG_P_NINTHER_LIMIT 128
+#define CAG_P_PARTIAL_INSERTION_LIMIT 8
+#define CAG_P_PARTITION_BLOCK 64
+
+#ifndef CAG_P_BLOCK_PARTITION_SIZE
+
+#define CAG_P_BLOCK_PARTITION_SIZE 16
 
-/*! \brief Private algorithm to do insertion sort. */
+#endif
+
+/*! \brief Private algorithm to do insertion sort on the n elements starting at
+   from. The unguarded version assumes that the element before from is no
+   greater than any in the range, which spares a test in the inner loop.
+*/
 
-#define CAG_P_INSERTION_SORT(from, to, i, j, p, value, prev, next, lteq, \
+#define CAG_P_INSERTION_SORT(from, n, i, j, k, p, value, prev, next, \
                              cmp, val_adr) \
 do { \
-    for (i = next(from); lteq(i, to); i = next(i)) { \
-        p = value(i); \
-        j = i; \
-        while (j != from && cmp(val_adr value(prev(j)), \
-                                val_adr p) > 0) { \
-            value(j) = value(prev(j)); \
-            j = prev(j); \
+    if ((n) > 1) \
+        for (i = next(from), k = 1; k < (n); i = next(i), ++k) { \
+            p = value(i); \
+            for (j = i; j != (from) && cmp(val_adr p, \
+                                           val_adr value(prev(j))) < 0; \
+                    j = prev(j)) \
+                value(j) = value(prev(j)); \
+            value(j) = p; \
         } \
-        value(j) = p; \
-    } \
 } while (0)
 
-/*! \brief Private algorithm to select pivot randomly in Quicksort. */
-
-#define CAG_P_RANDOM_PIVOT(from, to, dist, at, value, pivot, swap, result) \
-    do { \
-        size_t i = CAG_RAND() % dist; /* better randomness unnecessary */ \
-        pivot = at(from, i); \
-        swap(from, pivot); \
-        result = value(from); \
-    } while(0)
+#define CAG_P_UNGUARDED_INSERTION_SORT(from, n, i, j, k, p, value, prev, \
+                                       next, cmp, val_adr) \
+do { \
+    if ((n) > 1) \
+        for (i = next(from), k = 1; k < (n); i = next(i), ++k) { \
+            p = value(i); \
+            for (j = i; cmp(val_adr p, val_adr value(prev(j))) < 0; \
+                    j = prev(j)) \
+                value(j) = value(prev(j)); \
+            value(j) = p; \
+        } \
+} while (0)
 
-/*! \brief Private algorithm to select median of 3 pivot in Quicksort. */
+/*! \brief Private insertion sort that gives up once it has moved more than
+   CAG_P_PARTIAL_INSERTION_LIMIT elements. Sets result to whether the range was
+   sorted. Used to finish off ranges that look sorted after partitioning.
+*/
 
-#define CAG_P_MEDIAN_3_SELECT(from, to, dist, at, value, median, \
-                              swap, cmp, val_adr, result) \
+#define CAG_P_PARTIAL_INSERTION_SORT(from, n, i, j, k, moves, p, value, prev, \
+                                     next, cmp, val_adr, result) \
 do { \
-    median = at(from, dist / 2); \
-    if (cmp(val_adr value(from), val_adr value(median)) > 0) { \
-        if (cmp(val_adr value(median), \
-                val_adr value(to)) > 0) { \
-            swap(from, median); \
-        } else if (cmp(val_adr value(from), \
-                       val_adr value(to)) > 0) { \
-            swap(from, to); \
+    result = 1; \
+    moves = 0; \
+    if ((n) > 1) \
+        for (i = next(from), k = 1; k < (n); i = next(i), ++k) { \
+            if (cmp(val_adr value(i), val_adr value(prev(i))) >= 0) \
+                continue; \
+            p = value(i); \
+            for (j = i; j != (from) && cmp(val_adr p, \
+                                           val_adr value(prev(j))) < 0; \
+                    j = prev(j), ++moves) \
+                value(j) = value(prev(j)); \
+            value(j) = p; \
+            if (moves > CAG_P_PARTIAL_INSERTION_LIMIT) { \
+                result = 0; \
+                break; \
+            } \
         } \
+} while (0)
+
+/*! \brief Private algorithm to order the elements at three iterators. */
+
+#define CAG_P_SORT_2(a, b, value, swap, cmp, val_adr) \
+    if (cmp(val_adr value(b), val_adr value(a)) < 0) \
+        swap(a, b)
+
+#define CAG_P_SORT_3(a, b, c, value, swap, cmp, val_adr) \
+do { \
+    CAG_P_SORT_2(a, b, value, swap, cmp, val_adr); \
+    CAG_P_SORT_2(b, c, value, swap, cmp, val_adr); \
+    CAG_P_SORT_2(a, b, value, swap, cmp, val_adr); \
+} while (0)
+
+/*! \brief Private pivot selection for Quicksort. Moves the median of the
+   first, middle and last of the n elements to from, or for long ranges the
+   median of three such medians. Either way some element after from is then
+   no less than the pivot, which lets partitioning scan without bounds checks.
+*/
+
+#define CAG_P_SELECT_PIVOT(iterator_type, from, to, n, a, b, c, at, prev, \
+                           next, value, swap, cmp, val_adr) \
+do { \
+    iterator_type cag_mid = at(from, (n) / 2); \
+    a = from; \
+    c = prev(to); \
+    if ((n) > CAG_P_NINTHER_LIMIT) { \
+        CAG_P_SORT_3(a, cag_mid, c, value, swap, cmp, val_adr); \
+        a = next(a); \
+        b = prev(cag_mid); \
+        c = prev(c); \
+        CAG_P_SORT_3(a, b, c, value, swap, cmp, val_adr); \
+        a = next(a); \
+        b = next(cag_mid); \
+        c = prev(c); \
+        CAG_P_SORT_3(a, b, c, value, swap, cmp, val_adr); \
+        a = prev(cag_mid); \
+        CAG_P_SORT_3(a, cag_mid, b, value, swap, cmp, val_adr); \
+        a = from; \
+        swap(a, cag_mid); \
     } else { \
-        if (cmp(val_adr value(to), val_adr value(median)) > 0) { \
-            swap(from, median); \
-        }  else if (cmp(val_adr value(to), val_adr value(from)) > 0) { \
-            swap(from, to); \
-        } \
+        CAG_P_SORT_3(cag_mid, a, c, value, swap, cmp, val_adr); \
     } \
-    result = value(from); \
-} while(0)
+} while (0)
 
-/* \brief Private Lomuto partitioning algorithm that can be used by
-   Quicksort.
+/*! \brief Private partitioning around the pivot at from, with elements equal
+   to the pivot going right. Sets pos to the final place of the pivot, pos_n
+   to its distance from from and partitioned to whether no elements had to be
+   moved. Positions are tracked as counts so that only next and prev are
+   needed. Small elements are partitioned in blocks: first the misplaced
+   elements of a block on each side are found without branching on the
+   comparisons, then they are swapped pairwise.
 */
 
-#define CAG_P_LOMUTO_PARTITION(from, to, i, j, p, next, value, lteq, swap, \
-                               cmp, val_adr) \
+#define CAG_P_PARTITION_RIGHT(iterator_type, type, from, to, n, p, pos, \
+                              pos_n, partitioned, prev, next, value, swap, \
+                              cmp, val_adr) \
 do { \
-    j = from; \
-    for (i = next(from); lteq(i, to); i = next(i)) { \
-        if (cmp(val_adr value(i), val_adr p) < 0) { \
-            j = next(j); \
-            swap(i, j); \
+    iterator_type cag_f = from; \
+    iterator_type cag_l = to; \
+    size_t cag_fi = 0, cag_li = (n); \
+    p = value(from); \
+    do { \
+        cag_f = next(cag_f); \
+        ++cag_fi; \
+    } while (cmp(val_adr value(cag_f), val_adr p) < 0); \
+    if (cag_fi == 1) { \
+        while (cag_fi < cag_li) { \
+            cag_l = prev(cag_l); \
+            --cag_li; \
+            if (cmp(val_adr value(cag_l), val_adr p) < 0) \
+                break; \
         } \
+    } else { \
+        do { \
+            cag_l = prev(cag_l); \
+            --cag_li; \
+        } while (cmp(val_adr value(cag_l), val_adr p) >= 0); \
     } \
-    swap(from, j); \
-} while(0)
-
+    partitioned = cag_fi >= cag_li; \
+    if (!partitioned && sizeof(type) <= CAG_P_BLOCK_PARTITION_SIZE) { \
+        iterator_type cag_bl[CAG_P_PARTITION_BLOCK]; \
+        iterator_type cag_br[CAG_P_PARTITION_BLOCK]; \
+        size_t cag_nl = 0, cag_nr = 0, cag_sl = 0, cag_sr = 0; \
+        size_t cag_ls, cag_rs, cag_k; \
+        swap(cag_f, cag_l); \
+        cag_f = next(cag_f); \
+        ++cag_fi; \
+        while (cag_fi < cag_li) { \
+            cag_ls = cag_nl ? 0 : cag_nr ? cag_li - cag_fi \
+                     : (cag_li - cag_fi) / 2; \
+            cag_rs = cag_nr ? 0 : cag_li - cag_fi - cag_ls; \
+            if (cag_ls > CAG_P_PARTITION_BLOCK) \
+                cag_ls = CAG_P_PARTITION_BLOCK; \
+            if (cag_rs > CAG_P_PARTITION_BLOCK) \
+                cag_rs = CAG_P_PARTITION_BLOCK; \
+            for (cag_k = 0; cag_k < cag_ls; ++cag_k) { \
+                cag_bl[cag_nl] = cag_f; \
+                cag_nl += cmp(val_adr value(cag_f), val_adr p) >= 0; \
+                cag_f = next(cag_f); \
+            } \
+            cag_fi += cag_ls; \
+            for (cag_k = 0; cag_k < cag_rs; ++cag_k) { \
+                cag_l = prev(cag_l); \
+                cag_br[cag_nr] = cag_l; \
+                cag_nr += cmp(val_adr value(cag_l), val_adr p) < 0; \
+            } \
+            cag_li -= cag_rs; \
+            cag_k = cag_nl < cag_nr ? cag_nl : cag_nr; \
+            cag_nl -= cag_k; \
+            cag_nr -= cag_k; \
+            while (cag_k--) { \
+                swap(cag_bl[cag_sl], cag_br[cag_sr]); \
+                ++cag_sl; \
+                ++cag_sr; \
+            } \
+            if (!cag_nl) \
+                cag_sl = 0; \
+            if (!cag_nr) \
+                cag_sr = 0; \
+        } \
+        if (cag_nl) { \
+            while (cag_nl) { \
+                cag_l = prev(cag_l); \
+                --cag_li; \
+                --cag_nl; \
+                swap(cag_bl[cag_sl + cag_nl], cag_l); \
+            } \
+            cag_f = cag_l; \
+            cag_fi = cag_li; \
+        } \
+        while (cag_nr) { \
+            --cag_nr; \
+            swap(cag_br[cag_sr + cag_nr], cag_f); \
+            cag_f = next(cag_f); \
+            ++cag_fi; \
+        } \
+    } else { \
+        while (cag_fi < cag_li) { \
+            swap(cag_f, cag_l); \
+            do { \
+                cag_f = next(cag_f); \
+                ++cag_fi; \
+            } while (cmp(val_adr value(cag_f), val_adr p) < 0); \
+            do { \
+                cag_l = prev(cag_l); \
+                --cag_li; \
+            } while (cmp(val_adr value(cag_l), val_adr p) >= 0); \
+        } \
+    } \
+    pos = prev(cag_f); \
+    pos_n = cag_fi - 1; \
+    value(from) = value(pos); \
+    value(pos) = p; \
+} while (0)
 
-/* \brief Private Hoare partitioning algorithm that can be used by Quicksort. */
+/*! \brief Private partitioning around the pivot at from, with elements equal
+   to the pivot going left. Used when the pivot equals the element before
+   from, which is known to be no greater than any element of the range, so
+   that all elements equal to the pivot are put in their final place at once.
+*/
 
-#define CAG_P_HOARE_PARTITION(from, to, i, j, p, prev, next, \
-                              value, lt, swap, cmp, val_adr) \
+#define CAG_P_PARTITION_LEFT(iterator_type, from, to, n, p, pos, pos_n, prev, \
+                             next, value, swap, cmp, val_adr) \
 do { \
-    i = from; \
-    j = next(to); \
+    iterator_type cag_f = from; \
+    iterator_type cag_l = to; \
+    size_t cag_fi = 0, cag_li = (n); \
+    p = value(from); \
     do { \
+        cag_l = prev(cag_l); \
+        --cag_li; \
+    } while (cmp(val_adr p, val_adr value(cag_l)) < 0); \
+    if (cag_li + 1 == (n)) { \
+        while (cag_fi < cag_li) { \
+            cag_f = next(cag_f); \
+            ++cag_fi; \
+            if (cmp(val_adr p, val_adr value(cag_f)) < 0) \
+                break; \
+        } \
+    } else { \
         do { \
-            i = next(i); \
-        } while(cmp(val_adr value(i), val_adr p) < 0 && i != to); \
+            cag_f = next(cag_f); \
+            ++cag_fi; \
+        } while (cmp(val_adr p, val_adr value(cag_f)) >= 0); \
+    } \
+    while (cag_fi < cag_li) { \
+        swap(cag_f, cag_l); \
         do { \
-            j = prev(j); \
-        } while(cmp(val_adr value(j), val_adr p) > 0); \
-        swap(i, j); \
-    } while(lt(i, j)); \
-    swap(i, j); \
-    swap(from, j); \
-} while(0)
+            cag_l = prev(cag_l); \
+            --cag_li; \
+        } while (cmp(val_adr p, val_adr value(cag_l)) < 0); \
+        do { \
+            cag_f = next(cag_f); \
+            ++cag_fi; \
+        } while (cmp(val_adr p, val_adr value(cag_f)) >= 0); \
+    } \
+    pos = cag_l; \
+    pos_n = cag_li; \
+    value(from) = value(pos); \
+    value(pos) = p; \
+} while (0)
+
+/*! \brief Private Heapsort of the n elements starting at from. The fallback
+   that bounds Quicksort to O(n log n) when partitioning keeps going badly.
+*/
+
+#define CAG_P_HEAP_SORT(iterator_type, from, n, p, at, next, value, swap, \
+                        cmp, val_adr) \
+do { \
+    iterator_type cag_r; \
+    iterator_type cag_c; \
+    size_t cag_start = (n) / 2, cag_end = (n), cag_root, cag_child; \
+    while (cag_end > 1) { \
+        if (cag_start > 0) { \
+            cag_root = --cag_start; \
+        } else { \
+            cag_c = at(from, --cag_end); \
+            swap(from, cag_c); \
+            cag_root = 0; \
+        } \
+        cag_r = at(from, cag_root); \
+        p = value(cag_r); \
+        while ((cag_child = 2 * cag_root + 1) < cag_end) { \
+            cag_c = at(from, cag_child); \
+            if (cag_child + 1 < cag_end && \
+                    cmp(val_adr value(cag_c), \
+                        val_adr value(next(cag_c))) < 0) { \
+                cag_c = next(cag_c); \
+                ++cag_child; \
+            } \
+            if (cmp(val_adr p, val_adr value(cag_c)) >= 0) \
+                break; \
+            value(cag_r) = value(cag_c); \
+            cag_r = cag_c; \
+            cag_root = cag_child; \
+        } \
+        value(cag_r) = p; \
+    } \
+} while (0)
 
 /*! Very fast sorting algorithm for random access iterators. Also works on
-   bidirectional iterators. Uses Quicksort with random pivot selection followed
-   by median of 3 pivot selection, Hoare partitioning and Insertion sort for
-   small sub arrays. A manually maintained stack is used instead of
-   recursion. The average time efficiency class is O(n log n), including sorted,
-   reverse-sorted and randomly generated sequences. There are theoretically some
-   sequences which result in O(n^2) behaviour. I'm not sure if these can be
-   generated using adversarial methods. The odds of such a sequence arising
-   naturally are vanishingly small. Perhaps at some point this algorithm might
-   be enhanced to use Introsort, but for now it seems unnecessary.
+   bidirectional iterators. Uses pattern-defeating Quicksort: the pivot is the
+   median of 3, or of 9 for long ranges, and small ranges are insertion sorted.
+   A range whose pivot equals the pivot that bounds it from the left is
+   partitioned with all elements equal to the pivot going left, and those are
+   then done, so runs of equal keys take linear time. A partition that moved
+   nothing is finished by a partial insertion sort, so sorted and reverse
+   sorted ranges also take linear time. Badly unbalanced partitions have some
+   elements swapped to break up patterns, and after log2(n) of them the range
+   is Heapsorted, so the worst case is O(n log n), also for crafted input.
+   There is no randomness. A manually maintained stack is used instead of
+   recursion.
 */
 
 #define CAG_SORT(iterator_type, type, cmp, val_adr, distance, prev, \
                  next, at, lteq, lt, swap, value, from, to) \
+    CAG_P_SORT(iterator_type, type, cmp, val_adr, distance, prev, next, at, \
+               lteq, lt, swap, value, CAG_P_NO_SMALL_SORT, \
+               CAG_P_INSERTION_SORT_LIMIT, from, to)
+
+/*! \brief Same as CAG_SORT but ranges shorter than small_limit are first
+   offered to small_sort(it, n), which returns nonzero if it sorted the n
+   elements from it. Ranges it declines are insertion sorted.
+*/
+
+#define CAG_SMALL_SORT(iterator_type, type, cmp, val_adr, distance, prev, \
+                       next, at, lteq, lt, swap, value, small_sort, \
+                       small_limit, from, to) \
+    CAG_P_SORT(iterator_type, type, cmp, val_adr, distance, prev, next, at, \
+               lteq, lt, swap, value, small_sort, small_limit, from, to)
+
+#define CAG_P_NO_SMALL_SORT(it, n) 0
+
+#define CAG_P_SORT(iterator_type, type, cmp, val_adr, distance, prev, \
+                   next, at, lteq, lt, swap, value, small_sort, small_limit, \
+                   from, to) \
 do { \
-    int ip = 0; \
-    iterator_type beg[sizeof(type *) * CHAR_BIT]; \
-    iterator_type end[sizeof(type *) * CHAR_BIT]; \
-    iterator_type i; \
-    iterator_type j; \
-    iterator_type m; \
-    iterator_type _from; \
-    iterator_type _to; \
-    type p; \
-    beg[0] = (iterator_type) from; \
-    end[0] = (iterator_type) prev(to); \
-    while(ip >= 0) { \
-        _from = beg[ip]; \
-        _to = end[ip]; \
-        if (lt(_from, _to)) { \
-            size_t d = distance(_from, _to) + 1; \
-            if (d < CAG_P_INSERTION_SORT_LIMIT) { \
-                CAG_P_INSERTION_SORT(_from, _to, i, j, p, value, prev, next, \
-                                     lteq, cmp, val_adr); \
-                --ip; \
-            } else { \
-                CAG_P_RANDOM_PIVOT(_from, _to, d, at, value, m, swap, p); \
-                CAG_P_MEDIAN_3_SELECT(_from, _to, d, at, value, m, swap, \
-                                      cmp, val_adr, p); \
-                CAG_P_HOARE_PARTITION(_from, _to, i, j, p, prev, next, value, \
-                                      lt, swap, cmp, val_adr); \
-                if (distance(_from,j) < distance(j,_to) + 1) { \
-                    beg[ip] = next(j); \
-                    end[ip++] = _to; \
-                    beg[ip] = _from; \
-                    end[ip] = prev(j); \
-                } else { \
-                    beg[ip] =_from; \
-                    end[ip++] = prev(j); \
-                    beg[ip] = next(j); \
-                    end[ip] = _to; \
+    iterator_type cag_beg[sizeof(size_t) * CHAR_BIT]; \
+    iterator_type cag_end[sizeof(size_t) * CHAR_BIT]; \
+    size_t cag_len[sizeof(size_t) * CHAR_BIT]; \
+    int cag_bad[sizeof(size_t) * CHAR_BIT]; \
+    int cag_first[sizeof(size_t) * CHAR_BIT]; \
+    int cag_sp = 0, cag_budget, cag_leftmost, cag_ok; \
+    iterator_type cag_b; \
+    iterator_type cag_e; \
+    iterator_type cag_i; \
+    iterator_type cag_j; \
+    iterator_type cag_x; \
+    iterator_type cag_pos; \
+    size_t cag_n, cag_k, cag_moves, cag_pn, cag_ln, cag_rn; \
+    type cag_p; \
+    cag_beg[0] = (iterator_type) from; \
+    cag_end[0] = (iterator_type) to; \
+    cag_len[0] = distance(cag_beg[0], cag_end[0]); \
+    for (cag_n = cag_len[0], cag_bad[0] = 0; cag_n > 1; cag_n >>= 1) \
+        ++cag_bad[0]; \
+    cag_first[0] = 1; \
+    while (cag_sp >= 0) { \
+        cag_b = cag_beg[cag_sp]; \
+        cag_e = cag_end[cag_sp]; \
+        cag_n = cag_len[cag_sp]; \
+        cag_budget = cag_bad[cag_sp]; \
+        cag_leftmost = cag_first[cag_sp--]; \
+        for (;;) { \
+            if (cag_n < (small_limit)) { \
+                if (small_sort(cag_b, cag_n)) \
+                    break; \
+                if (cag_leftmost) \
+                    CAG_P_INSERTION_SORT(cag_b, cag_n, cag_i, cag_j, cag_k, \
+                                         cag_p, value, prev, next, cmp, \
+                                         val_adr); \
+                else \
+                    CAG_P_UNGUARDED_INSERTION_SORT(cag_b, cag_n, cag_i, \
+                                                   cag_j, cag_k, cag_p, \
+                                                   value, prev, next, cmp, \
+                                                   val_adr); \
+                break; \
+            } \
+            CAG_P_SELECT_PIVOT(iterator_type, cag_b, cag_e, cag_n, cag_i, \
+                               cag_j, cag_x, at, prev, next, value, swap, \
+                               cmp, val_adr); \
+            if (!cag_leftmost && cmp(val_adr value(prev(cag_b)), \
+                                     val_adr value(cag_b)) >= 0) { \
+                CAG_P_PARTITION_LEFT(iterator_type, cag_b, cag_e, cag_n, \
+                                     cag_p, cag_pos, cag_pn, prev, next, \
+                                     value, swap, cmp, val_adr); \
+                cag_b = next(cag_pos); \
+                cag_n -= cag_pn + 1; \
+                continue; \
+            } \
+            CAG_P_PARTITION_RIGHT(iterator_type, type, cag_b, cag_e, cag_n, \
+                                  cag_p, cag_pos, cag_pn, cag_ok, prev, \
+                                  next, value, swap, cmp, val_adr); \
+            cag_ln = cag_pn; \
+            cag_rn = cag_n - cag_pn - 1; \
+            if (cag_ln < cag_n / 8 || cag_rn < cag_n / 8) { \
+                if (--cag_budget == 0) { \
+                    CAG_P_HEAP_SORT(iterator_type, cag_b, cag_n, cag_p, at, \
+                                    next, value, swap, cmp, val_adr); \
+                    break; \
+                } \
+                if (cag_ln >= CAG_P_INSERTION_SORT_LIMIT) { \
+                    for (cag_k = 0; cag_k < (cag_ln > CAG_P_NINTHER_LIMIT \
+                                             ? 3 : 1); ++cag_k) { \
+                        cag_i = at(cag_b, cag_k); \
+                        cag_j = at(cag_b, cag_k + cag_ln / 4); \
+                        swap(cag_i, cag_j); \
+                        cag_i = at(cag_b, cag_ln - 1 - cag_k); \
+                        cag_j = at(cag_b, cag_ln - cag_k - cag_ln / 4); \
+                        swap(cag_i, cag_j); \
+                    } \
+                } \
+                if (cag_rn >= CAG_P_INSERTION_SORT_LIMIT) { \
+                    for (cag_k = 1; cag_k <= (cag_rn > CAG_P_NINTHER_LIMIT \
+                                              ? 3 : 1); ++cag_k) { \
+                        cag_i = at(cag_pos, cag_k); \
+                        cag_j = at(cag_pos, cag_k + cag_rn / 4); \
+                        swap(cag_i, cag_j); \
+                        cag_i = at(cag_pos, cag_rn + 1 - cag_k); \
+                        cag_j = at(cag_pos, cag_rn + 2 - cag_k - cag_rn / 4); \
+                        swap(cag_i, cag_j); \
+                    } \
+                } \
+            } else if (cag_ok) { \
+                CAG_P_PARTIAL_INSERTION_SORT(cag_b, cag_ln, cag_i, cag_j, \
+                                             cag_k, cag_moves, cag_p, value, \
+                                             prev, next, cmp, val_adr, \
+                                             cag_ok); \
+                if (cag_ok) { \
+                    cag_x = next(cag_pos); \
+                    CAG_P_PARTIAL_INSERTION_SORT(cag_x, cag_rn, cag_i, \
+                                                 cag_j, cag_k, cag_moves, \
+                                                 cag_p, value, prev, next, \
+                                                 cmp, val_adr, cag_ok); \
+                    if (cag_ok) \
+                        break; \
                 } \
             } \
-        } else { \
-            --ip; \
+            ++cag_sp; \
+            if (cag_ln < cag_rn) { \
+                cag_beg[cag_sp] = next(cag_pos); \
+                cag_end[cag_sp] = cag_e; \
+                cag_len[cag_sp] = cag_rn; \
+                cag_first[cag_sp] = 0; \
+                cag_e = cag_pos; \
+                cag_n = cag_ln; \
+            } else { \
+                cag_beg[cag_sp] = cag_b; \
+                cag_end[cag_sp] = cag_pos; \
+                cag_len[cag_sp] = cag_ln; \
+                cag_first[cag_sp] = cag_leftmost; \
+                cag_b = next(cag_pos); \
+                cag_n = cag_rn; \
+                cag_leftmost = 0; \
+            } \
+            cag_bad[cag_sp] = cag_budget; \
         } \
     } \
 } while(0)
@@ -1203,14 +1560,245 @@ CAG_DEC_SORT(function, iterator_type) \
     return from; \
 }
 
+#define CAG_DEF_SMALL_SORT(function, iterator_type, type, cmp, val_adr, \
+                           distance, prev, next, at, lteq, lt, swap, value, \
+                           small_sort, small_limit) \
+CAG_DEC_SORT(function, iterator_type) \
+{ \
+    CAG_SMALL_SORT(iterator_type, type, cmp, val_adr, distance, prev, \
+                   next, at, lteq, lt, swap, value, small_sort, small_limit, \
+                   from, to); \
+    return from; \
+}
+
+
+/*! Rearranges [from, to) so that the element at nth is the one that would be
+   there if the range were sorted, no element before nth is greater than it
+   and no element after it is less. Uses introselect: the partitioning of
+   CAG_SORT, but only the part that contains nth is partitioned further, so
+   the average time is O(n). After log2(n) badly unbalanced partitions the rest of the
+   range is Heapsorted, which bounds the worst case to O(n log n).
+*/
+
+#define CAG_NTH_ELEMENT(iterator_type, type, cmp, val_adr, distance, prev, \
+                        next, at, swap, value, from, nth, to) \
+do { \
+    iterator_type cag_b = (iterator_type) from; \
+    iterator_type cag_e = (iterator_type) to; \
+    iterator_type cag_i; \
+    iterator_type cag_j; \
+    iterator_type cag_x; \
+    iterator_type cag_pos; \
+    size_t cag_n, cag_k, cag_kk, cag_pn; \
+    int cag_budget = 0, cag_leftmost = 1, cag_ok; \
+    type cag_p; \
+    cag_n = distance(cag_b, cag_e); \
+    cag_k = distance(cag_b, (iterator_type) nth); \
+    for (cag_kk = cag_n; cag_kk > 1; cag_kk >>= 1) \
+        ++cag_budget; \
+    while (cag_k < cag_n) { \
+        if (cag_n < CAG_P_INSERTION_SORT_LIMIT) { \
+            if (cag_leftmost) \
+                CAG_P_INSERTION_SORT(cag_b, cag_n, cag_i, cag_j, cag_kk, \
+                                     cag_p, value, prev, next, cmp, \
+                                     val_adr); \
+            else \
+                CAG_P_UNGUARDED_INSERTION_SORT(cag_b, cag_n, cag_i, cag_j, \
+                                               cag_kk, cag_p, value, prev, \
+                                               next, cmp, val_adr); \
+            break; \
+        } \
+        CAG_P_SELECT_PIVOT(iterator_type, cag_b, cag_e, cag_n, cag_i, \
+                           cag_j, cag_x, at, prev, next, value, swap, cmp, \
+                           val_adr); \
+        if (!cag_leftmost && cmp(val_adr value(prev(cag_b)), \
+                                 val_adr value(cag_b)) >= 0) { \
+            CAG_P_PARTITION_LEFT(iterator_type, cag_b, cag_e, cag_n, cag_p, \
+                                 cag_pos, cag_pn, prev, next, value, swap, \
+                                 cmp, val_adr); \
+            if (cag_k <= cag_pn) \
+                break; \
+            cag_b = next(cag_pos); \
+            cag_k -= cag_pn + 1; \
+            cag_n -= cag_pn + 1; \
+            continue; \
+        } \
+        CAG_P_PARTITION_RIGHT(iterator_type, type, cag_b, cag_e, cag_n, \
+                              cag_p, cag_pos, cag_pn, cag_ok, prev, next, \
+                              value, swap, cmp, val_adr); \
+        if (cag_k == cag_pn) \
+            break; \
+        if ((cag_pn < cag_n / 8 || cag_n - cag_pn - 1 < cag_n / 8) && \
+                --cag_budget == 0) { \
+            CAG_P_HEAP_SORT(iterator_type, cag_b, cag_n, cag_p, at, next, \
+                            value, swap, cmp, val_adr); \
+            break; \
+        } \
+        if (cag_k < cag_pn) { \
+            cag_e = cag_pos; \
+            cag_n = cag_pn; \
+        } else { \
+            cag_b = next(cag_pos); \
+            cag_k -= cag_pn + 1; \
+            cag_n -= cag_pn + 1; \
+            cag_leftmost = 0; \
+        } \
+    } \
+} while (0)
+
+/*! \brief Declaration and definition of nth_element. Returns nth. */
+
+#define CAG_DEC_NTH_ELEMENT(function, iterator_type) \
+    iterator_type function(iterator_type from, iterator_type nth, \
+                           iterator_type to)
+
+#define CAG_DEF_NTH_ELEMENT(function, iterator_type, type, cmp, val_adr, \
+                            distance, prev, next, at, swap, value) \
+CAG_DEC_NTH_ELEMENT(function, iterator_type) \
+{ \
+    CAG_NTH_ELEMENT(iterator_type, type, cmp, val_adr, distance, prev, next, \
+                    at, swap, value, from, nth, to); \
+    return nth; \
+}
+
+/*! \brief Declaration and definition of partial_sort, which sorts the
+   elements of [from, to) that belong in [from, middle) into that part of the
+   range, leaving the rest in unspecified order. Selects middle with
+   nth_element and then sorts the part before it, which is O(n + k log k)
+   for k elements before middle.
+*/
+
+#define CAG_DEC_PARTIAL_SORT(function, iterator_type) \
+    iterator_type function(iterator_type from, iterator_type middle, \
+                           iterator_type to)
+
+#define CAG_DEF_PARTIAL_SORT(function, iterator_type, nth_element, sort) \
+CAG_DEC_PARTIAL_SORT(function, iterator_type) \
+{ \
+    if (middle != to) \
+        nth_element(from, middle, to); \
+    sort(from, middle); \
+    return from; \
+}
+
+/*! \brief Private sift down of p into a heap of n elements, with the
+   greatest element at the top, starting at position root. elem(heap, i) is
+   the i-th element of the heap.
+*/
+
+#define CAG_P_SIFT_DOWN(heap, root, child, n, p, elem, cmp, val_adr) \
+do { \
+    while ((child = 2 * root + 1) < (n)) { \
+        if (child + 1 < (n) && cmp(val_adr elem(heap, child), \
+                                   val_adr elem(heap, child + 1)) < 0) \
+            ++child; \
+        if (cmp(val_adr p, val_adr elem(heap, child)) >= 0) \
+            break; \
+        elem(heap, root) = elem(heap, child); \
+        root = child; \
+    } \
+    elem(heap, root) = p; \
+} while (0)
+
+/*! \brief Element accessors for CAG_P_TOP_K: an element of a C array, or the
+   value of an element of an array container given its first iterator.
+*/
+
+#define CAG_P_ELEM(heap, i) (heap)[i]
+
+#define CAG_P_ELEM_VALUE(heap, i) (heap)[i].value
+
+/*! \brief Private heap selection of the k smallest elements of [from, to)
+   into heap, in sorted order. Sets count to the number copied, which is k
+   unless the range is shorter. Only needs forward iteration over the range.
+   The first k elements make a heap with the greatest at the top, and each
+   later element that is less than the top replaces it. Finally the heap is
+   sorted in place. O(n log k) in the worst case, and O(n + k log k log n) on
+   average for random order.
+*/
+
+#define CAG_P_TOP_K(iterator_type, type, from, to, heap, k, count, elem, next, \
+                    value, cmp, val_adr) \
+do { \
+    iterator_type cag_it = from; \
+    size_t cag_i, cag_root, cag_child; \
+    type cag_p; \
+    for (count = 0; cag_it != (to) && count < (k); cag_it = next(cag_it)) \
+        elem(heap, count++) = value(cag_it); \
+    for (cag_i = count / 2; cag_i-- > 0; ) { \
+        cag_root = cag_i; \
+        cag_p = elem(heap, cag_root); \
+        CAG_P_SIFT_DOWN(heap, cag_root, cag_child, count, cag_p, elem, cmp, \
+                        val_adr); \
+    } \
+    if (count > 0) \
+        for (; cag_it != (to); cag_it = next(cag_it)) \
+            if (cmp(val_adr value(cag_it), val_adr elem(heap, 0)) < 0) { \
+                cag_root = 0; \
+                cag_p = value(cag_it); \
+                CAG_P_SIFT_DOWN(heap, cag_root, cag_child, count, cag_p, \
+                                elem, cmp, val_adr); \
+            } \
+    for (cag_i = count; cag_i > 1; ) { \
+        cag_p = elem(heap, --cag_i); \
+        elem(heap, cag_i) = elem(heap, 0); \
+        cag_root = 0; \
+        CAG_P_SIFT_DOWN(heap, cag_root, cag_child, cag_i, cag_p, elem, cmp, \
+                        val_adr); \
+    } \
+} while (0)
+
+/*! \brief Declaration and definition of partial_sort_copy, which copies the
+   smallest elements of [from, to) in sorted order to [result_from,
+   result_to), as many as fit. Returns the iterator one past the last element
+   copied. Requires iterators that are pointers, like those of arrays.
+*/
+
+#define CAG_DEC_PARTIAL_SORT_COPY(function, iterator_type) \
+    iterator_type function(iterator_type from, iterator_type to, \
+                           iterator_type result_from, \
+                           iterator_type result_to)
+
+#define CAG_DEF_PARTIAL_SORT_COPY(function, iterator_type, type, next, value, \
+                                  cmp, val_adr) \
+CAG_DEC_PARTIAL_SORT_COPY(function, iterator_type) \
+{ \
+    size_t count; \
+    CAG_P_TOP_K(iterator_type, type, from, to, result_from, \
+                (size_t) (result_to - result_from), count, \
+                CAG_P_ELEM_VALUE, next, value, cmp, val_adr); \
+    return result_from + count; \
+}
+
+/*! \brief Declaration and definition of top_k, which copies the k smallest
+   elements of [from, to) in sorted order to the C array out, which must have
+   room for k elements. Returns the number of elements copied, which is less
+   than k if the range is shorter. Works with forward iterators. The copies
+   are shallow.
+*/
+
+#define CAG_DEC_TOP_K(function, iterator_type, type) \
+    size_t function(iterator_type from, iterator_type to, type *out, \
+                    size_t k)
+
+#define CAG_DEF_TOP_K(function, iterator_type, type, next, value, cmp, \
+                      val_adr) \
+CAG_DEC_TOP_K(function, iterator_type, type) \
+{ \
+    size_t count; \
+    CAG_P_TOP_K(iterator_type, type, from, to, out, k, count, CAG_P_ELEM, \
+                next, value, cmp, val_adr); \
+    return count; \
+}
+
 
 /*! \brief Generic stable sort. Works on bidirectional iterators. O(n log n)
    efficiency.
 
    Implementation is a mergesort with O(n) extra space. Instead of recursion a
    manually managed stack is used. For single-linked lists a specialised
-   mergesort has been implemented in slist.h. The same should perhaps be done
-   for double-linked lists.
+   mergesort has been implemented in slist.h. Double-linked lists also have
+   relink_sort_C in dlist.h, which relinks nodes instead of copying values.
 
    This code needs to be reworked. It also does not error check in several
    places.
@@ -1281,62 +1869,325 @@ do { \
 } while(0)
 
 
-/* \brief Declaration and definition of stable sort that performs a Mergesort
-   with theta(n) extra space.
+/*! \brief Private constants of the stable sort. Sequences shorter than
+   CAG_P_MIN_MERGE are insertion sorted. CAG_P_MIN_GALLOP is the initial number
+   of consecutive wins by one run after which a merge starts galloping.
+   CAG_P_MAX_RUNS bounds the number of pending runs, which grow at least as
+   fast as the Fibonacci numbers.
+*/
+
+#define CAG_P_MIN_MERGE 64
+#define CAG_P_MIN_GALLOP 7
+#define CAG_P_MAX_RUNS (sizeof(size_t) * CHAR_BIT * 2)
+
+/*! \brief Private galloping search over the scratch buffer of the stable sort.
+   Counts how many of the len elements buf[start sign 0], buf[start sign 1],
+   ... satisfy cmp(element, key) op 0, assuming those that do come first.
+   Probes at exponentially growing distances and then binary searches the last
+   gap.
+*/
+
+#define CAG_P_GALLOP_BUFFER(buf, start, len, sign, key, op, cmp, val_adr, \
+                            result) \
+do { \
+    size_t g_lo = 0, g_hi = (len), g_step = 1, g_mid; \
+    while (g_lo < g_hi) { \
+        g_mid = g_step < g_hi - g_lo ? g_lo + g_step - 1 : g_hi - 1; \
+        if (cmp(val_adr buf[(start) sign g_mid], val_adr key) op 0) { \
+            g_lo = g_mid + 1; \
+            g_step *= 2; \
+        } else { \
+            g_hi = g_mid; \
+            break; \
+        } \
+    } \
+    while (g_lo < g_hi) { \
+        g_mid = g_lo + (g_hi - g_lo) / 2; \
+        if (cmp(val_adr buf[(start) sign g_mid], val_adr key) op 0) \
+            g_lo = g_mid + 1; \
+        else \
+            g_hi = g_mid; \
+    } \
+    result = g_lo; \
+} while (0)
+
+/*! \brief Private galloping search over a run of the stable sort. The same as
+   CAG_P_GALLOP_BUFFER, but walks the run from start with dir, so that it works
+   on bidirectional iterators. The walking is linear in the result, which is
+   no more than the cost of moving the elements found, but the number of
+   comparisons is logarithmic.
+*/
+
+#define CAG_P_GALLOP_RUN(iterator_type, start, len, dir, key, op, cmp, \
+                         val_adr, result) \
+do { \
+    iterator_type g_it = (start), g_p; \
+    size_t g_lo = 0, g_hi = (len), g_step = 1, g_mid, g_i; \
+    while (g_lo < g_hi) { \
+        g_mid = g_step < g_hi - g_lo ? g_lo + g_step - 1 : g_hi - 1; \
+        for (g_p = g_it, g_i = g_lo; g_i < g_mid; ++g_i) \
+            g_p = dir(g_p); \
+        if (cmp(val_adr g_p->value, val_adr key) op 0) { \
+            g_lo = g_mid + 1; \
+            g_step *= 2; \
+            if (g_lo < g_hi) \
+                g_it = dir(g_p); \
+        } else { \
+            g_hi = g_mid; \
+            break; \
+        } \
+    } \
+    while (g_lo < g_hi) { \
+        g_mid = g_lo + (g_hi - g_lo) / 2; \
+        for (g_p = g_it, g_i = g_lo; g_i < g_mid; ++g_i) \
+            g_p = dir(g_p); \
+        if (cmp(val_adr g_p->value, val_adr key) op 0) { \
+            g_lo = g_mid + 1; \
+            if (g_lo < g_hi) \
+                g_it = dir(g_p); \
+        } else { \
+            g_hi = g_mid; \
+        } \
+    } \
+    result = g_lo; \
+} while (0)
+
+/*! \brief Private merge of adjacent runs a (na elements) and b (nb elements)
+   of the stable sort, where na <= nb. Run a is moved to the scratch buffer and
+   the merge proceeds from the front. When one run wins min_gallop times in a
+   row the merge switches to galloping, copying whole stretches of a run at
+   once, and min_gallop adapts to how well that pays off.
+*/
+
+#define CAG_P_MERGE_LO(iterator_type, a, na, b, nb, buf, min_gallop, next, \
+                       cmp, val_adr) \
+do { \
+    iterator_type m_dest = (a), m_it = (a); \
+    size_t m_i = 0, m_k, m_ca, m_cb; \
+    for (m_k = 0; m_k < na; ++m_k, m_it = next(m_it)) \
+        buf[m_k] = m_it->value; \
+    while (na && nb) { \
+        m_ca = m_cb = 0; \
+        while (na && nb && m_ca < min_gallop && m_cb < min_gallop) { \
+            if (cmp(val_adr b->value, val_adr buf[m_i]) < 0) { \
+                m_dest->value = b->value; \
+                b = next(b); \
+                --nb; \
+                ++m_cb; \
+                m_ca = 0; \
+            } else { \
+                m_dest->value = buf[m_i++]; \
+                --na; \
+                ++m_ca; \
+                m_cb = 0; \
+            } \
+            m_dest = next(m_dest); \
+        } \
+        while (na && nb) { \
+            CAG_P_GALLOP_BUFFER(buf, m_i, na, +, b->value, <=, cmp, val_adr, \
+                                m_ca); \
+            for (m_k = 0; m_k < m_ca; ++m_k, m_dest = next(m_dest)) \
+                m_dest->value = buf[m_i++]; \
+            if (!(na -= m_ca)) \
+                break; \
+            CAG_P_GALLOP_RUN(iterator_type, b, nb, next, buf[m_i], <, cmp, \
+                             val_adr, m_cb); \
+            for (m_k = 0; m_k < m_cb; ++m_k, m_dest = next(m_dest)) { \
+                m_dest->value = b->value; \
+                b = next(b); \
+            } \
+            if (!(nb -= m_cb)) \
+                break; \
+            if (min_gallop > 1) \
+                --min_gallop; \
+            if (m_ca < CAG_P_MIN_GALLOP && m_cb < CAG_P_MIN_GALLOP) { \
+                min_gallop += 2; \
+                break; \
+            } \
+        } \
+    } \
+    for (m_k = 0; m_k < na; ++m_k, m_dest = next(m_dest)) \
+        m_dest->value = buf[m_i++]; \
+} while (0)
+
+/*! \brief Private merge of adjacent runs a (na elements, ending at b) and b
+   (nb elements, ending at b_end) of the stable sort, where na > nb. The mirror
+   image of CAG_P_MERGE_LO: run b is moved to the scratch buffer and the merge
+   proceeds from the back.
+*/
+
+#define CAG_P_MERGE_HI(iterator_type, b, na, b_end, nb, buf, min_gallop, \
+                       prev, next, cmp, val_adr) \
+do { \
+    iterator_type m_dest = (b_end), m_it = (b), m_a = (b); \
+    size_t m_k, m_ca, m_cb; \
+    for (m_k = 0; m_k < nb; ++m_k, m_it = next(m_it)) \
+        buf[m_k] = m_it->value; \
+    while (na && nb) { \
+        m_ca = m_cb = 0; \
+        while (na && nb && m_ca < min_gallop && m_cb < min_gallop) { \
+            m_it = prev(m_a); \
+            m_dest = prev(m_dest); \
+            if (cmp(val_adr buf[nb - 1], val_adr m_it->value) < 0) { \
+                m_dest->value = m_it->value; \
+                m_a = m_it; \
+                --na; \
+                ++m_ca; \
+                m_cb = 0; \
+            } else { \
+                m_dest->value = buf[--nb]; \
+                ++m_cb; \
+                m_ca = 0; \
+            } \
+        } \
+        while (na && nb) { \
+            CAG_P_GALLOP_RUN(iterator_type, prev(m_a), na, prev, buf[nb - 1], \
+                             >, cmp, val_adr, m_ca); \
+            for (m_k = 0; m_k < m_ca; ++m_k) { \
+                m_a = prev(m_a); \
+                m_dest = prev(m_dest); \
+                m_dest->value = m_a->value; \
+            } \
+            if (!(na -= m_ca)) \
+                break; \
+            m_it = prev(m_a); \
+            CAG_P_GALLOP_BUFFER(buf, nb - 1, nb, -, m_it->value, >=, cmp, \
+                                val_adr, m_cb); \
+            for (m_k = 0; m_k < m_cb; ++m_k) { \
+                m_dest = prev(m_dest); \
+                m_dest->value = buf[--nb]; \
+            } \
+            if (!nb) \
+                break; \
+            if (min_gallop > 1) \
+                --min_gallop; \
+            if (m_ca < CAG_P_MIN_GALLOP && m_cb < CAG_P_MIN_GALLOP) { \
+                min_gallop += 2; \
+                break; \
+            } \
+        } \
+    } \
+    while (nb) { \
+        m_dest = prev(m_dest); \
+        m_dest->value = buf[--nb]; \
+    } \
+} while (0)
+
+/*! \brief Declaration and definition of an adaptive stable sort that works on
+   bidirectional iterators.
+
+   The sequence is split into natural runs, strictly descending runs being
+   reversed and short runs extended to a minimum length by insertion sort. Runs
+   are kept on a stack and merged so that their lengths stay balanced, as in
+   Timsort. Each merge first skips the elements of either run that are already
+   in place, then copies the shorter run into a scratch buffer of at most n/2
+   elements, allocated once, and merges with galloping. Sorted, reverse sorted
+   and nearly sorted sequences take O(n) time, others O(n log n). Returns NULL
+   if the scratch buffer cannot be allocated, in which case the elements are
+   left in an unspecified order.
 */
 
 #define CAG_DEC_STABLE_SORT(function, iterator_type) \
     iterator_type function(iterator_type from, iterator_type to)
 
-#define CAG_DEF_STABLE_SORT(function, container, iterator_type, new_container, \
-                            free_container, begin, end, \
-                            next, distance, appendp, cmp, val_adr) \
+#define CAG_DEF_STABLE_SORT(function, iterator_type, type, prev, next, \
+                            distance, cmp, val_adr) \
 CAG_DEC_STABLE_SORT(function, iterator_type) \
 { \
-    container left, right; \
-    iterator_type it = from; \
-    size_t d, i; \
-    if ( (d = distance(from, to)) > 1) { \
-        new_container(&left); \
-        new_container(&right); \
-        for (i = 0; i < d / 2; ++i, it = next(it)) \
-            appendp(&left, &it->value); \
-        for (;it != to; it = next(it)) \
-            appendp(&right, &it->value); \
-        function(begin(&left), end(&left)); \
-        function(begin(&right), end(&right)); \
-        { \
-            iterator_type from1 = begin(&left); \
-            iterator_type to1 = end(&left); \
-            iterator_type from2 = begin(&right); \
-            iterator_type to2 = end(&right); \
-            iterator_type result = from; \
-            while(from1 != to1 && from2 != to2) { \
-                if (cmp(val_adr from1->value, val_adr from2->value) \
-                        <= 0) { \
-                    result->value = from1->value; \
-                    from1 = next(from1); \
-                } \
-                else { \
-                    result->value = from2->value; \
-                    from2 = next(from2); \
+    iterator_type base[CAG_P_MAX_RUNS + 1]; \
+    size_t len[CAG_P_MAX_RUNS + 1]; \
+    iterator_type lo = from, hi, a, b, j; \
+    size_t n = distance(from, to), rem = n, min_run = n, run, force, r = 0; \
+    size_t min_gallop = CAG_P_MIN_GALLOP, sp = 0, k, na, nb; \
+    type *buf = NULL; \
+    type t; \
+    while (min_run >= CAG_P_MIN_MERGE) { \
+        r |= min_run & 1; \
+        min_run >>= 1; \
+    } \
+    min_run += r; \
+    while (rem) { \
+        hi = next(lo); \
+        run = 1; \
+        if (rem > 1) { \
+            if (cmp(val_adr hi->value, val_adr lo->value) < 0) { \
+                do { \
+                    hi = next(hi); \
+                } while (++run < rem && \
+                         cmp(val_adr hi->value, \
+                             val_adr prev(hi)->value) < 0); \
+                for (a = lo, b = prev(hi), k = run / 2; k; --k) { \
+                    t = a->value; \
+                    a->value = b->value; \
+                    b->value = t; \
+                    a = next(a); \
+                    b = prev(b); \
                 } \
-                result = next(result); \
+            } else { \
+                do { \
+                    hi = next(hi); \
+                } while (++run < rem && \
+                         cmp(val_adr hi->value, \
+                             val_adr prev(hi)->value) >= 0); \
+            } \
+        } \
+        for (force = rem < min_run ? rem : min_run; run < force; \
+                ++run, hi = next(hi)) { \
+            t = hi->value; \
+            for (j = hi; j != lo && cmp(val_adr prev(j)->value, \
+                                        val_adr t) > 0; j = prev(j)) \
+                j->value = prev(j)->value; \
+            j->value = t; \
+        } \
+        if (run == n) \
+            return from; \
+        if (!buf && !(buf = CAG_MALLOC(n / 2 * sizeof(type)))) \
+            return NULL; \
+        base[sp] = lo; \
+        len[sp++] = run; \
+        base[sp] = lo = hi; \
+        len[sp] = 0; \
+        rem -= run; \
+        while (sp > 1) { \
+            k = sp - 2; \
+            if (!rem || (k > 0 && len[k - 1] <= len[k] + len[k + 1]) || \
+                    (k > 1 && len[k - 2] <= len[k - 1] + len[k])) { \
+                if (k > 0 && len[k - 1] < len[k + 1]) \
+                    --k; \
+            } else if (len[k] > len[k + 1]) { \
+                break; \
+            } \
+            a = base[k]; \
+            na = len[k]; \
+            b = base[k + 1]; \
+            nb = len[k + 1]; \
+            len[k] += nb; \
+            for (++k; k < sp; ++k) { \
+                base[k] = base[k + 1]; \
+                len[k] = len[k + 1]; \
+            } \
+            --sp; \
+            CAG_P_GALLOP_RUN(iterator_type, a, na, next, b->value, <=, cmp, \
+                             val_adr, k); \
+            if (!(na -= k)) \
+                continue; \
+            while (k--) \
+                a = next(a); \
+            j = prev(b); \
+            CAG_P_GALLOP_RUN(iterator_type, b, nb, next, j->value, <, cmp, \
+                             val_adr, nb); \
+            if (na <= nb) { \
+                CAG_P_MERGE_LO(iterator_type, a, na, b, nb, buf, min_gallop, \
+                               next, cmp, val_adr); \
+            } else { \
+                for (j = b, k = nb; k; --k) \
+                    j = next(j); \
+                CAG_P_MERGE_HI(iterator_type, b, na, j, nb, buf, min_gallop, \
+                               prev, next, cmp, val_adr); \
             } \
-            if (from1 != to1) \
-                for(;from1 != to1; \
-                        from1 = next(from1), \
-                        result = next(result)) \
-                    result->value = from1->value; \
-            else \
-                for(;from2 != to2; \
-                        from2 = next(from2), \
-                        result = next(result)) \
-                    result->value = from2->value; \
         } \
-        free_container(&left); \
-        free_container(&right); \
     } \
+    CAG_FREE(buf); \
     return from; \
 }
 
@@ -1558,6 +2409,352 @@ CAG_DEC_APPLY_IN_OUT(function, container_in, container_out, return_type) \
     CAG_FOLD(begin_ ## container(var), end_ ## container(var), \
              next_ ## container, left_it, right_it, code, result)
 
+/*! \brief Hash aggregation and hash join macros. Documented in user
+    documentation.
+
+    Each row is projected to an element of the hash table's type by a user
+    key macro, and the projection is hashed once. The hash value is kept with
+    the projection and handed to the *_hashed* functions of the table, so no
+    row is hashed twice. Tables are probed CAG_P_HASH_BATCH rows at a time
+    with get_many_hashed, which overlaps the cache misses of a batch.
+
+    When the projected rows used to build a table take more than
+    CAG_HASH_CACHE_SIZE bytes they are first radix partitioned on the top bits
+    of the hash value multiplied by the golden ratio. Those are the bits the
+    hash tables use to choose a bucket, so the inserts of one partition stay
+    within one slice of the table instead of ranging over all of it.
+*/
+
+#ifndef CAG_HASH_CACHE_SIZE
+#define CAG_HASH_CACHE_SIZE ((size_t) 1 << 18)
+#endif
+
+#define CAG_P_HASH_BATCH 16
+
+#define CAG_P_MAX_PARTITION_BITS 8
+
+#define CAG_P_PARTITION(h, bits) \
+    (((h) * CAG_P_GOLDEN_RATIO) >> (CAG_P_SIZE_T_BIT - (bits)))
+
+/*! \brief Count the rows of c in n. If their projections take more than
+    CAG_HASH_CACHE_SIZE bytes, project and hash them into the arrays rows and
+    hashes, ordered by partition, and otherwise set rows and hashes to NULL.
+    Rows keep their relative order within a partition. If memory for the
+    arrays cannot be had rows is also NULL and the caller streams the rows
+    from c instead.
+*/
+
+#define CAG_P_PARTITION_ROWS(container, c, type, key, hash_func, length_func, \
+                             rows, hashes, n) \
+do { \
+    it_ ## container cag_it = beg_ ## container(c); \
+    it_ ## container cag_end = end_ ## container(c); \
+    type *cag_in = NULL; \
+    size_t *cag_in_hashes = NULL; \
+    size_t cag_start[(1 << CAG_P_MAX_PARTITION_BITS) + 1]; \
+    size_t cag_i, cag_p, cag_bits = 0; \
+    rows = NULL; \
+    hashes = NULL; \
+    CAG_DISTANCE(cag_it, cag_end, next_ ## container, n); \
+    while (cag_bits < CAG_P_MAX_PARTITION_BITS && \
+            ((n) * sizeof(type)) >> cag_bits > CAG_HASH_CACHE_SIZE) \
+        ++cag_bits; \
+    if (cag_bits) { \
+        cag_in = CAG_MALLOC((n) * sizeof(type)); \
+        cag_in_hashes = CAG_MALLOC((n) * sizeof(size_t)); \
+        rows = CAG_MALLOC((n) * sizeof(type)); \
+        hashes = CAG_MALLOC((n) * sizeof(size_t)); \
+        if (cag_in && cag_in_hashes && rows && hashes) { \
+            memset(cag_start, 0, sizeof(cag_start)); \
+            for (cag_i = 0, cag_it = beg_ ## container(c); cag_i < (n); \
+                    ++cag_i, cag_it = next_ ## container(cag_it)) { \
+                cag_in[cag_i] = key(cag_it->value); \
+                cag_in_hashes[cag_i] = hash_func(cag_in[cag_i], \
+                                                 length_func(cag_in[cag_i])); \
+                ++cag_start[CAG_P_PARTITION(cag_in_hashes[cag_i], \
+                                            cag_bits) + 1]; \
+            } \
+            for (cag_p = 1; cag_p <= (size_t) 1 << cag_bits; ++cag_p) \
+                cag_start[cag_p] += cag_start[cag_p - 1]; \
+            for (cag_i = 0; cag_i < (n); ++cag_i) { \
+                cag_p = cag_start[CAG_P_PARTITION(cag_in_hashes[cag_i], \
+                                                  cag_bits)]++; \
+                rows[cag_p] = cag_in[cag_i]; \
+                hashes[cag_p] = cag_in_hashes[cag_i]; \
+            } \
+        } else { \
+            CAG_FREE(rows); \
+            CAG_FREE(hashes); \
+            rows = NULL; \
+            hashes = NULL; \
+        } \
+        CAG_FREE(cag_in); \
+        CAG_FREE(cag_in_hashes); \
+    } \
+} while (0)
+
+/*! \brief Run code on batches of at most CAG_P_HASH_BATCH projected rows and
+    their hash values, pointed to by batch and batch_hashes, with m set to the
+    size of the batch. The batches are taken from the arrays rows and hashes
+    made by CAG_P_PARTITION_ROWS if rows is not NULL, and are otherwise
+    projected and hashed from c as they are needed. Stops early once cond is
+    false.
+*/
+
+#define CAG_P_HASH_BATCHES(container, c, type, key, hash_func, length_func, \
+                           rows, hashes, n, batch, batch_hashes, m, cond, \
+                           code) \
+do { \
+    type cag_buf[CAG_P_HASH_BATCH]; \
+    size_t cag_buf_hashes[CAG_P_HASH_BATCH], cag_i; \
+    it_ ## container cag_it = beg_ ## container(c); \
+    it_ ## container cag_end = end_ ## container(c); \
+    if (rows) { \
+        for (cag_i = 0; cag_i < (n) && (cond); cag_i += m) { \
+            m = (n) - cag_i < CAG_P_HASH_BATCH \
+                ? (n) - cag_i : CAG_P_HASH_BATCH; \
+            batch = (rows) + cag_i; \
+            batch_hashes = (hashes) + cag_i; \
+            code; \
+        } \
+    } else { \
+        while (cag_it != cag_end && (cond)) { \
+            for (m = 0; m < CAG_P_HASH_BATCH && cag_it != cag_end; \
+                    ++m, cag_it = next_ ## container(cag_it)) { \
+                cag_buf[m] = key(cag_it->value); \
+                cag_buf_hashes[m] = hash_func(cag_buf[m], \
+                                              length_func(cag_buf[m])); \
+            } \
+            batch = cag_buf; \
+            batch_hashes = cag_buf_hashes; \
+            code; \
+        } \
+    } \
+} while (0)
+
+/*! \brief Aggregate a batch into a hash table. Rows whose group is already in
+    the table are all reduced before any new group is inserted, because an
+    insert may move the elements of open addressing tables. The rows of any
+    one group are still reduced in the order they came in.
+*/
+
+#define CAG_P_GROUP_BATCH(hash_container, hash, batch, batch_hashes, m, \
+                          reduce, result) \
+do { \
+    it_ ## hash_container cag_found[CAG_P_HASH_BATCH], cag_group; \
+    size_t cag_j; \
+    get_many_hashed_ ## hash_container(hash, batch, batch_hashes, m, \
+                                       cag_found); \
+    for (cag_j = 0; cag_j < (m); ++cag_j) \
+        if (cag_found[cag_j]) \
+            reduce(&cag_found[cag_j]->value, (batch)[cag_j]); \
+    for (cag_j = 0; cag_j < (m) && result; ++cag_j) { \
+        if (cag_found[cag_j]) \
+            continue; \
+        cag_group = get_hashed_ ## hash_container(hash, (batch)[cag_j], \
+                                                  (batch_hashes)[cag_j]); \
+        if (cag_group) \
+            reduce(&cag_group->value, (batch)[cag_j]); \
+        else if (!insert_hashed_ ## hash_container(hash, (batch)[cag_j], \
+                 (batch_hashes)[cag_j])) \
+            result = CAG_FALSE; \
+    } \
+} while (0)
+
+#define CAG_GROUP_BY(container, c, hash_container, hash, type, key, \
+                     hash_func, length_func, reduce, result) \
+do { \
+    type *cag_rows, *cag_batch; \
+    size_t *cag_hashes, *cag_batch_hashes, cag_n, cag_m; \
+    result = CAG_TRUE; \
+    CAG_P_PARTITION_ROWS(container, c, type, key, hash_func, length_func, \
+                         cag_rows, cag_hashes, cag_n); \
+    CAG_P_HASH_BATCHES(container, c, type, key, hash_func, length_func, \
+                       cag_rows, cag_hashes, cag_n, cag_batch, \
+                       cag_batch_hashes, cag_m, result, \
+                       CAG_P_GROUP_BATCH(hash_container, hash, cag_batch, \
+                                         cag_batch_hashes, cag_m, reduce, \
+                                         result)); \
+    CAG_FREE(cag_rows); \
+    CAG_FREE(cag_hashes); \
+} while (0)
+
+/*! \brief Build a hash table from the n projected rows of c. Each row is
+    inserted with insert_or_get_hashed, so it is looked up only once. A row
+    whose key is already in the table is copied, with its hash value, to the
+    arrays dups and dup_hashes instead, which are allocated with n elements
+    when the first such row turns up. d counts those rows.
+*/
+
+#define CAG_P_BUILD_BATCH(hash_container, hash, batch, batch_hashes, m, n, \
+                          dups, dup_hashes, d, result) \
+do { \
+    size_t cag_j; \
+    int cag_inserted; \
+    for (cag_j = 0; cag_j < (m) && result; ++cag_j) { \
+        if (!insert_or_get_hashed_ ## hash_container(hash, (batch)[cag_j], \
+                                                     (batch_hashes)[cag_j], \
+                                                     &cag_inserted)) \
+            result = CAG_FALSE; \
+        else if (!cag_inserted) { \
+            if (!dups) { \
+                dups = CAG_MALLOC((n) * sizeof(*(dups))); \
+                dup_hashes = CAG_MALLOC((n) * sizeof(size_t)); \
+            } \
+            if (!dups || !dup_hashes) { \
+                result = CAG_FALSE; \
+            } else { \
+                (dups)[d] = (batch)[cag_j]; \
+                (dup_hashes)[(d)++] = (batch_hashes)[cag_j]; \
+            } \
+        } \
+    } \
+} while (0)
+
+#define CAG_P_HASH_BUILD(container, c, hash_container, hash, type, key, \
+                         hash_func, length_func, dups, dup_hashes, d, \
+                         result) \
+do { \
+    type *cag_rows, *cag_batch; \
+    size_t *cag_hashes, *cag_batch_hashes, cag_n, cag_m; \
+    CAG_P_PARTITION_ROWS(container, c, type, key, hash_func, length_func, \
+                         cag_rows, cag_hashes, cag_n); \
+    if (!reserve_ ## hash_container(hash, cag_n)) \
+        result = CAG_FALSE; \
+    CAG_P_HASH_BATCHES(container, c, type, key, hash_func, length_func, \
+                       cag_rows, cag_hashes, cag_n, cag_batch, \
+                       cag_batch_hashes, cag_m, result, \
+                       CAG_P_BUILD_BATCH(hash_container, hash, cag_batch, \
+                                         cag_batch_hashes, cag_m, cag_n, \
+                                         dups, dup_hashes, d, result)); \
+    CAG_FREE(cag_rows); \
+    CAG_FREE(cag_hashes); \
+} while (0)
+
+/*! \brief Chain the d rows in dups to the elements of the table with the
+    same key. Once the build is over the elements no longer move, so each row
+    stores the iterator of its element in reps. The rows are chained through
+    next in the order they were built, from heads indexed by the top bits of
+    their hash values.
+*/
+
+#define CAG_P_LINK_DUPS(hash_container, hash, dups, dup_hashes, d, reps, \
+                        next, heads, bits, result) \
+do { \
+    size_t cag_k, cag_b; \
+    while (((size_t) 1 << (bits)) < (d)) \
+        ++(bits); \
+    reps = CAG_MALLOC((d) * sizeof(*(reps))); \
+    next = CAG_MALLOC((d) * sizeof(size_t)); \
+    heads = CAG_MALLOC(((size_t) 1 << (bits)) * sizeof(size_t)); \
+    if (!(reps) || !(next) || !(heads)) { \
+        result = CAG_FALSE; \
+    } else { \
+        for (cag_b = 0; cag_b < (size_t) 1 << (bits); ++cag_b) \
+            (heads)[cag_b] = (size_t) -1; \
+        for (cag_k = (d); cag_k-- > 0; ) { \
+            (reps)[cag_k] = get_hashed_ ## hash_container( \
+                hash, (dups)[cag_k], (dup_hashes)[cag_k]); \
+            cag_b = CAG_P_PARTITION((dup_hashes)[cag_k], bits); \
+            (next)[cag_k] = (heads)[cag_b]; \
+            (heads)[cag_b] = cag_k; \
+        } \
+    } \
+} while (0)
+
+/*! \brief Probe a hash table with the projected rows of c, running code for
+    every pair of a row and a build row with the same key, with v_build
+    pointing to the build row and v_probe to the projected row. The first
+    build row of a key is the element in the table and the others are found
+    through the chains made by CAG_P_LINK_DUPS, if d is not 0.
+*/
+
+#define CAG_P_HASH_PROBE(container, c, hash_container, hash, type, key, \
+                         hash_func, length_func, dups, d, reps, next, heads, \
+                         bits, v_build, v_probe, code) \
+do { \
+    type *cag_batch, *cag_no_rows = NULL; \
+    size_t *cag_batch_hashes, *cag_no_hashes = NULL, cag_m, cag_j, cag_k; \
+    size_t cag_no_n = 0; \
+    it_ ## hash_container cag_found[CAG_P_HASH_BATCH]; \
+    CAG_P_HASH_BATCHES(container, c, type, key, hash_func, length_func, \
+                       cag_no_rows, cag_no_hashes, cag_no_n, cag_batch, \
+                       cag_batch_hashes, cag_m, CAG_TRUE, \
+    { \
+        get_many_hashed_ ## hash_container(hash, cag_batch, \
+                                           cag_batch_hashes, cag_m, \
+                                           cag_found); \
+        for (cag_j = 0; cag_j < cag_m; ++cag_j) { \
+            if (!cag_found[cag_j]) \
+                continue; \
+            v_build = &cag_found[cag_j]->value; \
+            v_probe = &cag_batch[cag_j]; \
+            cag_k = (d) ? (heads)[CAG_P_PARTITION(cag_batch_hashes[cag_j], \
+                                                  bits)] : (size_t) -1; \
+            for (;;) { \
+                code; \
+                while (cag_k != (size_t) -1 && \
+                        (reps)[cag_k] != cag_found[cag_j]) \
+                    cag_k = (next)[cag_k]; \
+                if (cag_k == (size_t) -1) \
+                    break; \
+                v_build = &(dups)[cag_k]; \
+                cag_k = (next)[cag_k]; \
+            } \
+        } \
+    }); \
+} while (0)
+
+#define CAG_HASH_JOIN(container1, c1, container2, c2, hash_container, type, \
+                      key1, key2, hash_func, length_func, v1, v2, code, \
+                      result) \
+do { \
+    hash_container cag_table; \
+    it_ ## container1 cag_it1 = beg_ ## container1(c1); \
+    it_ ## container2 cag_it2 = beg_ ## container2(c2); \
+    it_ ## hash_container *cag_reps = NULL; \
+    type *cag_dups = NULL; \
+    size_t *cag_dup_hashes = NULL, *cag_next = NULL, *cag_heads = NULL; \
+    size_t cag_n1, cag_n2, cag_d = 0, cag_bits = 1; \
+    result = CAG_TRUE; \
+    CAG_DISTANCE(cag_it1, end_ ## container1(c1), next_ ## container1, \
+                 cag_n1); \
+    CAG_DISTANCE(cag_it2, end_ ## container2(c2), next_ ## container2, \
+                 cag_n2); \
+    if (!new_ ## hash_container(&cag_table)) \
+        result = CAG_FALSE; \
+    else { \
+        if (cag_n1 <= cag_n2) \
+            CAG_P_HASH_BUILD(container1, c1, hash_container, &cag_table, \
+                             type, key1, hash_func, length_func, cag_dups, \
+                             cag_dup_hashes, cag_d, result); \
+        else \
+            CAG_P_HASH_BUILD(container2, c2, hash_container, &cag_table, \
+                             type, key2, hash_func, length_func, cag_dups, \
+                             cag_dup_hashes, cag_d, result); \
+        if (result && cag_d) \
+            CAG_P_LINK_DUPS(hash_container, &cag_table, cag_dups, \
+                            cag_dup_hashes, cag_d, cag_reps, cag_next, \
+                            cag_heads, cag_bits, result); \
+        if (result && cag_n1 <= cag_n2) \
+            CAG_P_HASH_PROBE(container2, c2, hash_container, &cag_table, \
+                             type, key2, hash_func, length_func, cag_dups, \
+                             cag_d, cag_reps, cag_next, cag_heads, cag_bits, \
+                             v1, v2, code); \
+        else if (result) \
+            CAG_P_HASH_PROBE(container1, c1, hash_container, &cag_table, \
+                             type, key1, hash_func, length_func, cag_dups, \
+                             cag_d, cag_reps, cag_next, cag_heads, cag_bits, \
+                             v2, v1, code); \
+        free_ ## hash_container(&cag_table); \
+    } \
+    CAG_FREE(cag_dups); \
+    CAG_FREE(cag_dup_hashes); \
+    CAG_FREE(cag_reps); \
+    CAG_FREE(cag_next); \
+    CAG_FREE(cag_heads); \
+} while (0)
+
 /*! \brief Macros to document container declarations.
  */
 
@@ -1622,11 +2819,83 @@ do { \
 #define CAG_P_CMB2(x, y) cag_ ## x ## y
 #define CAG_P_CMB(x, y) CAG_P_CMB2(x, y)
 
+/* Minimal perfect hashing, used by frozen hash tables and mapped snapshots.
+
+   cag_perfect_hash gives each of n hash values its own slot in 0..n-1 using
+   the hash-and-displace method (CHD). The values are split into groups by
+   CAG_P_FROZEN_GROUP, on average CAG_P_FROZEN_LOAD to a group, and each group
+   gets a displacement d so that CAG_P_FROZEN_SLOT puts all its members in
+   free slots. The largest groups are placed first, while most slots are
+   still free. Groups of one are placed last and store their slot directly,
+   marked by CAG_P_FROZEN_DIRECT. Finding a slot then takes one displacement
+   read.
+
+   Equal hash values cannot be told apart by any displacement, so groups
+   that hold them are placed first, each in a block of adjacent slots, and
+   store the start of the block directly, marked by CAG_P_FROZEN_DIRECT and
+   CAG_P_FROZEN_RUN. A lookup in such a group that does not match the element
+   at its slot moves on to the next one while that element belongs to the
+   same group. Other groups have no collisions to resolve. When so many
+   values are equal that the blocks leave some group no free slots, every
+   group is stored as a block. Groups of more than CAG_P_FROZEN_SCAN values
+   are sorted to find equal ones.
+*/
+
+#define CAG_P_SIZE_T_BIT (sizeof(size_t) * CHAR_BIT)
+
+/*! \brief 2^N divided by the golden ratio, for N the width of size_t. */
+
+#define CAG_P_GOLDEN_RATIO \
+    (sizeof(size_t) > 4 \
+     ? ((((size_t) 0x9E3779B9UL << 16) << 16) | (size_t) 0x7F4A7C15UL) \
+     : (size_t) 0x9E3779B9UL)
+
+#define CAG_P_FROZEN_LOAD 4
+
+#define CAG_P_FROZEN_GROUPS(n) ((n) / CAG_P_FROZEN_LOAD + 1)
+
+#define CAG_P_FROZEN_TRIES ((size_t) 1 << 20)
+
+#define CAG_P_FROZEN_SCAN 16
+
+#define CAG_P_FROZEN_DIRECT ((size_t) 1 << (CAG_P_SIZE_T_BIT - 1))
+
+#define CAG_P_FROZEN_RUN ((size_t) 1 << (CAG_P_SIZE_T_BIT - 2))
+
+#define CAG_P_FROZEN_MASK (~(CAG_P_FROZEN_DIRECT | CAG_P_FROZEN_RUN))
+
+#define CAG_P_FROZEN_GROUP(h, groups) (cag_mix_hash(h) % (groups))
+
+#define CAG_P_FROZEN_SLOT(h, d, size) \
+    (cag_mix_hash((h) + ((d) + 1) * CAG_P_GOLDEN_RATIO) % (size))
+
+#define CAG_P_FROZEN_INDEX(i, run, disp, groups, h, size) \
+do { \
+    size_t cag_p_d = (disp)[CAG_P_FROZEN_GROUP(h, groups)]; \
+    run = (cag_p_d & CAG_P_FROZEN_RUN) != 0; \
+    i = cag_p_d & CAG_P_FROZEN_DIRECT ? cag_p_d & CAG_P_FROZEN_MASK : \
+        CAG_P_FROZEN_SLOT(h, cag_p_d & CAG_P_FROZEN_MASK, size); \
+} while (0)
+
+/* Seed used by cag_fast_hash and cag_mix_int_hash. Set it, e.g. from a random
+   source, before any hash tables are populated to make the hash values of a
+   process unpredictable. Changing it while a hash table holds elements makes
+   them unreachable.
+*/
+
+extern size_t cag_hash_seed;
+
 /* Prototypes */
 
 size_t cag_kr_hash(const void *key, const size_t len);
 size_t cag_oat_hash (const void *key, const size_t len );
 size_t cag_int_hash(const int key, const size_t len);
+size_t cag_mix_hash(size_t x);
+size_t cag_mix_int_hash(const int key, const size_t len);
+size_t cag_fast_hash(const void *key, const size_t len);
+size_t cag_seeded_hash(const void *key, const size_t len, const size_t seed);
+int cag_perfect_hash(const size_t *hashes, const size_t n, size_t *disp,
+		     const size_t groups, size_t *slots);
 char *cag_strdup(const char *s);
 int cag_alloc_str_str(void *to, const void *from);
 void cag_free_str_str(void *x);
@@ -102,7 +102,8 @@
     CAG_DEC_APPLY_DATA_CONTAINER(search_all_ ## container, container, \
                                  it_ ## container, type); \
     CAG_DEC_APPLY_DATA_CONTAINER(searchp_all_ ## container, container, \
-                                 it_ ## container, type *) \
+                                 it_ ## container, type *); \
+    CAG_DEC_TOP_K(top_k_ ## container, it_ ## container, type) \
 
 #define CAG_DEF_CMP_FORWARD(container, type, cmp_func, val_adr) \
     CAG_DEF_CMP(cmp_ ## container, it_ ## container, it_ ## container, \
@@ -140,6 +141,8 @@
     CAG_DEF_APPLY_DATA_CONTAINER(searchp_all_ ## container, container, \
                                  it_ ## container, type*, searchp_ ## container, \
                                  begin_ ## container, end_ ## container) \
+    CAG_DEF_TOP_K(top_k_ ## container, it_ ## container, type, \
+                  next_ ## container, CAG_VALUE, cmp_func, val_adr) \
 
 #define CAG_DEC_BIDIRECTIONAL(container, type) \
     CAG_DEC_FORWARD(container, type); \
@@ -282,6 +285,13 @@
                  rat_ ## container, \
                  rlteq_it_ ## container, rlt_it_ ## container, \
                  rswap_ ## container, CAG_VALUE) \
+    CAG_DEF_CMP_REORDERABLE_NO_SORT(container, type, cmp_func, val_adr) \
+
+/*! \brief The functions of CAG_DEF_CMP_REORDERABLE other than sort_C and
+   rsort_C, for containers that define their own sorts.
+*/
+
+#define CAG_DEF_CMP_REORDERABLE_NO_SORT(container, type, cmp_func, val_adr) \
     CAG_DEF_APPLY_CONTAINER(sort_all_ ## container, container, \
                             it_ ## container, sort_ ## container, \
                             begin_ ## container, end_ ## container) \
@@ -334,7 +344,11 @@
     CAG_DEC_APPLY_DATA_CONTAINER(binary_search_all_ ## container, container, \
                                  int, type); \
     CAG_DEC_APPLY_DATA_CONTAINER(binary_searchp_all_ ## container, container, \
-                                 int, type *) \
+                                 int, type *); \
+    CAG_DEC_NTH_ELEMENT(nth_element_ ## container, it_ ## container); \
+    CAG_DEC_PARTIAL_SORT(partial_sort_ ## container, it_ ## container); \
+    CAG_DEC_PARTIAL_SORT_COPY(partial_sort_copy_ ## container, \
+                              it_ ## container) \
 
 #define CAG_DEF_CMP_RANDOMACCESS(container, type, cmp_func, val_adr) \
     CAG_DEF_CMP_BIDIRECTIONAL(container, type, cmp_func, val_adr) \
@@ -377,7 +391,16 @@
     CAG_DEF_APPLY_DATA_CONTAINER(binary_searchp_all_ ## container, container, \
                                  int, type*, \
                                  binary_searchp_ ## container, \
-                                 begin_ ## container, end_ ## container)
+                                 begin_ ## container, end_ ## container) \
+    CAG_DEF_NTH_ELEMENT(nth_element_ ## container, it_ ## container, type, \
+                        cmp_func, val_adr, distance_ ## container, \
+                        prev_ ## container, next_ ## container, \
+                        at_ ## container, swap_ ## container, CAG_VALUE) \
+    CAG_DEF_PARTIAL_SORT(partial_sort_ ## container, it_ ## container, \
+                         nth_element_ ## container, sort_ ## container) \
+    CAG_DEF_PARTIAL_SORT_COPY(partial_sort_copy_ ## container, \
+                              it_ ## container, type, next_ ## container, \
+                              CAG_VALUE, cmp_func, val_adr)
 
 
 #endif /* CAG_CONCEPTS_H */
@@ -0,0 +1,345 @@
+/*! \file CAGL concurrent hash table implementation.
+
+    \copyright Copyright 2014 Nathan Geffen. All rights reserved.
+
+    \license This code is licensed under the GNU LESSER GENERAL PUBLIC LICENSE.
+
+    \sa COPYING for the license text.
+
+    \sa howtodev.rst to learn how this code works and how to modify it.
+*/
+
+
+#ifndef CAG_CONCHASH_H
+#define CAG_CONCHASH_H
+
+#include <pthread.h>
+#include "cagl/hash.h"
+
+/*! \brief Concurrent hash tables.
+
+   A concurrent hash table splits its elements between a number of shards,
+   each of which is an ordinary chained hash table (see hash.h) guarded by its
+   own reader-writer lock. An element's shard is chosen from its mixed hash
+   value, and the hash value is passed on to the shard so that every operation
+   hashes the key once. Lookups take a shard's read lock, so any number of
+   threads can read a shard at the same time, and inserts and removes only
+   block the threads using the same shard. With many more shards than threads
+   contention is rare. Each shard is padded by CAG_P_CONC_PAD bytes so that
+   the locks of neighbouring shards do not share a cache line.
+
+   Iterators would be invalidated as soon as the lock is released, so the
+   functions here return copies of elements, made with the container's
+   alloc_func, instead of iterators, and update_with runs a function on an
+   element while its shard is locked.
+
+   When CAG_STATS is defined, a lookup updates the counters of its shard, so
+   get takes the shard's write lock instead and lookups of one shard no
+   longer run in parallel.
+
+   Programs that use this header must be compiled and linked with POSIX
+   threads, e.g. with the -pthread option of gcc. Reader-writer locks are
+   only declared by pthread.h when _POSIX_C_SOURCE is at least 200112L or
+   _XOPEN_SOURCE is defined, which gcc and clang do by default but not with
+   -std=c89 or -std=c99. Such programs must define one of them before they
+   include any system header, e.g. by compiling with
+   -D_POSIX_C_SOURCE=200112L.
+*/
+
+#define CAG_P_CONC_SHARDS 16
+
+#define CAG_P_CONC_PAD 64
+
+#define CAG_P_CONC_SHARD(hash, h) \
+    (&(hash)->shards[cag_mix_hash(h) % (hash)->count])
+
+#ifdef CAG_STATS
+#define CAG_P_CONC_READ_LOCK(lock) pthread_rwlock_wrlock(lock)
+#else
+#define CAG_P_CONC_READ_LOCK(lock) pthread_rwlock_rdlock(lock)
+#endif
+
+/*! \brief Function declarations and definitions to create a concurrent hash
+   table, with CAG_P_CONC_SHARDS shards or a number chosen by the user.
+*/
+
+#define CAG_DEC_NEW_WITH_SHARDS_CONC_HASH(function, container) \
+    container *function(container *hash, size_t shards)
+
+#define CAG_DEF_NEW_WITH_SHARDS_CONC_HASH(function, container) \
+CAG_DEC_NEW_WITH_SHARDS_CONC_HASH(function, container) \
+{ \
+    size_t i; \
+    if (shards == 0) \
+        shards = 1; \
+    hash->shards = CAG_MALLOC(shards * sizeof(*hash->shards)); \
+    if (!hash->shards) \
+        return NULL; \
+    for (i = 0; i < shards; ++i) { \
+        if (!new_ ## container ## _shard(&hash->shards[i].table)) \
+            break; \
+        if (pthread_rwlock_init(&hash->shards[i].lock, NULL) != 0) { \
+            free_ ## container ## _shard(&hash->shards[i].table); \
+            break; \
+        } \
+    } \
+    if (i < shards) { \
+        while (i-- > 0) { \
+            pthread_rwlock_destroy(&hash->shards[i].lock); \
+            free_ ## container ## _shard(&hash->shards[i].table); \
+        } \
+        CAG_FREE(hash->shards); \
+        return NULL; \
+    } \
+    hash->count = shards; \
+    return hash; \
+}
+
+#define CAG_DEC_NEW_CONC_HASH(function, container) \
+    container *function(container *hash)
+
+#define CAG_DEF_NEW_CONC_HASH(function, container) \
+CAG_DEC_NEW_CONC_HASH(function, container) \
+{ \
+    return new_with_shards_ ## container(hash, CAG_P_CONC_SHARDS); \
+}
+
+/*! \brief Function declaration and definition to look up an element. If the
+   element is found and value is not NULL, a copy of the element is stored in
+   *value. The caller owns the copy. Returns 1 if the element was found and
+   copied and 0 if not.
+*/
+
+#define CAG_DEC_GET_CONC_HASH(function, container, type) \
+    int function(container *hash, type const element, type *value)
+
+#define CAG_DEF_GET_CONC_HASH(function, container, type, hash_func, \
+                              length_func, alloc_style, alloc_func) \
+CAG_DEC_GET_CONC_HASH(function, container, type) \
+{ \
+    size_t h = hash_func(element, length_func(element)); \
+    struct stripe_ ## container *s = CAG_P_CONC_SHARD(hash, h); \
+    it_ ## container ## _shard it; \
+    int found; \
+    CAG_P_CONC_READ_LOCK(&s->lock); \
+    it = get_hashed_ ## container ## _shard(&s->table, element, h); \
+    found = it != NULL; \
+    if (found && value) { \
+        alloc_style(*value, it->value, alloc_func, found = 0); \
+    } \
+    pthread_rwlock_unlock(&s->lock); \
+    return found; \
+}
+
+/*! \brief Function declaration and definition to insert an element, replacing
+   any equal element. Returns 1 on success and 0 if memory runs out.
+*/
+
+#define CAG_DEC_INSERT_CONC_HASH(function, container, type) \
+    int function(container *hash, type const element)
+
+#define CAG_DEF_INSERT_CONC_HASH(function, container, type, hash_func, \
+                                 length_func) \
+CAG_DEC_INSERT_CONC_HASH(function, container, type) \
+{ \
+    size_t h = hash_func(element, length_func(element)); \
+    struct stripe_ ## container *s = CAG_P_CONC_SHARD(hash, h); \
+    it_ ## container ## _shard it; \
+    pthread_rwlock_wrlock(&s->lock); \
+    it = insert_hashed_ ## container ## _shard(&s->table, element, h); \
+    pthread_rwlock_unlock(&s->lock); \
+    return it != NULL; \
+}
+
+/*! \brief Function declaration and definition to remove an element. Returns
+   1 if the element was found and removed and 0 if not.
+*/
+
+#define CAG_DEC_REMOVE_CONC_HASH(function, container, type) \
+    int function(container *hash, type const element)
+
+#define CAG_DEF_REMOVE_CONC_HASH(function, container, type, hash_func, \
+                                 length_func) \
+CAG_DEC_REMOVE_CONC_HASH(function, container, type) \
+{ \
+    size_t h = hash_func(element, length_func(element)); \
+    struct stripe_ ## container *s = CAG_P_CONC_SHARD(hash, h); \
+    int found; \
+    pthread_rwlock_wrlock(&s->lock); \
+    found = get_hashed_ ## container ## _shard(&s->table, element, h) \
+            != NULL; \
+    if (found) \
+        remove_hashed_ ## container ## _shard(&s->table, element, h); \
+    pthread_rwlock_unlock(&s->lock); \
+    return found; \
+}
+
+/*! \brief Function declaration and definition to update an element in place.
+   The element is inserted if the table does not hold it, and then fn is
+   called with its address and data while its shard is locked, so updates of
+   the same element by different threads never interleave. fn must not change
+   the part of the element that is compared or hashed, nor use the hash
+   table. Returns 1 on success and 0 if memory runs out.
+*/
+
+#define CAG_DEC_UPDATE_WITH_CONC_HASH(function, container, type) \
+    int function(container *hash, type const element, \
+                 void (*fn)(type *element, void *data), void *data)
+
+#define CAG_DEF_UPDATE_WITH_CONC_HASH(function, container, type, hash_func, \
+                                      length_func) \
+CAG_DEC_UPDATE_WITH_CONC_HASH(function, container, type) \
+{ \
+    size_t h = hash_func(element, length_func(element)); \
+    struct stripe_ ## container *s = CAG_P_CONC_SHARD(hash, h); \
+    it_ ## container ## _shard it; \
+    pthread_rwlock_wrlock(&s->lock); \
+    it = get_hashed_ ## container ## _shard(&s->table, element, h); \
+    if (it == NULL) \
+        it = insert_hashed_ ## container ## _shard(&s->table, element, h); \
+    if (it) \
+        fn(&it->value, data); \
+    pthread_rwlock_unlock(&s->lock); \
+    return it != NULL; \
+}
+
+/*! \brief Function declaration and definition for the number of elements.
+   Each shard is counted under its read lock, so while other threads insert
+   and remove the result is only a snapshot.
+*/
+
+#define CAG_DEC_SIZE_CONC_HASH(function, container) \
+    size_t function(container *hash)
+
+#define CAG_DEF_SIZE_CONC_HASH(function, container) \
+CAG_DEC_SIZE_CONC_HASH(function, container) \
+{ \
+    size_t i, size = 0; \
+    for (i = 0; i < hash->count; ++i) { \
+        pthread_rwlock_rdlock(&hash->shards[i].lock); \
+        size += hash->shards[i].table.size; \
+        pthread_rwlock_unlock(&hash->shards[i].lock); \
+    } \
+    return size; \
+}
+
+/*! \brief Function declaration and definition for *free*. No other thread may
+   use the table while it is freed.
+*/
+
+#define CAG_DEC_FREE_CONC_HASH(function, container) \
+    void function(container *hash)
+
+#define CAG_DEF_FREE_CONC_HASH(function, container) \
+CAG_DEC_FREE_CONC_HASH(function, container) \
+{ \
+    size_t i; \
+    for (i = 0; i < hash->count; ++i) { \
+        pthread_rwlock_destroy(&hash->shards[i].lock); \
+        free_ ## container ## _shard(&hash->shards[i].table); \
+    } \
+    CAG_FREE(hash->shards); \
+}
+
+/*! \brief Declaration of concurrent hash functions and data structures. */
+
+#define CAG_DEC_CONC_HASH(container, type) \
+    CAG_DEC_CMP_HASH(container ## _shard, type); \
+    struct stripe_ ## container { \
+        pthread_rwlock_t lock; \
+        container ## _shard table; \
+        char pad[CAG_P_CONC_PAD]; \
+    }; \
+    struct container { \
+        struct stripe_ ## container *shards; \
+        size_t count; \
+    }; \
+    typedef struct container container; \
+    CAG_DEC_NEW_WITH_SHARDS_CONC_HASH(new_with_shards_ ## container, \
+                                      container); \
+    CAG_DEC_NEW_CONC_HASH(new_ ## container, container); \
+    CAG_DEC_GET_CONC_HASH(get_ ## container, container, type); \
+    CAG_DEC_INSERT_CONC_HASH(insert_ ## container, container, type); \
+    CAG_DEC_REMOVE_CONC_HASH(remove_ ## container, container, type); \
+    CAG_DEC_UPDATE_WITH_CONC_HASH(update_with_ ## container, container, \
+                                  type); \
+    CAG_DEC_SIZE_CONC_HASH(size_ ## container, container); \
+    CAG_DEC_FREE_CONC_HASH(free_ ## container, container)
+
+/*! \brief Definition of concurrent hash functions. The parameters are those of
+   CAG_DEF_ALL_CMP_HASH.
+*/
+
+#define CAG_DEF_ALL_CONC_HASH(container, type, cmp_func, val_adr, hash_func, \
+                              length_func, alloc_style, alloc_func, \
+                              free_func) \
+CAG_DEF_ALL_CMP_HASH(container ## _shard, type, cmp_func, val_adr, \
+                     hash_func, length_func, alloc_style, alloc_func, \
+                     free_func); \
+CAG_DEF_NEW_WITH_SHARDS_CONC_HASH(new_with_shards_ ## container, container) \
+CAG_DEF_NEW_CONC_HASH(new_ ## container, container) \
+CAG_DEF_GET_CONC_HASH(get_ ## container, container, type, hash_func, \
+                      length_func, alloc_style, alloc_func) \
+CAG_DEF_INSERT_CONC_HASH(insert_ ## container, container, type, hash_func, \
+                         length_func) \
+CAG_DEF_REMOVE_CONC_HASH(remove_ ## container, container, type, hash_func, \
+                         length_func) \
+CAG_DEF_UPDATE_WITH_CONC_HASH(update_with_ ## container, container, type, \
+                              hash_func, length_func) \
+CAG_DEF_SIZE_CONC_HASH(size_ ## container, container) \
+CAG_DEF_FREE_CONC_HASH(free_ ## container, container) \
+typedef container CAG_P_CMB(container,  __LINE__)
+
+#define CAG_DEC_DEF_ALL_CONC_HASH(container, type, cmp_func, val_adr, \
+                                  hash_func, length_func, alloc_style, \
+                                  alloc_func, free_func) \
+    CAG_DEC_CONC_HASH(container, type); \
+    CAG_DEF_ALL_CONC_HASH(container, type, cmp_func, val_adr, hash_func, \
+                          length_func, alloc_style, alloc_func, free_func)
+
+/*! \brief Definition of a concurrent hash table that does not manage the
+   memory of its elements.
+*/
+
+#define CAG_DEF_CONC_HASH(container, type, cmp_func, hash_func, length_func) \
+    CAG_DEF_ALL_CONC_HASH(container, type, cmp_func, CAG_BYVAL, \
+                          hash_func, length_func, \
+                          CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                          CAG_NO_FREE_FUNC)
+
+#define CAG_DEC_DEF_CONC_HASH(container, type, cmp_func, hash_func, \
+                              length_func) \
+    CAG_DEC_CONC_HASH(container, type); \
+    CAG_DEF_CONC_HASH(container, type, cmp_func, hash_func, length_func)
+
+/*! \brief Concurrent hash tables of C strings and of structs of two strings,
+   with memory managed as for CAG_DEF_STR_HASH and CAG_DEF_STR_STR_HASH.
+*/
+
+#define CAG_DEC_STR_CONC_HASH(container) \
+    CAG_DEC_CONC_HASH(container, char *)
+
+#define CAG_DEF_STR_CONC_HASH(container) \
+    CAG_DEF_ALL_CONC_HASH(container, char *, strcmp, CAG_BYVAL, \
+                          cag_fast_hash, strlen, CAG_SIMPLE_ALLOC_STYLE, \
+                          cag_strdup, free)
+
+#define CAG_DEC_DEF_STR_CONC_HASH(container) \
+    CAG_DEC_STR_CONC_HASH(container); \
+    CAG_DEF_STR_CONC_HASH(container)
+
+#define CAG_DEC_STR_STR_CONC_HASH(container, type) \
+    CAG_DEC_CONC_HASH(container, type)
+
+#define CAG_DEF_STR_STR_CONC_HASH(container, type) \
+    CAG_DEF_ALL_CONC_HASH(container, type, CAG_STRCMP_STRUCT_WITH_STR_KEY, \
+                          CAG_BYVAL, CAG_FAST_HASH_STRUCT_WITH_STR_KEY, \
+                          CAG_STRLEN_STRUCT_WITH_STR_KEY, \
+                          CAG_STRUCT_ALLOC_STYLE, cag_alloc_str_str, \
+                          CAG_FREE_STRUCT_STR_STR)
+
+#define CAG_DEC_DEF_STR_STR_CONC_HASH(container, type) \
+    CAG_DEC_STR_STR_CONC_HASH(container, type); \
+    CAG_DEF_STR_STR_CONC_HASH(container, type)
+
+#endif /* CAG_CONCHASH_H */
@@ -489,6 +489,114 @@ CAG_DEC_ERASE_DLIST(function, container, iterator_type) \
         CAG_FREE(list->end_); \
     }
 
+/*! \brief Function declaration and definition of a stable natural merge sort
+   that relinks the nodes of a range instead of copying values. The range is
+   detached as a NULL terminated singly linked list and split into its
+   natural runs. Ascending runs are kept and strictly descending runs are
+   reversed, which keeps the sort stable. The runs are pushed on a stack and
+   merged as in Timsort, so that the stack stays shallow and merged lists
+   have similar lengths. The prev pointers are set in a final pass. Sorted
+   and reverse sorted ranges take O(n) time. Iterators keep pointing at the
+   same elements, so the function returns the new first node of the range.
+   Used for relink_sort_C and rrelink_sort_C. Reverse iterators work because
+   their next and prev members are swapped.
+*/
+
+#define CAG_DEC_SORT_DLIST(function, iterator_type) \
+    iterator_type function(iterator_type from, iterator_type to)
+
+#define CAG_DEF_SORT_DLIST(function, iterator_type, cmp_func, val_adr) \
+static iterator_type CAG_P_CMB(function, _merge)(iterator_type a, \
+                                                 iterator_type b) \
+{ \
+    iterator_type head = NULL; \
+    iterator_type *tail = &head; \
+    while (a && b) { \
+        if (cmp_func(val_adr b->value, val_adr a->value) < 0) { \
+            *tail = b; \
+            b = b->next; \
+        } else { \
+            *tail = a; \
+            a = a->next; \
+        } \
+        tail = &(*tail)->next; \
+    } \
+    *tail = a ? a : b; \
+    return head; \
+} \
+static iterator_type CAG_P_CMB(function, _run)(iterator_type head, \
+                                               iterator_type *rest, \
+                                               size_t *len) \
+{ \
+    iterator_type tail = head; \
+    iterator_type node = head->next; \
+    iterator_type next; \
+    size_t n = 1; \
+    if (node && cmp_func(val_adr node->value, val_adr head->value) < 0) { \
+        do { \
+            next = node->next; \
+            node->next = head; \
+            head = node; \
+            node = next; \
+            ++n; \
+        } while (node && \
+                 cmp_func(val_adr node->value, val_adr head->value) < 0); \
+    } else { \
+        while (node && \
+               cmp_func(val_adr node->value, val_adr tail->value) >= 0) { \
+            tail = node; \
+            node = node->next; \
+            ++n; \
+        } \
+    } \
+    tail->next = NULL; \
+    *rest = node; \
+    *len = n; \
+    return head; \
+} \
+CAG_DEC_SORT_DLIST(function, iterator_type) \
+{ \
+    iterator_type heads[sizeof(size_t) * CHAR_BIT * 2]; \
+    size_t lens[sizeof(size_t) * CHAR_BIT * 2]; \
+    iterator_type before; \
+    iterator_type node; \
+    size_t k, sp = 0; \
+    if (from == to || from->next == to) \
+        return from; \
+    before = from->prev; \
+    to->prev->next = NULL; \
+    for (node = from; node; ) { \
+        heads[sp] = CAG_P_CMB(function, _run)(node, &node, &lens[sp]); \
+        ++sp; \
+        while (sp > 1) { \
+            k = sp - 2; \
+            if ((k > 0 && lens[k - 1] <= lens[k] + lens[k + 1]) || \
+                (k > 1 && lens[k - 2] <= lens[k - 1] + lens[k])) { \
+                if (lens[k - 1] < lens[k + 1]) \
+                    --k; \
+            } else if (lens[k] > lens[k + 1]) { \
+                break; \
+            } \
+            heads[k] = CAG_P_CMB(function, _merge)(heads[k], heads[k + 1]); \
+            lens[k] += lens[k + 1]; \
+            for (++k; k + 1 < sp; ++k) { \
+                heads[k] = heads[k + 1]; \
+                lens[k] = lens[k + 1]; \
+            } \
+            --sp; \
+        } \
+    } \
+    for (; sp > 1; --sp) \
+        heads[sp - 2] = CAG_P_CMB(function, _merge)(heads[sp - 2], \
+                                                    heads[sp - 1]); \
+    before->next = heads[0]; \
+    for (node = before; node->next; node = node->next) \
+        node->next->prev = node; \
+    node->next = to; \
+    to->prev = node; \
+    return before->next; \
+}
+
 /*! \brief Declarations of list iterator and functions. */
 
 #define CAG_DEC_DLIST(container, type) \
@@ -670,6 +778,10 @@ CAG_DEF_ALL_CMP_DLIST(container, type, cmp_func, val_adr, \
                         it_ ## container); \
     CAG_DEC_STABLE_SORT(rstable_sort_ ## container, \
                         rit_ ## container); \
+    CAG_DEC_SORT_DLIST(relink_sort_ ## container, it_ ## container); \
+    CAG_DEC_SORT_DLIST(rrelink_sort_ ## container, rit_ ## container); \
+    CAG_DEC_APPLY_CONTAINER(relink_sort_all_ ## container, container, \
+                            it_ ## container); \
     CAG_DEC_CMP_REORDERABLE(container, type); \
     CAG_DEC_CMP_BIDIRECTIONAL(container, type)
 
@@ -688,18 +800,19 @@ CAG_DEF_ALL_CMP_DLIST(container, type, cmp_func, val_adr, \
                               alloc_style, alloc_func, free_func) \
 CAG_DEF_ALL_DLIST(container, type, \
                   alloc_style, alloc_func, free_func, val_adr); \
-CAG_DEF_STABLE_SORT(stable_sort_ ## container, \
-                    container, it_ ## container, \
-                    new_ ## container, free_ ## container, \
-                    begin_ ## container, end_ ## container, \
-                    next_ ## container, distance_ ## container, \
-                    appendp_ ## container, cmp_func, val_adr) \
-CAG_DEF_STABLE_SORT(rstable_sort_ ## container, \
-                    container, rit_ ## container, \
-                    new_ ## container, free_ ## container, \
-                    rbegin_ ## container, rend_ ## container, \
-                    rnext_ ## container, rdistance_ ## container, \
-                    prependp_ ## container, cmp_func, val_adr) \
+CAG_DEF_STABLE_SORT(stable_sort_ ## container, it_ ## container, \
+                    type, prev_ ## container, next_ ## container, \
+                    distance_ ## container, cmp_func, val_adr) \
+CAG_DEF_STABLE_SORT(rstable_sort_ ## container, rit_ ## container, \
+                    type, rprev_ ## container, rnext_ ## container, \
+                    rdistance_ ## container, cmp_func, val_adr) \
+CAG_DEF_SORT_DLIST(relink_sort_ ## container, it_ ## container, cmp_func, \
+                   val_adr) \
+CAG_DEF_SORT_DLIST(rrelink_sort_ ## container, rit_ ## container, cmp_func, \
+                   val_adr) \
+CAG_DEF_APPLY_CONTAINER(relink_sort_all_ ## container, container, \
+                        it_ ## container, relink_sort_ ## container, \
+                        begin_ ## container, end_ ## container) \
 CAG_DEF_CMP_REORDERABLE(container, type, cmp_func, val_adr) \
 CAG_DEF_CMP_BIDIRECTIONAL(container, type, cmp_func, val_adr) \
 typedef container CAG_P_CMB(container ## _cmp,  __LINE__)
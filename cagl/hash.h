@@ -15,33 +15,183 @@
 
 #include <stdlib.h>
 #include "cagl/concepts.h"
+#include "cagl/mapped.h"
+
+/*! \brief Sizing of chained hash tables.
+
+    Tables start with CAG_P_HASH_BUCKETS buckets and double in size whenever
+    the number of elements exceeds max_load times the number of buckets. When
+    remove takes the number of elements below min_load times the number of
+    buckets, the table shrinks so that it is half of max_load full. The gap
+    between the two limits stops a table near either of them from resizing
+    back and forth. A table never shrinks below the number of buckets it was
+    created with, or below the size reserve made room for. When the number of
+    buckets is a power of two, an element's bucket is found with Fibonacci
+    (multiply-shift) hashing, which costs a multiplication instead of a
+    division and takes the high bits of the product, so weak hash functions
+    still spread well. Any other number of
+    buckets, e.g. one passed to new_with_buckets or rehash by the user, falls
+    back to the remainder of division.
+*/
+
+#define CAG_P_HASH_BUCKETS 32
+
+#define CAG_P_HASH_MAX_LOAD 0.75
+
+#define CAG_P_HASH_MIN_LOAD 0.1
+
+/*! \brief Reduce hash value h to a bucket index. A shift of zero means the
+    number of buckets is not a power of two.
+*/
+
+#define CAG_P_REDUCE_HASH(h, buckets, shift) \
+    ((shift) ? ((h) * CAG_P_GOLDEN_RATIO) >> (shift) : (h) % (buckets))
+
+/*! \brief Set shift to the right shift for multiply-shift hashing into buckets
+    buckets, or zero if buckets is not a power of two greater than one.
+*/
+
+#define CAG_P_SHIFT_HASH(buckets, shift) \
+do { \
+    size_t cag_p_b = (buckets); \
+    shift = 0; \
+    if (cag_p_b > 1 && (cag_p_b & (cag_p_b - 1)) == 0) \
+        for (shift = CAG_P_SIZE_T_BIT; cag_p_b > 1; cag_p_b >>= 1) \
+            --shift; \
+} while (0)
 
-/*! \brief A table of the sizes the hash table is resized to. Used in the rehash
-    code.
+/*! \brief Statistics of chained hash tables.
 
-    This could do with optimising. Also, rehashing has not been tested with the
-    very large entries in this table.
+   stats fills a struct cag_hash_stats with the load factor, a histogram of
+   chain lengths, the average number of nodes a lookup would examine, worked
+   out from the chain lengths, and the memory used by the table.
 
-    The last entry in the table should be set to zero because the current
-    implementation will not rehash once it gets to the last entry. So setting it
-    to anything other than zero would be deceptive.
- */
+   When CAG_STATS is defined before hash.h is included, each table also keeps
+   counters of its lookups and rehashes, which stats copies into the fields
+   after the histogram. Lookups are the calls of get, getp and get_hashed, and
+   their probes are the nodes they compare with the key. The counters live in
+   a separately allocated struct so that the const lookup functions can update
+   them. Without CAG_STATS these fields are zero and tables carry no counters.
+*/
 
-#define CAG_P_HTABLE_SIZES 16
+#define CAG_HASH_STATS_CHAINS 8
+
+struct cag_hash_stats {
+    size_t size;            /* Number of elements */
+    size_t buckets;         /* Number of buckets */
+    double load_factor;     /* Elements per bucket */
+    size_t chains[CAG_HASH_STATS_CHAINS]; /* chains[i] is the number of
+                               buckets holding i nodes, except the last, which
+                               counts the buckets holding at least that many */
+    size_t max_chain;       /* Longest chain */
+    double hit_probes;      /* Average nodes examined to find an element */
+    double miss_probes;     /* Average nodes examined for an absent key */
+    size_t bucket_bytes;    /* Memory used by bucket arrays */
+    size_t node_bytes;      /* Memory used by nodes, including free ones */
+    size_t value_bytes;     /* Part of node_bytes taken up by the elements */
+    size_t hits;            /* The remaining fields need CAG_STATS. */
+    size_t misses;          /* Lookups that did or did not find the key */
+    double average_hit_probes;
+    double average_miss_probes;
+    size_t max_hit_probes;
+    size_t max_miss_probes;
+    size_t rehashes;        /* Rehashes, including automatic ones */
+    double rehash_seconds;  /* Processor time spent rehashing */
+};
 
-static const size_t cag_p_htable_sizes[] = {
-    23, 47, 101,
-    509, 1009, 10993,
-    109987, 412849, 970704,
-    1299989, 3562115, 5999993,
-    12999997, 99999989, 3999999979,
-    0
+struct cag_hash_counters {
+    size_t hits;
+    size_t misses;
+    size_t hit_probes;
+    size_t miss_probes;
+    size_t max_hit_probes;
+    size_t max_miss_probes;
+    size_t rehashes;
+    double rehash_seconds;
 };
 
-/*! \brief Two string hash algorithms are currently provided: Kernighan &
-   Ritchie and Oat. See cag_common.c for implementations and references.
+#ifdef CAG_STATS
+
+#include <time.h>
+
+#define CAG_P_STATS_FIELD struct cag_hash_counters *counters;
+
+#define CAG_P_STATS_NEW(hash) \
+    (hash)->counters = calloc(1, sizeof(*(hash)->counters))
+
+#define CAG_P_STATS_FREE(hash) CAG_FREE((hash)->counters)
+
+#define CAG_P_STATS_DECL size_t cag_p_probes = 0; clock_t cag_p_clock = 0;
+
+#define CAG_P_STATS_PROBE ++cag_p_probes,
+
+#define CAG_P_STATS_LOOKUP(hash, found) \
+do { \
+    struct cag_hash_counters *cag_p_c = (hash)->counters; \
+    if (cag_p_c && (found)) { \
+        ++cag_p_c->hits; \
+        cag_p_c->hit_probes += cag_p_probes; \
+        if (cag_p_probes > cag_p_c->max_hit_probes) \
+            cag_p_c->max_hit_probes = cag_p_probes; \
+    } else if (cag_p_c) { \
+        ++cag_p_c->misses; \
+        cag_p_c->miss_probes += cag_p_probes; \
+        if (cag_p_probes > cag_p_c->max_miss_probes) \
+            cag_p_c->max_miss_probes = cag_p_probes; \
+    } \
+    (void) cag_p_clock; \
+} while (0)
+
+#define CAG_P_STATS_START cag_p_clock = clock()
+
+#define CAG_P_STATS_STOP(hash, n) \
+do { \
+    if ((hash)->counters) { \
+        (hash)->counters->rehashes += (n); \
+        (hash)->counters->rehash_seconds += \
+            (double) (clock() - cag_p_clock) / CLOCKS_PER_SEC; \
+    } \
+    (void) cag_p_probes; \
+} while (0)
+
+#define CAG_P_STATS_COPY(hash, stats) \
+do { \
+    struct cag_hash_counters *cag_p_c = (hash)->counters; \
+    if (cag_p_c) { \
+        (stats)->hits = cag_p_c->hits; \
+        (stats)->misses = cag_p_c->misses; \
+        (stats)->average_hit_probes = cag_p_c->hits ? \
+            (double) cag_p_c->hit_probes / (double) cag_p_c->hits : 0; \
+        (stats)->average_miss_probes = cag_p_c->misses ? \
+            (double) cag_p_c->miss_probes / (double) cag_p_c->misses : 0; \
+        (stats)->max_hit_probes = cag_p_c->max_hit_probes; \
+        (stats)->max_miss_probes = cag_p_c->max_miss_probes; \
+        (stats)->rehashes = cag_p_c->rehashes; \
+        (stats)->rehash_seconds = cag_p_c->rehash_seconds; \
+    } \
+} while (0)
+
+#else
+
+#define CAG_P_STATS_FIELD
+#define CAG_P_STATS_NEW(hash)
+#define CAG_P_STATS_FREE(hash)
+#define CAG_P_STATS_DECL
+#define CAG_P_STATS_PROBE
+#define CAG_P_STATS_LOOKUP(hash, found)
+#define CAG_P_STATS_START
+#define CAG_P_STATS_STOP(hash, n)
+#define CAG_P_STATS_COPY(hash, stats)
+
+#endif
 
-   The two macros below can be used with structs that are passed by value and
+/*! \brief Three string hash algorithms are currently provided: Kernighan &
+   Ritchie, Oat and a seeded word-at-a-time hash, cag_fast_hash. See
+   cag_common.c for implementations and references. cag_fast_hash is the
+   default. It reads a machine word per step instead of a byte and produces a
+   full size_t value, which matters once tables have millions of buckets.
+
+   The macros below can be used with structs that are passed by value and
    whose first element is a string (char *) used as the key into the hash table.
 */
 
@@ -51,7 +201,10 @@ static const size_t cag_p_htable_sizes[] = {
 #define CAG_OAT_HASH_STRUCT_WITH_STR_KEY(x, y) \
     cag_oat_hash( CAG_STR_KEY_FROM_STRUCT(x), y)
 
-#define CAG_STRING_HASH(x, y) CAG_OAT_HASH_STRUCT_WITH_STR_KEY(x, y)
+#define CAG_FAST_HASH_STRUCT_WITH_STR_KEY(x, y) \
+    cag_fast_hash( CAG_STR_KEY_FROM_STRUCT(x), y)
+
+#define CAG_STRING_HASH(x, y) CAG_FAST_HASH_STRUCT_WITH_STR_KEY(x, y)
 
 
 /*! \brief Macro for hash table of integers.  See cag_common.c for
@@ -60,6 +213,14 @@ static const size_t cag_p_htable_sizes[] = {
 
 #define CAG_INT_HASH(i, len) i
 
+/*! \brief Hash for integer keys that mixes all the bits of the key into all
+   the bits of the result. Use it instead of CAG_INT_HASH when keys share low
+   bits, e.g. multiples of a power of two. cag_mix_int_hash is a seeded function
+   version for int keys.
+*/
+
+#define CAG_MIX_HASH(i, len) cag_mix_hash((size_t) (i))
+
 /*! \brief New hash table function declaration and definitions.
 
    The with_buckets version allows the user to specify the number of buckets
@@ -72,17 +233,32 @@ static const size_t cag_p_htable_sizes[] = {
 #define CAG_DEF_NEW_HASH_WITH_BUCKETS(function, container) \
     CAG_DEC_NEW_HASH_WITH_BUCKETS(function, container) \
     { \
-        hash->buckets = buckets; \
+        hash->buckets = hash->min_buckets = buckets; \
+        CAG_P_SHIFT_HASH(buckets, hash->shift); \
         hash->size = 0; \
         hash->rehash = 1; \
+        hash->max_load = CAG_P_HASH_MAX_LOAD; \
+        hash->min_load = CAG_P_HASH_MIN_LOAD; \
+        hash->old = NULL; \
+        hash->old_buckets = hash->old_shift = 0; \
+        hash->migrated = hash->incremental = 0; \
+        hash->slabs = hash->spare = hash->fresh = NULL; \
+        hash->fresh_left = 0; \
+        CAG_P_STATS_NEW(hash); \
         hash->objects = calloc(hash->buckets + 1, sizeof(hash->objects)); \
-        if (!hash->objects) \
+        if (!hash->objects) { \
+            CAG_P_STATS_FREE(hash); \
             return NULL; \
-        else { \
-            hash->objects[hash->buckets] = \
-                    calloc(1, sizeof(*hash->objects[hash->buckets])); \
-            return hash; \
         } \
+        hash->objects[hash->buckets] = \
+                calloc(1, sizeof(*hash->objects[hash->buckets])); \
+        if (!hash->objects[hash->buckets]) { \
+            CAG_FREE(hash->objects); \
+            CAG_P_STATS_FREE(hash); \
+            return NULL; \
+        } \
+        hash->objects[hash->buckets]->bucket = &hash->objects[hash->buckets]; \
+        return hash; \
     }
 
 #define CAG_DEC_NEW_HASH(function, container) \
@@ -91,22 +267,46 @@ static const size_t cag_p_htable_sizes[] = {
 #define CAG_DEF_NEW_HASH(function, container) \
     CAG_DEC_NEW_HASH(function, container) \
     { \
-        return new_with_buckets_ ## container(hash, cag_p_htable_sizes[0]); \
+        return new_with_buckets_ ## container(hash, CAG_P_HASH_BUCKETS); \
     }
 
+/*! \brief The bucket an element with hash value h belongs in.
+
+   While an incremental rehash is in progress, elements whose bucket in the old
+   array has not been migrated yet stay in the old array, and all others are in
+   the new one. So every key has exactly one home bucket and lookups never have
+   to search both arrays.
+*/
+
+#define CAG_P_OLD_INDEX_HASH(hash, h) \
+    CAG_P_REDUCE_HASH(h, (hash)->old_buckets, (hash)->old_shift)
+
+#define CAG_P_BUCKET_HASH(hash, h) \
+    ((hash)->old && CAG_P_OLD_INDEX_HASH(hash, h) >= (hash)->migrated \
+     ? &(hash)->old[CAG_P_OLD_INDEX_HASH(hash, h)] \
+     : &(hash)->objects[CAG_P_REDUCE_HASH(h, (hash)->buckets, \
+                                          (hash)->shift)])
+
 /*! \brief Algorithm and function declaration and definition to get (lookup) a
    hash entry based on the key. Pass by value and address versions implemented.
 */
 
-#define CAG_P_GET_HASH(iterator_type, hash, key, cmp_func, val_adr, \
-                       hash_func, length_func) \
+#define CAG_P_FIND_HASH(hash, h, key, cmp_func, val_adr, it) \
+    for (it = *CAG_P_BUCKET_HASH(hash, h); \
+            it != NULL && (it->hash != (h) || \
+                           cmp_func(val_adr (key), val_adr it->value) != 0); \
+            it = it->next)
+
+#define CAG_P_GET_HASH(iterator_type, hash, key, cmp_func, val_adr, h) \
 do { \
     iterator_type it; \
-    size_t i = hash_func(key,  length_func(key)) % hash->buckets; \
-    for (it = hash->objects[i]; it != NULL; it = it->next) \
-        if (cmp_func(val_adr (key), val_adr it->value) == 0) \
-            return it; \
-    return NULL; \
+    CAG_P_STATS_DECL \
+    for (it = *CAG_P_BUCKET_HASH(hash, h); \
+            it != NULL && (CAG_P_STATS_PROBE (it->hash != (h) || \
+                           cmp_func(val_adr (key), val_adr it->value) != 0)); \
+            it = it->next); \
+    CAG_P_STATS_LOOKUP(hash, it != NULL); \
+    return it; \
 } while(0)
 
 #define CAG_DEC_GET_HASH(function, container, iterator_type, type) \
@@ -116,8 +316,8 @@ do { \
                          type, cmp_func, val_adr, hash_func, length_func) \
 CAG_DEC_GET_HASH(function, container, iterator_type, type) \
 { \
-    CAG_P_GET_HASH(iterator_type, hash, element, cmp_func, val_adr, \
-                   hash_func, length_func); \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_GET_HASH(iterator_type, hash, element, cmp_func, val_adr, h); \
 }
 
 #define CAG_DEC_GETP_HASH(function, container, iterator_type, type) \
@@ -127,42 +327,234 @@ CAG_DEC_GET_HASH(function, container, iterator_type, type) \
                           type, cmp_func, val_adr, hash_func, length_func) \
 CAG_DEC_GETP_HASH(function, container, iterator_type, type) \
 { \
-    CAG_P_GET_HASH(iterator_type, hash, *element, cmp_func, val_adr, \
-                   hash_func, length_func); \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_GET_HASH(iterator_type, hash, *element, cmp_func, val_adr, h); \
+}
+
+/*! \brief Function declaration and definition of *get_hashed*, a version of
+   *get* for callers that already hold the hash value of the element. The value
+   must be the one the container's hash function returns for the element.
+*/
+
+#define CAG_DEC_GET_HASHED(function, container, iterator_type, type) \
+    iterator_type function(const container *hash, const type element, \
+                           const size_t h)
+
+#define CAG_DEF_GET_HASHED(function, container, iterator_type, \
+                           type, cmp_func, val_adr) \
+CAG_DEC_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_HASH(iterator_type, hash, element, cmp_func, val_adr, h); \
+}
+
+/*! \brief Function declarations and definitions of *get_many* and
+   *getp_many*, which look up n keys and store an iterator, or NULL, for each
+   in results. The keys are handled in batches of CAG_P_GET_MANY_BATCH. All the
+   keys of a batch are hashed and their buckets prefetched before any bucket is
+   read, and then the first node of every bucket is prefetched before any
+   chain is walked, so the cache misses of different keys overlap instead of
+   following one another. getp_many takes an array of pointers to keys.
+   get_many_hashed also takes the hash value of every key, as returned by the
+   container's hash function, and does not hash the keys again.
+*/
+
+#define CAG_P_GET_MANY_BATCH 16
+
+#define CAG_P_DEREF *
+
+#define CAG_P_NO_HASHES ((const size_t *) NULL)
+
+#define CAG_DEC_GET_MANY_HASH(function, container, iterator_type, type) \
+    size_t function(const container *hash, const type *keys, size_t n, \
+                    iterator_type *results)
+
+#define CAG_DEC_GETP_MANY_HASH(function, container, iterator_type, type) \
+    size_t function(const container *hash, const type *const *keys, \
+                    size_t n, iterator_type *results)
+
+#define CAG_DEC_GET_MANY_HASHED(function, container, iterator_type, type) \
+    size_t function(const container *hash, const type *keys, \
+                    const size_t *hashes, size_t n, iterator_type *results)
+
+#define CAG_P_GET_MANY_HASH(iterator_type, hash, keys, key_adr, hashes, n, \
+                            results, cmp_func, val_adr, hash_func, \
+                            length_func) \
+do { \
+    size_t h[CAG_P_GET_MANY_BATCH], i, j, m, found = 0; \
+    iterator_type *bucket[CAG_P_GET_MANY_BATCH], it; \
+    for (i = 0; i < n; i += m) { \
+        m = n - i < CAG_P_GET_MANY_BATCH ? n - i : CAG_P_GET_MANY_BATCH; \
+        for (j = 0; j < m; ++j) { \
+            h[j] = hashes ? hashes[i + j] \
+                   : (size_t) hash_func(key_adr keys[i + j], \
+                                        length_func(key_adr keys[i + j])); \
+            bucket[j] = CAG_P_BUCKET_HASH(hash, h[j]); \
+            CAG_PREFETCH(bucket[j]); \
+        } \
+        for (j = 0; j < m; ++j) \
+            if (*bucket[j]) \
+                CAG_PREFETCH(*bucket[j]); \
+        for (j = 0; j < m; ++j) { \
+            for (it = *bucket[j]; it != NULL && (it->hash != h[j] || \
+                    cmp_func(val_adr (key_adr keys[i + j]), \
+                             val_adr it->value) != 0); it = it->next); \
+            results[i + j] = it; \
+            found += it != NULL; \
+        } \
+    } \
+    return found; \
+} while (0)
+
+#define CAG_DEF_GET_MANY_HASH(function, container, iterator_type, type, \
+                              cmp_func, val_adr, hash_func, length_func) \
+CAG_DEC_GET_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                        CAG_P_NO_HASHES, n, results, cmp_func, val_adr, \
+                        hash_func, length_func); \
+}
+
+#define CAG_DEF_GETP_MANY_HASH(function, container, iterator_type, type, \
+                               cmp_func, val_adr, hash_func, length_func) \
+CAG_DEC_GETP_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_HASH(iterator_type, hash, keys, CAG_P_DEREF, \
+                        CAG_P_NO_HASHES, n, results, cmp_func, val_adr, \
+                        hash_func, length_func); \
+}
+
+#define CAG_DEF_GET_MANY_HASHED(function, container, iterator_type, type, \
+                                cmp_func, val_adr, hash_func, length_func) \
+CAG_DEC_GET_MANY_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_HASH(iterator_type, hash, keys, CAG_BYVAL, hashes, n, \
+                        results, cmp_func, val_adr, hash_func, length_func); \
 }
 
 
+/*! \brief Migrate the number of buckets set in the incremental field, or
+   finish the migration if incremental rehashing has since been switched off.
+*/
+
+#define CAG_P_REHASH_STEP(container, hash) \
+    rehash_step_ ## container(hash, (hash)->incremental ? \
+                              (hash)->incremental : (hash)->old_buckets)
+
+/*! \brief Node pool of chained hash tables.
+
+   Nodes are carved out of slabs, blocks of nodes allocated together, instead
+   of being allocated one by one. Each slab holds twice as many nodes as the
+   one before it, from CAG_P_HASH_SLAB_MIN up to CAG_P_HASH_SLAB_MAX. The first
+   node of a slab is its header: its next field links the slabs of the table
+   and its hash field holds the number of nodes in the slab. Removed nodes go
+   onto a free list threaded through their next fields and are reused by later
+   inserts. Their bucket field is set to NULL, which lets free walk the slabs
+   instead of the chains and skip the nodes that are not in use. The memory of
+   the pool is only returned to the heap by free.
+
+   Tables that store their elements inline (see CAG_DEC_INLINE_STR_HASH) have
+   nodes of different sizes, so they allocate and free each node on its own
+   and never have slabs.
+*/
+
+#define CAG_P_HASH_SLAB_MIN 16
+
+#define CAG_P_HASH_SLAB_MAX 4096
+
+#define CAG_P_ALLOC_NODE_HASH(hash, it) \
+do { \
+    size_t cag_p_n; \
+    if ((hash)->spare) { \
+        it = (hash)->spare; \
+        (hash)->spare = it->next; \
+    } else { \
+        if ((hash)->fresh_left == 0) { \
+            cag_p_n = (hash)->slabs ? (hash)->slabs->hash * 2 : \
+                      CAG_P_HASH_SLAB_MIN; \
+            if (cag_p_n > CAG_P_HASH_SLAB_MAX) \
+                cag_p_n = CAG_P_HASH_SLAB_MAX; \
+            it = CAG_MALLOC((cag_p_n + 1) * sizeof(*it)); \
+            if (it) { \
+                it->next = (hash)->slabs; \
+                it->hash = cag_p_n; \
+                (hash)->slabs = it; \
+                (hash)->fresh = it + 1; \
+                (hash)->fresh_left = cag_p_n; \
+            } \
+        } \
+        if ((hash)->fresh_left) { \
+            it = (hash)->fresh++; \
+            --(hash)->fresh_left; \
+        } else { \
+            it = NULL; \
+        } \
+    } \
+} while (0)
+
+#define CAG_P_FREE_NODE_HASH(hash, it) \
+do { \
+    if (!(hash)->slabs) { \
+        CAG_FREE(it); \
+    } else { \
+        it->bucket = NULL; \
+        it->next = (hash)->spare; \
+        (hash)->spare = it; \
+    } \
+} while (0)
+
 /*! \brief Algorithm and function declaration and definition to insert into a
    hash table. Pass by value and address versions implemented.
+
+   The key is hashed once and its bucket searched once. If the key is found
+   and replace is non-zero the element is replaced, else the existing element
+   is left alone. *inserted is set to 1 if a new node was added and to 0 if
+   not.
+
+   node_extra gives the number of bytes to allocate after a new node for an
+   element stored inline. Such nodes come from the heap instead of the pool.
+   An inline element equal to the one in the table is the same string, so it
+   is never replaced.
 */
 
 
-#define CAG_P_INSERT_HASH(container, iterator_type, \
-                          type, cmp_func, hash_func, \
-                          length_func, get, \
-                          alloc_style, alloc_func, free_func, val_adr, val) \
+#define CAG_P_INSERT_HASH(container, iterator_type, type, cmp_func, \
+                          alloc_style, alloc_func, free_func, val_adr, \
+                          node_extra, val, h, inserted, replace) \
 do { \
-    iterator_type it; \
+    iterator_type it, *bucket; \
     type replace_val; \
-    size_t hashval; \
-    if ((it = get(hash, val)) == NULL) { \
-        if ( (float) hash->size / (float) hash->buckets > 0.75) { \
+    size_t extra; \
+    char *cag_node_end; \
+    CAG_P_FIND_HASH(hash, h, val, cmp_func, val_adr, it); \
+    *(inserted) = (it == NULL); \
+    if (it == NULL) { \
+        if (hash->old) \
+            CAG_P_REHASH_STEP(container, hash); \
+        else if ((double) hash->size > \
+                 hash->max_load * (double) hash->buckets) { \
             rehash_ ## container(hash, 0); \
         } \
-        it = CAG_MALLOC(sizeof(*it)); \
+        extra = node_extra(val); \
+        if (extra) \
+            it = CAG_MALLOC(sizeof(*it) + extra); \
+        else \
+            CAG_P_ALLOC_NODE_HASH(hash, it); \
         if (it == NULL) \
             return NULL; \
-        hashval = hash_func(val, length_func(val)) % hash->buckets; \
-        it->next = hash->objects[hashval]; \
-        it->bucket = &hash->objects[hashval]; \
+        cag_node_end = (char *) it + sizeof(*it); \
+        (void) cag_node_end; \
+        it->hash = h; \
+        bucket = CAG_P_BUCKET_HASH(hash, it->hash); \
+        it->next = *bucket; \
+        it->bucket = bucket; \
         alloc_style(it->value, val, alloc_func, \
                     { \
-                            CAG_FREE(it); \
+                            CAG_P_FREE_NODE_HASH(hash, it); \
                             return NULL; \
                     }); \
-        hash->objects[hashval] = it; \
+        *bucket = it; \
         ++hash->size; \
-    } else { \
+    } else if (replace && !node_extra(val)) { \
         alloc_style(replace_val, val, alloc_func, \
                     {return NULL;}); \
         free_func(val_adr it->value); \
@@ -179,13 +571,15 @@ iterator_type function(container *hash, type const element)
 #define CAG_DEF_INSERT_HASH(function, container, iterator_type, \
                             type, cmp_func, hash_func, \
                             length_func, get, \
-                            alloc_style, alloc_func, free_func, val_adr) \
+                            alloc_style, alloc_func, free_func, val_adr, \
+                            node_extra) \
 CAG_DEC_INSERT_HASH(function, container, iterator_type, type) \
 { \
-    CAG_P_INSERT_HASH(container, iterator_type, \
-                      type, cmp_func, hash_func, \
-                      length_func, get, \
-                      alloc_style, alloc_func, free_func, val_adr, element); \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int inserted; \
+    CAG_P_INSERT_HASH(container, iterator_type, type, cmp_func, \
+                      alloc_style, alloc_func, free_func, val_adr, \
+                      node_extra, element, h, &inserted, 1); \
 }
 
 #define CAG_DEC_INSERTP_HASH(function, container, iterator_type, \
@@ -195,13 +589,83 @@ iterator_type function(container *hash, type const *element)
 #define CAG_DEF_INSERTP_HASH(function, container, iterator_type, \
                              type, cmp_func, hash_func, \
                              length_func, get, \
-                             alloc_style, alloc_func, free_func, val_adr) \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             node_extra) \
 CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
 { \
-    CAG_P_INSERT_HASH(container, iterator_type, \
-                      type, cmp_func, hash_func, \
-                      length_func, get, \
-                      alloc_style, alloc_func, free_func, val_adr, *element); \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    int inserted; \
+    CAG_P_INSERT_HASH(container, iterator_type, type, cmp_func, \
+                      alloc_style, alloc_func, free_func, val_adr, \
+                      node_extra, *element, h, &inserted, 1); \
+}
+
+/*! \brief Function declaration and definition of *insert_hashed*, a version of
+   *insert* for callers that already hold the hash value of the element.
+*/
+
+#define CAG_DEC_INSERT_HASHED(function, container, iterator_type, type) \
+    iterator_type function(container *hash, type const element, \
+                           const size_t h)
+
+#define CAG_DEF_INSERT_HASHED(function, container, iterator_type, \
+                              type, cmp_func, alloc_style, alloc_func, \
+                              free_func, val_adr, node_extra) \
+CAG_DEC_INSERT_HASHED(function, container, iterator_type, type) \
+{ \
+    int inserted; \
+    CAG_P_INSERT_HASH(container, iterator_type, type, cmp_func, \
+                      alloc_style, alloc_func, free_func, val_adr, \
+                      node_extra, element, h, &inserted, 1); \
+}
+
+/*! \brief Function declaration and definition of *insert_or_get*. If the key
+   of element is already in the table its iterator is returned and the element
+   in the table is left unchanged. Otherwise element is inserted. In either
+   case the key is only hashed once. If inserted is not NULL, *inserted is set
+   to 1 if the element was inserted and 0 if it was already there.
+*/
+
+#define CAG_DEC_INSERT_OR_GET_HASH(function, container, iterator_type, type) \
+    iterator_type function(container *hash, type const element, int *inserted)
+
+#define CAG_DEF_INSERT_OR_GET_HASH(function, container, iterator_type, \
+                                   type, cmp_func, hash_func, length_func, \
+                                   alloc_style, alloc_func, free_func, \
+                                   val_adr, node_extra) \
+CAG_DEC_INSERT_OR_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_HASH(container, iterator_type, type, cmp_func, \
+                      alloc_style, alloc_func, free_func, val_adr, \
+                      node_extra, element, h, inserted, 0); \
+}
+
+/*! \brief Function declaration and definition of *insert_or_get_hashed*, a
+   version of *insert_or_get* for callers that already hold the hash value of
+   the element.
+*/
+
+#define CAG_DEC_INSERT_OR_GET_HASHED(function, container, iterator_type, \
+                                     type) \
+    iterator_type function(container *hash, type const element, \
+                           const size_t h, int *inserted)
+
+#define CAG_DEF_INSERT_OR_GET_HASHED(function, container, iterator_type, \
+                                     type, cmp_func, alloc_style, \
+                                     alloc_func, free_func, val_adr, \
+                                     node_extra) \
+CAG_DEC_INSERT_OR_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_HASH(container, iterator_type, type, cmp_func, \
+                      alloc_style, alloc_func, free_func, val_adr, \
+                      node_extra, element, h, inserted, 0); \
 }
 
 /*! \brief Function declaration and definition for *put* and *putp*. Every
@@ -237,6 +701,26 @@ CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
     }
 
 
+/*! \brief Return the first node in or after bucket slot mit.
+
+   The slot after the last bucket of an array holds a node whose bucket pointer
+   does not point back at its own slot. For the current array this is the end
+   sentinel, whose bucket pointer does. For the old array during an incremental
+   rehash it is a link node pointing at the start of the new array, so that
+   iteration visits both arrays.
+*/
+
+#define CAG_P_SCAN_HASH(mit) \
+do { \
+    for (;;) { \
+        while (*mit == NULL) \
+            ++mit; \
+        if ((*mit)->bucket == mit) \
+            return *mit; \
+        mit = (*mit)->bucket; \
+    } \
+} while (0)
+
 /*! \brief Function declaration and definition for *begin* and *end*.
 */
 
@@ -247,9 +731,8 @@ CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
 #define CAG_DEF_BEGIN_HASH(function, container, iterator_type) \
     CAG_DEC_BEGIN_HASH(function, container, iterator_type) \
     { \
-        iterator_type *it = hash->objects; \
-        while (*it == NULL) ++it; \
-        return *it; \
+        iterator_type const *it = hash->old ? hash->old : hash->objects; \
+        CAG_P_SCAN_HASH(it); \
     }
 
 #define CAG_DEC_END_HASH(function, container, iterator_type) \
@@ -276,9 +759,7 @@ CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
             return it->next; \
         else { \
             mit = it->bucket + 1; \
-            while ( *mit == NULL) \
-                ++mit; \
-            return *mit; \
+            CAG_P_SCAN_HASH(mit); \
         } \
     }
 
@@ -319,13 +800,13 @@ CAG_DEC_ERASE_HASH(function, container, iterator_type) \
     if (prev) { \
         prev->next = it->next; \
         free_func(val_adr it->value); \
-        CAG_FREE(it); \
+        CAG_P_FREE_NODE_HASH(hash, it); \
         return next_func(prev); \
     } else { \
         next = next_func(it); \
         it->bucket[0] = it->next; \
         free_func(val_adr it->value); \
-        CAG_FREE(it); \
+        CAG_P_FREE_NODE_HASH(hash, it); \
         return next; \
     } \
 }
@@ -334,24 +815,30 @@ CAG_DEC_ERASE_HASH(function, container, iterator_type) \
    value and by address versions are provided.
 */
 
-#define CAG_P_REMOVE_HASH(iterator_type, next_func, hash_func, length_func, \
-                          cmp_func, val_adr, free_func, key) \
+#define CAG_P_REMOVE_HASH(container, iterator_type, next_func, \
+                          cmp_func, val_adr, free_func, key, h) \
 do { \
-    iterator_type it, next, prev = NULL; \
-    size_t i = hash_func(key, length_func(key)) % hash->buckets; \
-    for (it = hash->objects[i]; it != NULL; prev = it, it = it->next) \
-        if (cmp_func(val_adr (key), val_adr it->value) == 0) { \
+    iterator_type it, next, prev = NULL, *bucket; \
+    if (hash->old) \
+        CAG_P_REHASH_STEP(container, hash); \
+    else if (hash->buckets > hash->min_buckets && \
+             (double) hash->size <= hash->min_load * (double) hash->buckets) \
+        shrink_to_fit_ ## container(hash); \
+    bucket = CAG_P_BUCKET_HASH(hash, h); \
+    for (it = *bucket; it != NULL; prev = it, it = it->next) \
+        if (it->hash == (h) && \
+                cmp_func(val_adr (key), val_adr it->value) == 0) { \
             --hash->size; \
             if (prev) { \
                 prev->next = it->next; \
                 free_func(val_adr it->value); \
-                CAG_FREE(it); \
+                CAG_P_FREE_NODE_HASH(hash, it); \
                 return next_func(prev); \
             } else { \
                 next = next_func(it); \
-                hash->objects[i] = it->next; \
+                *bucket = it->next; \
                 free_func(val_adr it->value); \
-                CAG_FREE(it); \
+                CAG_P_FREE_NODE_HASH(hash, it); \
                 return next; \
             } \
         } \
@@ -366,8 +853,9 @@ do { \
                             length_func, cmp_func, val_adr, free_func) \
 CAG_DEC_REMOVE_HASH(function, container, iterator_type, type) \
 { \
-    CAG_P_REMOVE_HASH(iterator_type, next_func, hash_func, length_func, \
-                      cmp_func, val_adr, free_func, element); \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_REMOVE_HASH(container, iterator_type, next_func, cmp_func, \
+                      val_adr, free_func, element, h); \
 }
 
 #define CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
@@ -378,12 +866,40 @@ CAG_DEC_REMOVE_HASH(function, container, iterator_type, type) \
                              length_func, cmp_func, val_adr, free_func) \
 CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
 { \
-    CAG_P_REMOVE_HASH(iterator_type, next_func, hash_func, length_func, \
-                      cmp_func, val_adr, free_func, *element); \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_REMOVE_HASH(container, iterator_type, next_func, cmp_func, \
+                      val_adr, free_func, *element, h); \
+}
+
+/*! \brief Function declaration and definition of *remove_hashed*, a version of
+   *remove* for callers that already hold the hash value of the element.
+*/
+
+#define CAG_DEC_REMOVE_HASHED(function, container, iterator_type, type) \
+    iterator_type function(container *hash, const type element, \
+                           const size_t h)
+
+#define CAG_DEF_REMOVE_HASHED(function, container, iterator_type, \
+                              type, next_func, cmp_func, val_adr, free_func) \
+CAG_DEC_REMOVE_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_REMOVE_HASH(container, iterator_type, next_func, cmp_func, \
+                      val_adr, free_func, element, h); \
 }
 
 
 /*! \brief Function declaration and definition to rebuild the hash table.
+
+    Every node stores the full hash value of its element, so rehashing only
+    allocates a new bucket array and relinks the existing nodes into it. No
+    elements are copied, no nodes are allocated and the hash function is not
+    called. The end sentinel moves with the nodes.
+
+    If the incremental field of the hash table is non-zero, rehash only
+    allocates the new array. The old array is kept and its buckets are moved
+    over a few at a time by rehash_step, which insert and remove call while a
+    migration is in progress. A rehash started while another is in progress
+    first completes the earlier one.
 */
 
 
@@ -393,43 +909,409 @@ CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
 #define CAG_DEF_REHASH(function, container, iterator_type) \
     CAG_DEC_REHASH(function, container) \
     { \
-        container tmp; \
-        iterator_type it, result; \
-        size_t c = 1; \
+        iterator_type *objects, it, next, link = NULL; \
+        size_t i, j, shift; \
+        CAG_P_STATS_DECL \
         if (!hash->rehash) \
             return hash; \
+        if (hash->old) \
+            rehash_step_ ## container(hash, hash->old_buckets); \
+        CAG_P_STATS_START; \
         if (buckets == 0) { \
-            while (c < CAG_P_HTABLE_SIZES && \
-                    cag_p_htable_sizes[c++] <= hash->buckets); \
-            if (c == CAG_P_HTABLE_SIZES) { \
+            for (buckets = CAG_P_HASH_BUCKETS; buckets / 2 < hash->buckets && \
+                    buckets < (size_t) -1 / 2 / sizeof(*objects); \
+                    buckets *= 2); \
+            if (buckets / 2 < hash->buckets) { \
                 hash->rehash = 0; \
                 return hash; \
             } \
-            buckets = cag_p_htable_sizes[c-1]; \
         } \
-        if (!new_with_buckets_ ## container(&tmp, buckets)) { \
+        CAG_P_SHIFT_HASH(buckets, shift); \
+        objects = calloc(buckets + 1, sizeof(*objects)); \
+        if (!objects) { \
             hash->rehash = 0; \
             return hash; \
         } \
-        CAG_FOR_ALL(container, hash, it, \
-                    { \
-                            result = \
-                                    insert_ ## container(&tmp, it->value); \
-        if(!result) { \
-        free_ ## container(&tmp); \
-            hash->rehash = 0; \
-            return hash; \
+        objects[buckets] = hash->objects[hash->buckets]; \
+        objects[buckets]->bucket = &objects[buckets]; \
+        if (hash->incremental) \
+            link = CAG_MALLOC(sizeof(*link)); \
+        if (link) { \
+            link->next = NULL; \
+            link->bucket = objects; \
+            hash->objects[hash->buckets] = link; \
+            hash->old = hash->objects; \
+            hash->old_buckets = hash->buckets; \
+            hash->old_shift = hash->shift; \
+            hash->migrated = 0; \
+        } else { \
+            for (i = 0; i < hash->buckets; ++i) \
+                for (it = hash->objects[i]; it != NULL; it = next) { \
+                    next = it->next; \
+                    j = CAG_P_REDUCE_HASH(it->hash, buckets, shift); \
+                    it->next = objects[j]; \
+                    it->bucket = &objects[j]; \
+                    objects[j] = it; \
+                } \
+            CAG_FREE(hash->objects); \
         } \
-                    }); \
-        free_ ## container(hash); \
-        hash->objects = tmp.objects; \
-        hash->buckets = tmp.buckets; \
-        hash->size = tmp.size; \
+        hash->objects = objects; \
+        hash->buckets = buckets; \
+        hash->shift = shift; \
+        CAG_P_STATS_STOP(hash, 1); \
+        return hash; \
+    }
+
+/*! \brief Function declaration and definition to migrate up to budget buckets
+    of an incremental rehash. Returns the number of buckets still to be
+    migrated, so it can be called until it returns 0 to drain the migration,
+    for example when the program is idle.
+*/
+
+#define CAG_DEC_REHASH_STEP(function, container) \
+    size_t function(container *hash, size_t budget)
+
+#define CAG_DEF_REHASH_STEP(function, container, iterator_type) \
+    CAG_DEC_REHASH_STEP(function, container) \
+    { \
+        iterator_type it, next, *bucket; \
+        CAG_P_STATS_DECL \
+        CAG_P_STATS_START; \
+        for (; hash->old && budget > 0; --budget) { \
+            for (it = hash->old[hash->migrated]; it != NULL; it = next) { \
+                next = it->next; \
+                bucket = &hash->objects[CAG_P_REDUCE_HASH(it->hash, \
+                                        hash->buckets, hash->shift)]; \
+                it->next = *bucket; \
+                it->bucket = bucket; \
+                *bucket = it; \
+            } \
+            hash->old[hash->migrated] = NULL; \
+            if (++hash->migrated == hash->old_buckets) { \
+                CAG_FREE(hash->old[hash->old_buckets]); \
+                CAG_FREE(hash->old); \
+                hash->old = NULL; \
+            } \
+        } \
+        CAG_P_STATS_STOP(hash, 0); \
+        return hash->old ? hash->old_buckets - hash->migrated : 0; \
+    }
+
+/*! \brief Function declaration and definition for *shrink_to_fit*, which
+    rehashes the table into the smallest number of buckets that leaves it at
+    most half of max_load full. Tables are never shrunk below min_buckets,
+    the number of buckets they were created with or that reserve made room
+    for. Chained hash tables call this from remove when they fall below
+    min_load.
+*/
+
+#define CAG_DEC_SHRINK_TO_FIT_HASH(function, container) \
+    container *function(container *hash)
+
+#define CAG_DEF_SHRINK_TO_FIT_HASH(function, container) \
+    CAG_DEC_SHRINK_TO_FIT_HASH(function, container) \
+    { \
+        size_t b = CAG_P_HASH_BUCKETS; \
+        while ((double) hash->size > hash->max_load * (double) b / 2 && \
+                b < hash->buckets) \
+            b *= 2; \
+        if (b < hash->min_buckets) \
+            b = hash->min_buckets; \
+        if (b < hash->buckets) \
+            rehash_ ## container(hash, b); \
+        return hash; \
+    }
+
+/*! \brief Function declarations and definitions for *reserve* and
+    *insert_many*.
+
+    reserve makes room for n elements in all, so that the table is not
+    rehashed again until it holds more than n. It rehashes at most once, to the
+    size the table would have grown to, and does so in one go even if
+    incremental rehashing is switched on. Chained tables are then not shrunk
+    below that size, so removes between inserts do not undo the reservation.
+    Returns NULL if the table could not be resized.
+
+    insert_many inserts the n elements of an array, as insert would. It
+    reserves room for them first, and chained tables also take the nodes for
+    all of them from one block instead of growing their pool slab by slab. The
+    elements are then hashed a batch at a time, with the buckets of a batch
+    prefetched before any element of it is linked in. A table that has
+    already grown therefore sees a single linear pass over the elements.
+    Returns NULL if memory runs out, in which case some of the elements may
+    have been inserted.
+*/
+
+#define CAG_DEC_RESERVE_HASH(function, container) \
+    container *function(container *hash, size_t n)
+
+#define CAG_DEC_INSERT_MANY_HASH(function, container, type) \
+    container *function(container *hash, type const *elements, size_t n)
+
+#define CAG_DEF_RESERVE_HASH(function, container) \
+    CAG_DEC_RESERVE_HASH(function, container) \
+    { \
+        size_t b = CAG_P_HASH_BUCKETS, incremental = hash->incremental; \
+        while ((double) n > hash->max_load * (double) b && \
+                b < (size_t) -1 / 2 / sizeof(*hash->objects)) \
+            b *= 2; \
+        if (b > hash->buckets) { \
+            hash->incremental = 0; \
+            rehash_ ## container(hash, b); \
+            hash->incremental = incremental; \
+        } \
+        if (hash->buckets < b) \
+            return NULL; \
+        if (hash->min_buckets < b) \
+            hash->min_buckets = b; \
         return hash; \
     }
 
+/*! \brief Put the n nodes an insert_many may need into one block. The fresh
+    nodes left in the current slab go onto the free list first, as free
+    assumes every slab but the newest is used up. Nothing is done if the nodes
+    are already there, or if the block cannot be allocated, in which case
+    inserts fall back to the slabs of the pool.
+*/
+
+#define CAG_P_RESERVE_NODES_HASH(hash, it, n) \
+do { \
+    if ((hash)->fresh_left < (n) && \
+            (it = CAG_MALLOC(((n) + 1) * sizeof(*it))) != NULL) { \
+        for (; (hash)->fresh_left; --(hash)->fresh_left) { \
+            (hash)->fresh->bucket = NULL; \
+            (hash)->fresh->next = (hash)->spare; \
+            (hash)->spare = (hash)->fresh++; \
+        } \
+        it->next = (hash)->slabs; \
+        it->hash = (n); \
+        (hash)->slabs = it; \
+        (hash)->fresh = it + 1; \
+        (hash)->fresh_left = (n); \
+    } \
+} while (0)
+
+#define CAG_P_INSERT_MANY_HASH(container, hash, elements, n, hash_func, \
+                               length_func, prefetch) \
+do { \
+    size_t h[CAG_P_GET_MANY_BATCH], i, j, m; \
+    reserve_ ## container(hash, hash->size + n); \
+    for (i = 0; i < n; i += m) { \
+        m = n - i < CAG_P_GET_MANY_BATCH ? n - i : CAG_P_GET_MANY_BATCH; \
+        for (j = 0; j < m; ++j) { \
+            h[j] = hash_func(elements[i + j], \
+                             length_func(elements[i + j])); \
+            prefetch(hash, h[j]); \
+        } \
+        for (j = 0; j < m; ++j) \
+            if (!insert_hashed_ ## container(hash, elements[i + j], h[j])) \
+                return NULL; \
+    } \
+    return hash; \
+} while (0)
+
+#define CAG_P_PREFETCH_HASH(hash, h) CAG_PREFETCH(CAG_P_BUCKET_HASH(hash, h))
+
+#define CAG_DEF_INSERT_MANY_HASH(function, container, iterator_type, type, \
+                                 hash_func, length_func, node_extra) \
+CAG_DEC_INSERT_MANY_HASH(function, container, type) \
+{ \
+    iterator_type block; \
+    if (n && !node_extra(elements[0])) \
+        CAG_P_RESERVE_NODES_HASH(hash, block, n); \
+    CAG_P_INSERT_MANY_HASH(container, hash, elements, n, hash_func, \
+                           length_func, CAG_P_PREFETCH_HASH); \
+}
+
+/*! \brief Function declaration and definition for *stats*. See struct
+   cag_hash_stats above.
+*/
+
+#define CAG_P_STATS_CHAIN(stats, it, len, hit_total) \
+do { \
+    for (len = 0; it != NULL; it = it->next) \
+        ++len; \
+    ++(stats)->chains[len < CAG_HASH_STATS_CHAINS ? \
+                      len : CAG_HASH_STATS_CHAINS - 1]; \
+    if (len > (stats)->max_chain) \
+        (stats)->max_chain = len; \
+    hit_total += (double) len * (double) (len + 1) / 2; \
+} while (0)
+
+#define CAG_DEC_STATS_HASH(function, container) \
+    struct cag_hash_stats *function(const container *hash, \
+                                    struct cag_hash_stats *stats)
+
+#define CAG_DEF_STATS_HASH(function, container, iterator_type) \
+CAG_DEC_STATS_HASH(function, container) \
+{ \
+    size_t i, len, buckets = hash->buckets; \
+    double hit_total = 0; \
+    iterator_type it; \
+    memset(stats, 0, sizeof(*stats)); \
+    for (i = 0; i < hash->buckets; ++i) { \
+        it = hash->objects[i]; \
+        CAG_P_STATS_CHAIN(stats, it, len, hit_total); \
+    } \
+    stats->bucket_bytes = (hash->buckets + 1) * sizeof(*hash->objects); \
+    if (hash->old) { \
+        for (i = hash->migrated; i < hash->old_buckets; ++i) { \
+            it = hash->old[i]; \
+            CAG_P_STATS_CHAIN(stats, it, len, hit_total); \
+        } \
+        buckets += hash->old_buckets - hash->migrated; \
+        stats->bucket_bytes += (hash->old_buckets + 1) * sizeof(*hash->old) + \
+                               sizeof(**hash->old); \
+    } \
+    stats->size = hash->size; \
+    stats->buckets = hash->buckets; \
+    stats->load_factor = (double) hash->size / (double) hash->buckets; \
+    stats->hit_probes = hash->size ? hit_total / (double) hash->size : 0; \
+    stats->miss_probes = (double) hash->size / (double) buckets; \
+    stats->node_bytes = sizeof(**hash->objects); \
+    for (it = hash->slabs; it != NULL; it = it->next) \
+        stats->node_bytes += (it->hash + 1) * sizeof(*it); \
+    stats->value_bytes = hash->size * sizeof(hash->objects[0]->value); \
+    CAG_P_STATS_COPY(hash, stats); \
+    return stats; \
+}
+
+/*! \brief Frozen hash tables.
+
+   freeze copies the elements of a chained hash table into a read-only table
+   built on a minimal perfect hash function (see cag_perfect_hash in
+   common.h). The elements are held in one array with exactly one slot per
+   element. A lookup hashes the key once and then reads one displacement and
+   one element, whatever the table size, and there are no chains to follow.
+   The stored hash values of the nodes are reused, so the hash function is not
+   called while freezing.
+
+   The elements of a group that holds equal hash values are stored next to
+   each other, and a lookup in such a group compares the key with each
+   element of that short block, hashing the next element to see whether the
+   block goes on.
+
+   freeze returns NULL if memory runs out.
+*/
+
+#define CAG_DEC_FREEZE_HASH(function, container) \
+    frozen_ ## container *function(const container *hash, \
+                                   frozen_ ## container *frozen)
+
+#define CAG_DEF_FREEZE_HASH(function, container, iterator_type, \
+                            alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEC_FREEZE_HASH(function, container) \
+{ \
+    size_t n = hash->size, i, *hashes, *pos; \
+    iterator_type it, *nodes; \
+    int ok; \
+    frozen->size = n; \
+    frozen->groups = CAG_P_FROZEN_GROUPS(n); \
+    frozen->disp = CAG_MALLOC(frozen->groups * sizeof(*frozen->disp)); \
+    frozen->values = CAG_MALLOC((n ? n : 1) * sizeof(*frozen->values)); \
+    nodes = CAG_MALLOC((n ? n : 1) * sizeof(*nodes)); \
+    hashes = CAG_MALLOC((n ? n : 1) * sizeof(*hashes)); \
+    pos = CAG_MALLOC((n ? n : 1) * sizeof(*pos)); \
+    ok = frozen->disp && frozen->values && nodes && hashes && pos; \
+    if (ok) { \
+        for (i = 0, it = begin_ ## container(hash); \
+                it != end_ ## container(hash); \
+                ++i, it = next_ ## container(it)) { \
+            nodes[i] = it; \
+            hashes[i] = it->hash; \
+        } \
+        ok = cag_perfect_hash(hashes, n, frozen->disp, frozen->groups, pos); \
+    } \
+    for (i = 0; ok && i < n; ++i) \
+        alloc_style(frozen->values[pos[i]], nodes[i]->value, alloc_func, \
+                    { \
+                        while (i-- > 0) \
+                            free_func(val_adr frozen->values[pos[i]]); \
+                        ok = 0; \
+                        break; \
+                    }); \
+    CAG_FREE(nodes); \
+    CAG_FREE(hashes); \
+    CAG_FREE(pos); \
+    if (!ok) { \
+        CAG_FREE(frozen->disp); \
+        CAG_FREE(frozen->values); \
+        return NULL; \
+    } \
+    return frozen; \
+}
+
+/*! \brief Function declarations and definitions to look up an element of a
+   frozen hash table, returning the address of the element or NULL.
+*/
+
+#define CAG_P_GET_FROZEN_HASH(frozen, key, cmp_func, val_adr, hash_func, \
+                              length_func, h) \
+do { \
+    size_t i; \
+    int run; \
+    if (frozen->size == 0) \
+        return NULL; \
+    CAG_P_FROZEN_INDEX(i, run, frozen->disp, frozen->groups, h, \
+                       frozen->size); \
+    while (cmp_func(val_adr (key), val_adr frozen->values[i]) != 0) \
+        if (!run || ++i == frozen->size || \
+            CAG_P_FROZEN_GROUP((size_t) hash_func(frozen->values[i], \
+                                   length_func(frozen->values[i])), \
+                               frozen->groups) != \
+            CAG_P_FROZEN_GROUP(h, frozen->groups)) \
+            return NULL; \
+    return &frozen->values[i]; \
+} while (0)
+
+#define CAG_DEC_GET_FROZEN_HASH(function, container, type) \
+    type *function(const frozen_ ## container *frozen, const type element)
+
+#define CAG_DEF_GET_FROZEN_HASH(function, container, type, cmp_func, \
+                                val_adr, hash_func, length_func) \
+CAG_DEC_GET_FROZEN_HASH(function, container, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_GET_FROZEN_HASH(frozen, element, cmp_func, val_adr, hash_func, \
+                          length_func, h); \
+}
+
+#define CAG_DEC_GETP_FROZEN_HASH(function, container, type) \
+    type *function(const frozen_ ## container *frozen, const type *element)
+
+#define CAG_DEF_GETP_FROZEN_HASH(function, container, type, cmp_func, \
+                                 val_adr, hash_func, length_func) \
+CAG_DEC_GETP_FROZEN_HASH(function, container, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_GET_FROZEN_HASH(frozen, *element, cmp_func, val_adr, hash_func, \
+                          length_func, h); \
+}
+
+/*! \brief Function declaration and definition to free a frozen hash table. */
+
+#define CAG_DEC_FREE_FROZEN_HASH(function, container) \
+    void function(frozen_ ## container *frozen)
+
+#define CAG_DEF_FREE_FROZEN_HASH(function, container, free_func, val_adr) \
+CAG_DEC_FREE_FROZEN_HASH(function, container) \
+{ \
+    size_t i; \
+    for (i = 0; i < frozen->size; ++i) \
+        free_func(val_adr frozen->values[i]); \
+    CAG_FREE(frozen->values); \
+    CAG_FREE(frozen->disp); \
+}
+
 /*! \brief Function declaration and definition for *free*, to return the
    container to the heap.
+
+   The nodes are released a slab at a time. free_func is called on the nodes
+   of each slab that are in use. When free_func does nothing, as with
+   CAG_NO_FREE_FUNC, that loop has an empty body and the compiler removes it,
+   so freeing takes time proportional to the number of slabs rather than the
+   number of elements. Tables without slabs, whose nodes hold their elements
+   inline, free their nodes bucket by bucket.
 */
 
 
@@ -440,19 +1322,30 @@ CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
                           free_func, val_adr) \
 CAG_DEC_FREE_HASH(function, container) \
 { \
-    size_t i; \
-    iterator_type prev, curr; \
-    for (i = 0; i < hash->buckets; ++i) { \
-        prev = hash->objects[i]; \
-        while(prev) { \
-            free_func(val_adr prev->value); \
-            curr = prev->next; \
-            CAG_FREE(prev); \
-            prev = curr; \
+    size_t i, used; \
+    iterator_type slab, next; \
+    if (hash->old) \
+        rehash_step_ ## container(hash, hash->old_buckets); \
+    for (i = 0; !hash->slabs && hash->size && i < hash->buckets; ++i) \
+        for (slab = hash->objects[i]; slab != NULL; slab = next) { \
+            next = slab->next; \
+            free_func(val_adr slab->value); \
+            CAG_FREE(slab); \
         } \
+    for (slab = hash->slabs, used = slab ? slab->hash - hash->fresh_left : 0; \
+            slab != NULL; slab = next) { \
+        for (i = 1; i <= used; ++i) \
+            if (slab[i].bucket) { \
+                free_func(val_adr slab[i].value); \
+            } \
+        next = slab->next; \
+        CAG_FREE(slab); \
+        if (next) \
+            used = next->hash; \
     } \
     CAG_FREE(hash->objects[hash->buckets]); \
     CAG_FREE(hash->objects); \
+    CAG_P_STATS_FREE(hash); \
 }
 
 /*! \brief Declaration of hash functions and data structures. */
@@ -461,6 +1354,7 @@ CAG_DEC_FREE_HASH(function, container) \
     struct iterator_ ## container { \
         struct iterator_ ## container *next; \
         struct iterator_ ## container **bucket; \
+        size_t hash; \
         type value; \
     }; \
     typedef struct iterator_ ## container iterator_ ## container; \
@@ -470,18 +1364,54 @@ CAG_DEC_FREE_HASH(function, container) \
         size_t buckets; \
         size_t size; \
         int rehash; \
+        double max_load; \
+        double min_load; \
+        size_t min_buckets; \
+        size_t shift; \
+        it_ ## container *old; \
+        size_t old_buckets; \
+        size_t old_shift; \
+        size_t migrated; \
+        size_t incremental; \
+        it_ ## container slabs; \
+        it_ ## container spare; \
+        it_ ## container fresh; \
+        size_t fresh_left; \
+        CAG_P_STATS_FIELD \
     }; \
     typedef struct container container; \
+    struct frozen_ ## container { \
+        type *values; \
+        size_t size; \
+        size_t *disp; \
+        size_t groups; \
+    }; \
+    typedef struct frozen_ ## container frozen_ ## container; \
     CAG_DEC_NEW_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
                                   container); \
     CAG_DEC_NEW_HASH(new_ ## container, container); \
     CAG_DEC_NEW_HASH_WITH_BUCKETS(new_with_buckets_ ## container, container); \
     CAG_DEC_GET_HASH(get_ ## container, container, it_ ## container, type); \
     CAG_DEC_GETP_HASH(getp_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GET_HASHED(get_hashed_ ## container, container, it_ ## container, \
+                       type); \
+    CAG_DEC_GET_MANY_HASH(get_many_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_GETP_MANY_HASH(getp_many_ ## container, container, \
+                           it_ ## container, type); \
+    CAG_DEC_GET_MANY_HASHED(get_many_hashed_ ## container, container, \
+                            it_ ## container, type); \
     CAG_DEC_INSERT_HASH(insert_ ## container, container, it_ ## container, \
                         type); \
     CAG_DEC_INSERTP_HASH(insertp_ ## container, container, it_ ## container, \
                          type); \
+    CAG_DEC_INSERT_HASHED(insert_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASH(insert_or_get_ ## container, container, \
+                               it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASHED(insert_or_get_hashed_ ## container, \
+                                 container, it_ ## container, type); \
+    CAG_DEC_INSERT_MANY_HASH(insert_many_ ## container, container, type); \
     CAG_DEC_PUT_HASH(put_ ## container, container, it_ ## container, \
                      type); \
     CAG_DEC_PUTP_HASH(putp_ ## container, container, it_ ## container, \
@@ -496,10 +1426,20 @@ CAG_DEC_FREE_HASH(function, container) \
                         type); \
     CAG_DEC_REMOVEP_HASH(removep_ ## container, container, it_ ## container, \
                          type); \
+    CAG_DEC_REMOVE_HASHED(remove_hashed_ ## container, container, \
+                          it_ ## container, type); \
     CAG_DEC_ERASE_HASH(erase_ ## container, container, it_ ## container); \
     CAG_DEC_ERASE_RANGE(erase_range_ ## container, \
                         container, it_ ## container); \
     CAG_DEC_REHASH(rehash_ ## container, container); \
+    CAG_DEC_REHASH_STEP(rehash_step_ ## container, container); \
+    CAG_DEC_SHRINK_TO_FIT_HASH(shrink_to_fit_ ## container, container); \
+    CAG_DEC_RESERVE_HASH(reserve_ ## container, container); \
+    CAG_DEC_STATS_HASH(stats_ ## container, container); \
+    CAG_DEC_FREEZE_HASH(freeze_ ## container, container); \
+    CAG_DEC_GET_FROZEN_HASH(get_frozen_ ## container, container, type); \
+    CAG_DEC_GETP_FROZEN_HASH(getp_frozen_ ## container, container, type); \
+    CAG_DEC_FREE_FROZEN_HASH(free_frozen_ ## container, container); \
     CAG_DEC_FREE_HASH(free_ ## container, container); \
     CAG_DEC_FORWARD(container, type)
 
@@ -509,10 +1449,17 @@ CAG_DEC_FREE_HASH(function, container) \
 
 #define CAG_DEC_CMPP_HASH CAG_DEC_CMP_HASH
 
-/*! \brief Definitions of hash functions. */
+/*! \brief Private definition of the chained hash functions, shared by the
+   tables that store elements in their nodes and those that store them inline.
+   node_extra is passed on to insert. Frozen tables hold their own copies of
+   the elements, made with frozen_style and frozen_func and released with
+   frozen_free.
+*/
 
-#define CAG_DEF_ALL_CMP_HASH(container, type, cmp_func, val_adr, hash_func, \
-                             length_func, alloc_style, alloc_func, free_func) \
+#define CAG_P_DEF_ALL_HASH(container, type, cmp_func, val_adr, hash_func, \
+                           length_func, alloc_style, alloc_func, free_func, \
+                           node_extra, frozen_style, frozen_func, \
+                           frozen_free) \
 CAG_DEF_NEW_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
                               container) \
 CAG_DEF_NEW_HASH(new_ ## container, container) \
@@ -520,14 +1467,36 @@ CAG_DEF_GET_HASH(get_ ## container, container, it_ ## container, \
                  type, cmp_func, val_adr, hash_func, length_func) \
 CAG_DEF_GETP_HASH(getp_ ## container, container, it_ ## container, \
                   type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GET_HASHED(get_hashed_ ## container, container, it_ ## container, \
+                   type, cmp_func, val_adr) \
+CAG_DEF_GET_MANY_HASH(get_many_ ## container, container, it_ ## container, \
+                      type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GETP_MANY_HASH(getp_many_ ## container, container, it_ ## container, \
+                       type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GET_MANY_HASHED(get_many_hashed_ ## container, container, \
+                        it_ ## container, type, cmp_func, val_adr, \
+                        hash_func, length_func) \
 CAG_DEF_INSERT_HASH(insert_ ## container, container, it_ ## container, \
                     type, cmp_func, \
                     hash_func, length_func, get_ ## container, \
-                    alloc_style, alloc_func, free_func, val_adr) \
+                    alloc_style, alloc_func, free_func, val_adr, \
+                    node_extra) \
 CAG_DEF_INSERTP_HASH(insertp_ ## container, container, it_ ## container, \
                      type, cmp_func, \
                      hash_func, length_func, get_ ## container, \
-                     alloc_style, alloc_func, free_func, val_adr) \
+                     alloc_style, alloc_func, free_func, val_adr, \
+                     node_extra) \
+CAG_DEF_INSERT_HASHED(insert_hashed_ ## container, container, \
+                      it_ ## container, type, cmp_func, alloc_style, \
+                      alloc_func, free_func, val_adr, node_extra) \
+CAG_DEF_INSERT_OR_GET_HASH(insert_or_get_ ## container, container, \
+                           it_ ## container, type, cmp_func, hash_func, \
+                           length_func, alloc_style, alloc_func, free_func, \
+                           val_adr, node_extra) \
+CAG_DEF_INSERT_OR_GET_HASHED(insert_or_get_hashed_ ## container, \
+                             container, it_ ## container, type, cmp_func, \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             node_extra) \
 CAG_DEF_PUT_HASH(put_ ## container, container, it_ ## container, \
                  type) \
 CAG_DEF_PUTP_HASH(putp_ ## container, container, it_ ## container, \
@@ -545,18 +1514,44 @@ CAG_DEF_REMOVE_HASH(remove_ ## container, container, it_ ## container, \
 CAG_DEF_REMOVEP_HASH(removep_ ## container, container, it_ ## container, \
                      type, next_ ## container, hash_func, length_func, \
                      cmp_func, val_adr, free_func) \
+CAG_DEF_REMOVE_HASHED(remove_hashed_ ## container, container, \
+                      it_ ## container, type, next_ ## container, \
+                      cmp_func, val_adr, free_func) \
 CAG_DEF_ERASE_HASH(erase_ ## container, container, it_ ## container, \
                    next_ ## container, free_func, val_adr) \
 CAG_DEF_ERASE_RANGE(erase_range_ ## container, container, \
                     it_ ## container, erase_ ## container, CAG_NO_OP_3) \
 CAG_DEF_REHASH(rehash_ ## container, container, it_ ## container) \
+CAG_DEF_REHASH_STEP(rehash_step_ ## container, container, it_ ## container) \
+CAG_DEF_SHRINK_TO_FIT_HASH(shrink_to_fit_ ## container, container) \
+CAG_DEF_RESERVE_HASH(reserve_ ## container, container) \
+CAG_DEF_INSERT_MANY_HASH(insert_many_ ## container, container, \
+                         it_ ## container, type, hash_func, length_func, \
+                         node_extra) \
+CAG_DEF_STATS_HASH(stats_ ## container, container, it_ ## container) \
+CAG_DEF_FREEZE_HASH(freeze_ ## container, container, it_ ## container, \
+                    frozen_style, frozen_func, frozen_free, val_adr) \
+CAG_DEF_GET_FROZEN_HASH(get_frozen_ ## container, container, type, \
+                        cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GETP_FROZEN_HASH(getp_frozen_ ## container, container, type, \
+                         cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_FREE_FROZEN_HASH(free_frozen_ ## container, container, \
+                         frozen_free, val_adr) \
 CAG_DEF_FREE_HASH(free_ ## container, container, it_ ## container, \
                   free_func, val_adr) \
 CAG_DEF_FORWARD(container, type) \
 typedef container CAG_P_CMB(container,  __LINE__)
 
-/*! \brief Declaration and definition in one macro. Useful for container types
-    that are only used in one module.
+/*! \brief Definitions of hash functions. */
+
+#define CAG_DEF_ALL_CMP_HASH(container, type, cmp_func, val_adr, hash_func, \
+                             length_func, alloc_style, alloc_func, free_func) \
+    CAG_P_DEF_ALL_HASH(container, type, cmp_func, val_adr, hash_func, \
+                       length_func, alloc_style, alloc_func, free_func, \
+                       CAG_NO_NODE_EXTRA, alloc_style, alloc_func, free_func)
+
+/*! \brief Declaration and definition in one macro. Useful for container types
+    that are only used in one module.
 */
 
 #define CAG_DEC_DEF_ALL_CMP_HASH(container, type, cmp_func, val_adr, hash_func, \
@@ -598,6 +1593,104 @@ typedef container CAG_P_CMB(container,  __LINE__)
     CAG_DEF_CMPP_HASH(container, type, cmp_func, hash_func, length_func)
 
 
+/*! \brief Mapped snapshots of string hash tables.
+
+   save_mapped writes the elements of a string hash table to a file in the
+   format of cag_save_mapped (see mapped.h). open_mapped maps such a file into
+   memory and get_mapped looks keys up in it without building a hash table.
+   For hash tables of strings get_mapped returns the stored string, and for
+   tables of key and data string pairs it returns the data. close_mapped
+   unmaps the file. The key_func and value_func parameters extract the key and
+   value strings from an element. The functions need cagl/mapped.c, so they
+   are only generated by the MAPPED_STR and MAPPED_STR_STR macros below, or
+   by invoking CAG_DEC_MAPPED_HASH and CAG_DEF_MAPPED_HASH directly.
+*/
+
+#define CAG_P_MAPPED_KEY_STR(x) (x)
+
+#define CAG_P_MAPPED_VALUE_STR(x) ""
+
+#define CAG_P_MAPPED_KEY_STR_STR(x) CAG_STR_KEY_FROM_STRUCT(x)
+
+#define CAG_P_MAPPED_VALUE_STR_STR(x) ((char **) &(x))[1]
+
+#define CAG_DEC_SAVE_MAPPED_HASH(function, container) \
+    int function(const container *hash, const char *path)
+
+#define CAG_DEF_SAVE_MAPPED_HASH(function, container, iterator_type, \
+                                 key_func, value_func) \
+CAG_DEC_SAVE_MAPPED_HASH(function, container) \
+{ \
+    size_t i, n = hash->size ? hash->size : 1, *lengths; \
+    const char **strings; \
+    iterator_type it; \
+    int result = CAG_ERROR; \
+    strings = CAG_MALLOC(2 * n * sizeof(*strings)); \
+    lengths = CAG_MALLOC(2 * n * sizeof(*lengths)); \
+    if (strings && lengths) { \
+        for (i = 0, it = begin_ ## container(hash); \
+                it != end_ ## container(hash); \
+                ++i, it = next_ ## container(it)) { \
+            strings[i] = key_func(it->value); \
+            lengths[i] = strlen(strings[i]); \
+            strings[n + i] = value_func(it->value); \
+            lengths[n + i] = strlen(strings[n + i]); \
+        } \
+        result = cag_save_mapped(path, hash->size, strings, lengths, \
+                                 strings + n, lengths + n); \
+    } \
+    CAG_FREE(strings); \
+    CAG_FREE(lengths); \
+    return result; \
+}
+
+#define CAG_DEC_OPEN_MAPPED_HASH(function) \
+    cag_mapped *function(cag_mapped *mapped, const char *path)
+
+#define CAG_DEF_OPEN_MAPPED_HASH(function) \
+CAG_DEC_OPEN_MAPPED_HASH(function) \
+{ \
+    return cag_open_mapped(mapped, path); \
+}
+
+#define CAG_DEC_GET_MAPPED_HASH(function) \
+    const char *function(const cag_mapped *mapped, const char *key)
+
+#define CAG_DEF_GET_MAPPED_STR_HASH(function) \
+CAG_DEC_GET_MAPPED_HASH(function) \
+{ \
+    return cag_get_mapped(mapped, key, strlen(key), NULL); \
+}
+
+#define CAG_DEF_GET_MAPPED_STR_STR_HASH(function) \
+CAG_DEC_GET_MAPPED_HASH(function) \
+{ \
+    const char *value; \
+    return cag_get_mapped(mapped, key, strlen(key), &value) ? value : NULL; \
+}
+
+#define CAG_DEC_CLOSE_MAPPED_HASH(function) \
+    void function(cag_mapped *mapped)
+
+#define CAG_DEF_CLOSE_MAPPED_HASH(function) \
+CAG_DEC_CLOSE_MAPPED_HASH(function) \
+{ \
+    cag_close_mapped(mapped); \
+}
+
+#define CAG_DEC_MAPPED_HASH(container) \
+    CAG_DEC_SAVE_MAPPED_HASH(save_mapped_ ## container, container); \
+    CAG_DEC_OPEN_MAPPED_HASH(open_mapped_ ## container); \
+    CAG_DEC_GET_MAPPED_HASH(get_mapped_ ## container); \
+    CAG_DEC_CLOSE_MAPPED_HASH(close_mapped_ ## container)
+
+#define CAG_DEF_MAPPED_HASH(container, key_func, value_func, get_mapped) \
+    CAG_DEF_SAVE_MAPPED_HASH(save_mapped_ ## container, container, \
+                             it_ ## container, key_func, value_func) \
+    CAG_DEF_OPEN_MAPPED_HASH(open_mapped_ ## container) \
+    get_mapped(get_mapped_ ## container) \
+    CAG_DEF_CLOSE_MAPPED_HASH(close_mapped_ ## container)
+
 /*! \brief Declare and define macros for a hash table whose elements are structs
    composed of two strings.  This is a common use-case, e.g. for a dictionary
    made up of words (the keys) and definitions.
@@ -609,7 +1702,7 @@ typedef container CAG_P_CMB(container,  __LINE__)
 
 #define CAG_DEF_STR_STR_HASH(container, type) \
     CAG_DEF_ALL_CMP_HASH(container, type, CAG_STRCMP_STRUCT_WITH_STR_KEY, \
-                         CAG_BYVAL, CAG_OAT_HASH_STRUCT_WITH_STR_KEY, \
+                         CAG_BYVAL, CAG_FAST_HASH_STRUCT_WITH_STR_KEY, \
                          CAG_STRLEN_STRUCT_WITH_STR_KEY, CAG_STRUCT_ALLOC_STYLE, \
                          cag_alloc_str_str, CAG_FREE_STRUCT_STR_STR)
 
@@ -617,6 +1710,25 @@ typedef container CAG_P_CMB(container,  __LINE__)
     CAG_DEC_STR_STR_HASH(container, type); \
     CAG_DEF_STR_STR_HASH(container, type)
 
+/*! \brief As CAG_DEC_STR_STR_HASH and CAG_DEF_STR_STR_HASH, but also declare
+   and define save_mapped_C, open_mapped_C, get_mapped_C and close_mapped_C.
+   Programs that use them must link with cagl/mapped.c.
+*/
+
+#define CAG_DEC_MAPPED_STR_STR_HASH(container, type) \
+    CAG_DEC_STR_STR_HASH(container, type); \
+    CAG_DEC_MAPPED_HASH(container)
+
+#define CAG_DEF_MAPPED_STR_STR_HASH(container, type) \
+    CAG_DEF_MAPPED_HASH(container, CAG_P_MAPPED_KEY_STR_STR, \
+                        CAG_P_MAPPED_VALUE_STR_STR, \
+                        CAG_DEF_GET_MAPPED_STR_STR_HASH) \
+    CAG_DEF_STR_STR_HASH(container, type)
+
+#define CAG_DEC_DEF_MAPPED_STR_STR_HASH(container, type) \
+    CAG_DEC_MAPPED_STR_STR_HASH(container, type); \
+    CAG_DEF_MAPPED_STR_STR_HASH(container, type)
+
 
 /*! \brief Declare and define macros for a hash table whose elements are C
    strings.  This is a common use-case, e.g. a list of words.
@@ -627,12 +1739,2282 @@ typedef container CAG_P_CMB(container,  __LINE__)
     CAG_DEC_CMP_HASH(container, char *)
 
 #define CAG_DEF_STR_HASH(container) \
-    CAG_DEF_ALL_CMP_HASH(container, char *, strcmp, CAG_BYVAL, cag_oat_hash, \
+    CAG_DEF_ALL_CMP_HASH(container, char *, strcmp, CAG_BYVAL, cag_fast_hash, \
                          strlen, CAG_SIMPLE_ALLOC_STYLE, cag_strdup, free)
 
 #define CAG_DEC_DEF_STR_HASH(container) \
     CAG_DEC_STR_HASH(container); \
     CAG_DEF_STR_HASH(container)
 
+/*! \brief As CAG_DEC_STR_HASH and CAG_DEF_STR_HASH, but also declare and
+   define save_mapped_C, open_mapped_C, get_mapped_C and close_mapped_C.
+   Programs that use them must link with cagl/mapped.c.
+*/
+
+#define CAG_DEC_MAPPED_STR_HASH(container) \
+    CAG_DEC_STR_HASH(container); \
+    CAG_DEC_MAPPED_HASH(container)
+
+#define CAG_DEF_MAPPED_STR_HASH(container) \
+    CAG_DEF_MAPPED_HASH(container, CAG_P_MAPPED_KEY_STR, \
+                        CAG_P_MAPPED_VALUE_STR, CAG_DEF_GET_MAPPED_STR_HASH) \
+    CAG_DEF_STR_HASH(container)
+
+#define CAG_DEC_DEF_MAPPED_STR_HASH(container) \
+    CAG_DEC_MAPPED_STR_HASH(container); \
+    CAG_DEF_MAPPED_STR_HASH(container)
+
+
+/*! \brief Declare and define macros for a hash table of C strings stored
+   inline. Each string is copied into the end of its node, so an element takes
+   one allocation instead of a node and a copy made by cag_strdup, and a lookup
+   that finds the node finds the string next to the cached hash value rather
+   than behind another pointer. The nodes do not come from the pool, so remove
+   returns their memory to the heap at once. The functions are those of
+   CAG_DEC_STR_HASH. Frozen tables hold their own copies of the strings.
+
+   The elements are still of type char *, but point into their nodes. They must
+   not be changed, moved to other nodes, e.g. with swap_C, or kept after their
+   node is removed.
+*/
+
+#define CAG_DEC_INLINE_STR_HASH(container) \
+    CAG_DEC_STR_HASH(container)
+
+#define CAG_DEF_INLINE_STR_HASH(container) \
+    CAG_P_DEF_ALL_HASH(container, char *, strcmp, CAG_BYVAL, cag_fast_hash, \
+                       strlen, CAG_INLINE_STR_ALLOC_STYLE, CAG_NO_ALLOC_FUNC, \
+                       CAG_NO_FREE_FUNC, CAG_INLINE_STR_EXTRA, \
+                       CAG_SIMPLE_ALLOC_STYLE, cag_strdup, free)
+
+#define CAG_DEC_DEF_INLINE_STR_HASH(container) \
+    CAG_DEC_INLINE_STR_HASH(container); \
+    CAG_DEF_INLINE_STR_HASH(container)
+
+
+/*! \brief Open-addressing ("flat") hash table.
+
+    The flat hash table stores its elements inline in a single contiguous array
+    of slots rather than in separately allocated nodes. Collisions are resolved
+    by linear probing. Each slot carries one metadata byte: either a marker
+    (empty, deleted or end of table) or the low seven bits of the element's hash
+    value. A lookup compares metadata bytes first and only calls the
+    comparison function when these match, so a probe usually touches a single
+    cache line and never follows a pointer.
+
+    The number of slots is always a power of two. The slot for an element is
+    found with Fibonacci (multiply-shift) hashing, which uses the high bits of
+    the product and so tolerates weak hash functions such as CAG_INT_HASH.
+
+    The generated functions have the same names and signatures as those of
+    CAG_DEC_CMP_HASH, so the two engines can be swapped by changing the
+    declaration and definition macros. Unlike the chained hash table, inserting
+    into a flat hash table invalidates iterators if the table is resized.
+*/
+
+#define CAG_P_FLAT_EMPTY 0x80
+#define CAG_P_FLAT_DELETED 0xFE
+#define CAG_P_FLAT_END 0xFF
+
+#define CAG_P_FLAT_H2(h) ((unsigned char) ((h) & 0x7F))
+
+#define CAG_P_FLAT_OCCUPIED(slot) ((slot).meta < CAG_P_FLAT_EMPTY)
+
+/*! \brief Default and minimum number of slots in a flat hash table. */
+
+#define CAG_P_FLAT_BUCKETS 16
+
+/*! \brief Slots used (including deleted ones) may not exceed 7/8 of the table.
+*/
+
+#define CAG_P_FLAT_FULL(used, buckets) ((used) > (buckets) - (buckets) / 8)
+
+#define CAG_P_FLAT_INDEX(hash, h) (((h) * CAG_P_GOLDEN_RATIO) >> (hash)->shift)
+
+/*! \brief Allocate slots for a flat hash table. The number of slots is rounded
+    up to a power of two.
+*/
+
+#define CAG_P_ALLOC_FLAT_HASH(hash, n) \
+do { \
+    size_t cag_p_i, cag_p_b = CAG_P_FLAT_BUCKETS; \
+    (hash)->shift = CAG_P_SIZE_T_BIT - 4; \
+    while (cag_p_b < (n) && cag_p_b * 2 > cag_p_b) { \
+        cag_p_b *= 2; \
+        --(hash)->shift; \
+    } \
+    (hash)->objects = CAG_MALLOC((cag_p_b + 1) * sizeof(*(hash)->objects)); \
+    if ((hash)->objects) { \
+        for (cag_p_i = 0; cag_p_i < cag_p_b; ++cag_p_i) \
+            (hash)->objects[cag_p_i].meta = CAG_P_FLAT_EMPTY; \
+        (hash)->objects[cag_p_b].meta = CAG_P_FLAT_END; \
+        (hash)->buckets = cag_p_b; \
+        (hash)->size = 0; \
+        (hash)->deleted = 0; \
+    } \
+} while (0)
+
+#define CAG_DEF_NEW_FLAT_HASH_WITH_BUCKETS(function, container) \
+    CAG_DEC_NEW_HASH_WITH_BUCKETS(function, container) \
+    { \
+        hash->rehash = 1; \
+        CAG_P_ALLOC_FLAT_HASH(hash, buckets); \
+        return hash->objects ? hash : NULL; \
+    }
+
+#define CAG_DEF_NEW_FLAT_HASH(function, container) \
+    CAG_DEC_NEW_HASH(function, container) \
+    { \
+        return new_with_buckets_ ## container(hash, CAG_P_FLAT_BUCKETS); \
+    }
+
+/*! \brief Private algorithm to probe a flat hash table for a key. On exit *it*
+    points to the matching slot, or is NULL if there is none, and *free_slot*
+    points to the first deleted or empty slot on the probe sequence.
+*/
+
+#define CAG_P_PROBE_FLAT_HASH(hash, h, key, cmp_func, val_adr, it, free_slot) \
+do { \
+    size_t cag_p_mask = (hash)->buckets - 1; \
+    size_t cag_p_i = CAG_P_FLAT_INDEX(hash, h); \
+    unsigned char cag_p_h2 = CAG_P_FLAT_H2(h); \
+    free_slot = NULL; \
+    for (;;) { \
+        it = &(hash)->objects[cag_p_i]; \
+        if (it->meta == cag_p_h2) { \
+            if (cmp_func(val_adr (key), val_adr it->value) == 0) \
+                break; \
+        } else if (it->meta == CAG_P_FLAT_EMPTY) { \
+            if (!free_slot) \
+                free_slot = it; \
+            it = NULL; \
+            break; \
+        } else if (it->meta == CAG_P_FLAT_DELETED && !free_slot) { \
+            free_slot = it; \
+        } \
+        cag_p_i = (cag_p_i + 1) & cag_p_mask; \
+    } \
+} while (0)
+
+#define CAG_P_GET_FLAT_HASH(iterator_type, hash, key, cmp_func, val_adr, h) \
+do { \
+    iterator_type it, free_slot; \
+    CAG_P_PROBE_FLAT_HASH(hash, h, key, cmp_func, val_adr, it, free_slot); \
+    (void) free_slot; \
+    return it; \
+} while (0)
+
+#define CAG_DEF_GET_FLAT_HASH(function, container, iterator_type, \
+                              type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEC_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_GET_FLAT_HASH(iterator_type, hash, element, cmp_func, val_adr, h); \
+}
+
+#define CAG_DEF_GETP_FLAT_HASH(function, container, iterator_type, \
+                               type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEC_GETP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_GET_FLAT_HASH(iterator_type, hash, *element, cmp_func, val_adr, h); \
+}
+
+#define CAG_DEF_GET_HASHED_FLAT_HASH(function, container, iterator_type, \
+                                     type, cmp_func, val_adr) \
+CAG_DEC_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_FLAT_HASH(iterator_type, hash, element, cmp_func, val_adr, h); \
+}
+
+/*! \brief Batched lookups for flat hash tables. The home slot of every key in
+    a batch is prefetched before any of them is probed.
+*/
+
+#define CAG_P_GET_MANY_FLAT_HASH(iterator_type, hash, keys, key_adr, \
+                                 hashes, n, results, cmp_func, val_adr, \
+                                 hash_func, length_func) \
+do { \
+    size_t h[CAG_P_GET_MANY_BATCH], i, j, m, found = 0; \
+    iterator_type it, free_slot; \
+    for (i = 0; i < n; i += m) { \
+        m = n - i < CAG_P_GET_MANY_BATCH ? n - i : CAG_P_GET_MANY_BATCH; \
+        for (j = 0; j < m; ++j) { \
+            h[j] = hashes ? hashes[i + j] \
+                   : (size_t) hash_func(key_adr keys[i + j], \
+                                        length_func(key_adr keys[i + j])); \
+            CAG_PREFETCH(&hash->objects[CAG_P_FLAT_INDEX(hash, h[j])]); \
+        } \
+        for (j = 0; j < m; ++j) { \
+            CAG_P_PROBE_FLAT_HASH(hash, h[j], key_adr keys[i + j], cmp_func, \
+                                  val_adr, it, free_slot); \
+            results[i + j] = it; \
+            found += it != NULL; \
+        } \
+    } \
+    (void) free_slot; \
+    return found; \
+} while (0)
+
+#define CAG_DEF_GET_MANY_FLAT_HASH(function, container, iterator_type, type, \
+                                   cmp_func, val_adr, hash_func, length_func) \
+CAG_DEC_GET_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_FLAT_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                             CAG_P_NO_HASHES, n, results, cmp_func, \
+                             val_adr, hash_func, length_func); \
+}
+
+#define CAG_DEF_GETP_MANY_FLAT_HASH(function, container, iterator_type, \
+                                    type, cmp_func, val_adr, hash_func, \
+                                    length_func) \
+CAG_DEC_GETP_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_FLAT_HASH(iterator_type, hash, keys, CAG_P_DEREF, \
+                             CAG_P_NO_HASHES, n, results, cmp_func, \
+                             val_adr, hash_func, length_func); \
+}
+
+#define CAG_DEF_GET_MANY_HASHED_FLAT_HASH(function, container, \
+                                          iterator_type, type, cmp_func, \
+                                          val_adr, hash_func, length_func) \
+CAG_DEC_GET_MANY_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_FLAT_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                             hashes, n, results, cmp_func, \
+                             val_adr, hash_func, length_func); \
+}
+
+/*! \brief Algorithm to insert into a flat hash table. If the key is already
+    present its element is replaced if replace is non-zero, as for the chained
+    hash table.
+*/
+
+#define CAG_P_INSERT_FLAT_HASH(container, iterator_type, type, cmp_func, \
+                               alloc_style, alloc_func, free_func, val_adr, \
+                               val, h, inserted, replace) \
+do { \
+    iterator_type it, free_slot; \
+    type replace_val; \
+    CAG_P_PROBE_FLAT_HASH(hash, h, val, cmp_func, val_adr, it, free_slot); \
+    *(inserted) = (it == NULL); \
+    if (it) { \
+        if (replace) { \
+            alloc_style(replace_val, val, alloc_func, {return NULL;}); \
+            free_func(val_adr it->value); \
+            it->value = replace_val; \
+        } \
+        return it; \
+    } \
+    if (free_slot->meta == CAG_P_FLAT_EMPTY && \
+            CAG_P_FLAT_FULL(hash->size + hash->deleted + 1, hash->buckets)) { \
+        rehash_ ## container(hash, 0); \
+        if (hash->size + hash->deleted + 1 >= hash->buckets) \
+            return NULL; \
+        CAG_P_PROBE_FLAT_HASH(hash, h, val, cmp_func, val_adr, it, \
+                              free_slot); \
+    } \
+    alloc_style(free_slot->value, val, alloc_func, {return NULL;}); \
+    if (free_slot->meta == CAG_P_FLAT_DELETED) \
+        --hash->deleted; \
+    free_slot->meta = CAG_P_FLAT_H2(h); \
+    ++hash->size; \
+    return free_slot; \
+} while (0)
+
+#define CAG_DEF_INSERT_FLAT_HASH(function, container, iterator_type, \
+                                 type, cmp_func, hash_func, length_func, \
+                                 alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEC_INSERT_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int inserted; \
+    CAG_P_INSERT_FLAT_HASH(container, iterator_type, type, cmp_func, \
+                           alloc_style, alloc_func, free_func, val_adr, \
+                           element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERTP_FLAT_HASH(function, container, iterator_type, \
+                                  type, cmp_func, hash_func, length_func, \
+                                  alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    int inserted; \
+    CAG_P_INSERT_FLAT_HASH(container, iterator_type, type, cmp_func, \
+                           alloc_style, alloc_func, free_func, val_adr, \
+                           *element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERT_HASHED_FLAT_HASH(function, container, iterator_type, \
+                                        type, cmp_func, alloc_style, \
+                                        alloc_func, free_func, val_adr) \
+CAG_DEC_INSERT_HASHED(function, container, iterator_type, type) \
+{ \
+    int inserted; \
+    CAG_P_INSERT_FLAT_HASH(container, iterator_type, type, cmp_func, \
+                           alloc_style, alloc_func, free_func, val_adr, \
+                           element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERT_OR_GET_FLAT_HASH(function, container, iterator_type, \
+                                        type, cmp_func, hash_func, \
+                                        length_func, alloc_style, alloc_func, \
+                                        free_func, val_adr) \
+CAG_DEC_INSERT_OR_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_FLAT_HASH(container, iterator_type, type, cmp_func, \
+                           alloc_style, alloc_func, free_func, val_adr, \
+                           element, h, inserted, 0); \
+}
+
+#define CAG_DEF_INSERT_OR_GET_HASHED_FLAT_HASH(function, container, \
+                                               iterator_type, type, cmp_func, \
+                                               alloc_style, alloc_func, \
+                                               free_func, val_adr) \
+CAG_DEC_INSERT_OR_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_FLAT_HASH(container, iterator_type, type, cmp_func, \
+                           alloc_style, alloc_func, free_func, val_adr, \
+                           element, h, inserted, 0); \
+}
+
+/*! \brief Function declaration and definition for *begin*, *end* and *next*.
+    Iteration scans the slot array, skipping empty and deleted slots. The end
+    marker slot stops the scan.
+*/
+
+#define CAG_P_SKIP_FLAT_HASH(it) \
+    while ((it)->meta >= CAG_P_FLAT_EMPTY && (it)->meta != CAG_P_FLAT_END) \
+        ++(it)
+
+#define CAG_DEF_BEGIN_FLAT_HASH(function, container, iterator_type) \
+    CAG_DEC_BEGIN_HASH(function, container, iterator_type) \
+    { \
+        iterator_type it = hash->objects; \
+        CAG_P_SKIP_FLAT_HASH(it); \
+        return it; \
+    }
+
+#define CAG_DEF_END_FLAT_HASH(function, container, iterator_type) \
+    CAG_DEC_END_HASH(function, container, iterator_type) \
+    { \
+        return hash->objects + hash->buckets; \
+    }
+
+#define CAG_DEF_NEXT_FLAT_HASH(function, iterator_type) \
+    CAG_DEC_NEXT_HASH(function, iterator_type) \
+    { \
+        iterator_type n = it + 1; \
+        CAG_P_SKIP_FLAT_HASH(n); \
+        return n; \
+    }
+
+/*! \brief Mark a slot as free. If the following slot is empty no probe
+    sequence can pass through this one, so it too can be marked empty instead
+    of leaving a tombstone.
+*/
+
+#define CAG_P_RELEASE_FLAT_HASH(hash, it) \
+do { \
+    size_t cag_p_n = ((it) - (hash)->objects + 1) & ((hash)->buckets - 1); \
+    if ((hash)->objects[cag_p_n].meta == CAG_P_FLAT_EMPTY) { \
+        (it)->meta = CAG_P_FLAT_EMPTY; \
+    } else { \
+        (it)->meta = CAG_P_FLAT_DELETED; \
+        ++(hash)->deleted; \
+    } \
+    --(hash)->size; \
+} while (0)
+
+#define CAG_DEF_ERASE_FLAT_HASH(function, container, iterator_type, \
+                                next_func, free_func, val_adr) \
+CAG_DEC_ERASE_HASH(function, container, iterator_type) \
+{ \
+    free_func(val_adr it->value); \
+    CAG_P_RELEASE_FLAT_HASH(hash, it); \
+    return next_func(it); \
+}
+
+#define CAG_P_REMOVE_FLAT_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                               free_func, key, h) \
+do { \
+    iterator_type it, free_slot; \
+    CAG_P_PROBE_FLAT_HASH(hash, h, key, cmp_func, val_adr, it, free_slot); \
+    (void) free_slot; \
+    if (!it) \
+        return NULL; \
+    free_func(val_adr it->value); \
+    CAG_P_RELEASE_FLAT_HASH(hash, it); \
+    return next_func(it); \
+} while (0)
+
+#define CAG_DEF_REMOVE_FLAT_HASH(function, container, iterator_type, \
+                                 type, next_func, hash_func, \
+                                 length_func, cmp_func, val_adr, free_func) \
+CAG_DEC_REMOVE_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_REMOVE_FLAT_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                           free_func, element, h); \
+}
+
+#define CAG_DEF_REMOVEP_FLAT_HASH(function, container, iterator_type, \
+                                  type, next_func, hash_func, \
+                                  length_func, cmp_func, val_adr, free_func) \
+CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_REMOVE_FLAT_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                           free_func, *element, h); \
+}
+
+#define CAG_DEF_REMOVE_HASHED_FLAT_HASH(function, container, iterator_type, \
+                                        type, next_func, cmp_func, val_adr, \
+                                        free_func) \
+CAG_DEC_REMOVE_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_REMOVE_FLAT_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                           free_func, element, h); \
+}
+
+/*! \brief Function definition to rebuild a flat hash table. Elements are moved
+    into the new slot array without being copied by *alloc_func*. If *buckets*
+    is zero the table doubles in size, unless it is mostly tombstones, in which
+    case it is rebuilt at the same size to reclaim them.
+*/
+
+#define CAG_DEF_REHASH_FLAT_HASH(function, container, iterator_type, \
+                                 hash_func, length_func) \
+CAG_DEC_REHASH(function, container) \
+{ \
+    container tmp; \
+    iterator_type it, to; \
+    size_t h, i, mask; \
+    if (!hash->rehash) \
+        return hash; \
+    if (buckets == 0) { \
+        if (CAG_P_FLAT_FULL(hash->size * 2, hash->buckets)) \
+            buckets = hash->buckets * 2; \
+        else \
+            buckets = hash->buckets; \
+    } \
+    if (buckets < hash->size + hash->size / 7 + 1) \
+        buckets = hash->size + hash->size / 7 + 1; \
+    CAG_P_ALLOC_FLAT_HASH(&tmp, buckets); \
+    if (!tmp.objects) { \
+        hash->rehash = 0; \
+        return hash; \
+    } \
+    mask = tmp.buckets - 1; \
+    for (it = hash->objects; it != hash->objects + hash->buckets; ++it) { \
+        if (!CAG_P_FLAT_OCCUPIED(*it)) \
+            continue; \
+        h = hash_func(it->value, length_func(it->value)); \
+        i = CAG_P_FLAT_INDEX(&tmp, h); \
+        while (tmp.objects[i].meta != CAG_P_FLAT_EMPTY) \
+            i = (i + 1) & mask; \
+        to = &tmp.objects[i]; \
+        to->value = it->value; \
+        to->meta = it->meta; \
+    } \
+    CAG_FREE(hash->objects); \
+    hash->objects = tmp.objects; \
+    hash->buckets = tmp.buckets; \
+    hash->shift = tmp.shift; \
+    hash->deleted = 0; \
+    return hash; \
+}
+
+/*! \brief Function definition for *shrink_to_fit* of a flat hash table. The
+    table is rebuilt at the smallest size that leaves it at most half full,
+    which also clears out deleted slots.
+*/
+
+#define CAG_DEF_SHRINK_TO_FIT_FLAT_HASH(function, container) \
+CAG_DEC_SHRINK_TO_FIT_HASH(function, container) \
+{ \
+    size_t b = CAG_P_FLAT_BUCKETS; \
+    while (b / 2 < hash->size && b < hash->buckets) \
+        b *= 2; \
+    if (b < hash->buckets || hash->deleted) \
+        rehash_ ## container(hash, b); \
+    return hash; \
+}
+
+/*! \brief Function definitions for *reserve* and *insert_many* of a flat
+    hash table. reserve also clears out deleted slots if they would make the
+    table fill up before it holds n elements.
+*/
+
+#define CAG_DEF_RESERVE_FLAT_HASH(function, container) \
+CAG_DEC_RESERVE_HASH(function, container) \
+{ \
+    size_t b = CAG_P_FLAT_BUCKETS; \
+    while (CAG_P_FLAT_FULL(n, b) && b * 2 > b) \
+        b *= 2; \
+    if (b > hash->buckets || \
+            CAG_P_FLAT_FULL(n + hash->deleted, hash->buckets)) \
+        rehash_ ## container(hash, b > hash->buckets ? b : hash->buckets); \
+    return CAG_P_FLAT_FULL(n + hash->deleted, hash->buckets) ? NULL : hash; \
+}
+
+#define CAG_P_PREFETCH_FLAT_HASH(hash, h) \
+    CAG_PREFETCH(&(hash)->objects[CAG_P_FLAT_INDEX(hash, h)])
+
+#define CAG_DEF_INSERT_MANY_FLAT_HASH(function, container, type, hash_func, \
+                                      length_func) \
+CAG_DEC_INSERT_MANY_HASH(function, container, type) \
+{ \
+    CAG_P_INSERT_MANY_HASH(container, hash, elements, n, hash_func, \
+                           length_func, CAG_P_PREFETCH_FLAT_HASH); \
+}
+
+/*! \brief Function definition for *free* of a flat hash table. */
+
+#define CAG_DEF_FREE_FLAT_HASH(function, container, iterator_type, \
+                               free_func, val_adr) \
+CAG_DEC_FREE_HASH(function, container) \
+{ \
+    iterator_type it; \
+    for (it = hash->objects; it != hash->objects + hash->buckets; ++it) \
+        if (CAG_P_FLAT_OCCUPIED(*it)) { \
+            free_func(val_adr it->value); \
+        } \
+    CAG_FREE(hash->objects); \
+}
+
+/*! \brief Declaration of flat hash table functions and data structures. */
+
+#define CAG_DEC_FLAT_HASH(container, type) \
+    struct iterator_ ## container { \
+        type value; \
+        unsigned char meta; \
+    }; \
+    typedef struct iterator_ ## container iterator_ ## container; \
+    typedef iterator_ ## container * it_ ## container; \
+    struct container { \
+        it_ ## container objects; \
+        size_t buckets; \
+        size_t size; \
+        size_t deleted; \
+        size_t shift; \
+        int rehash; \
+    }; \
+    typedef struct container container; \
+    CAG_DEC_NEW_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
+                                  container); \
+    CAG_DEC_NEW_HASH(new_ ## container, container); \
+    CAG_DEC_GET_HASH(get_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GETP_HASH(getp_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GET_HASHED(get_hashed_ ## container, container, it_ ## container, \
+                       type); \
+    CAG_DEC_GET_MANY_HASH(get_many_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_GETP_MANY_HASH(getp_many_ ## container, container, \
+                           it_ ## container, type); \
+    CAG_DEC_GET_MANY_HASHED(get_many_hashed_ ## container, container, \
+                            it_ ## container, type); \
+    CAG_DEC_INSERT_HASH(insert_ ## container, container, it_ ## container, \
+                        type); \
+    CAG_DEC_INSERTP_HASH(insertp_ ## container, container, it_ ## container, \
+                         type); \
+    CAG_DEC_INSERT_HASHED(insert_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASH(insert_or_get_ ## container, container, \
+                               it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASHED(insert_or_get_hashed_ ## container, \
+                                 container, it_ ## container, type); \
+    CAG_DEC_INSERT_MANY_HASH(insert_many_ ## container, container, type); \
+    CAG_DEC_PUT_HASH(put_ ## container, container, it_ ## container, \
+                     type); \
+    CAG_DEC_PUTP_HASH(putp_ ## container, container, it_ ## container, \
+                      type); \
+    CAG_DEC_BEGIN_HASH(begin_ ## container, container, it_ ## container); \
+    CAG_DEC_END_HASH(end_ ## container, container, it_ ## container); \
+    CAG_DEC_NEXT_HASH(next_ ## container, it_ ## container); \
+    CAG_DEC_AT_HASH(at_ ## container, it_ ## container); \
+    CAG_DEC_CMP(cmp_ ## container, it_ ## container, it_ ## container); \
+    CAG_DEC_DISTANCE(distance_ ## container, it_ ## container); \
+    CAG_DEC_REMOVE_HASH(remove_ ## container, container, it_ ## container, \
+                        type); \
+    CAG_DEC_REMOVEP_HASH(removep_ ## container, container, it_ ## container, \
+                         type); \
+    CAG_DEC_REMOVE_HASHED(remove_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_ERASE_HASH(erase_ ## container, container, it_ ## container); \
+    CAG_DEC_ERASE_RANGE(erase_range_ ## container, \
+                        container, it_ ## container); \
+    CAG_DEC_REHASH(rehash_ ## container, container); \
+    CAG_DEC_SHRINK_TO_FIT_HASH(shrink_to_fit_ ## container, container); \
+    CAG_DEC_RESERVE_HASH(reserve_ ## container, container); \
+    CAG_DEC_FREE_HASH(free_ ## container, container); \
+    CAG_DEC_FORWARD(container, type)
+
+/*! \brief Definitions of flat hash table functions. */
+
+#define CAG_DEF_ALL_FLAT_HASH(container, type, cmp_func, val_adr, hash_func, \
+                              length_func, alloc_style, alloc_func, \
+                              free_func) \
+CAG_DEF_NEW_FLAT_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
+                                   container) \
+CAG_DEF_NEW_FLAT_HASH(new_ ## container, container) \
+CAG_DEF_GET_FLAT_HASH(get_ ## container, container, it_ ## container, \
+                      type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GETP_FLAT_HASH(getp_ ## container, container, it_ ## container, \
+                       type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GET_HASHED_FLAT_HASH(get_hashed_ ## container, container, \
+                             it_ ## container, type, cmp_func, val_adr) \
+CAG_DEF_GET_MANY_FLAT_HASH(get_many_ ## container, container, \
+                           it_ ## container, type, cmp_func, val_adr, \
+                           hash_func, length_func) \
+CAG_DEF_GETP_MANY_FLAT_HASH(getp_many_ ## container, container, \
+                            it_ ## container, type, cmp_func, val_adr, \
+                            hash_func, length_func) \
+CAG_DEF_GET_MANY_HASHED_FLAT_HASH(get_many_hashed_ ## container, \
+                                  container, it_ ## container, type, \
+                                  cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_INSERT_FLAT_HASH(insert_ ## container, container, it_ ## container, \
+                         type, cmp_func, hash_func, length_func, \
+                         alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEF_INSERTP_FLAT_HASH(insertp_ ## container, container, \
+                          it_ ## container, type, cmp_func, hash_func, \
+                          length_func, alloc_style, alloc_func, free_func, \
+                          val_adr) \
+CAG_DEF_INSERT_HASHED_FLAT_HASH(insert_hashed_ ## container, container, \
+                                it_ ## container, type, cmp_func, \
+                                alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEF_INSERT_OR_GET_FLAT_HASH(insert_or_get_ ## container, container, \
+                                it_ ## container, type, cmp_func, hash_func, \
+                                length_func, alloc_style, alloc_func, \
+                                free_func, val_adr) \
+CAG_DEF_INSERT_OR_GET_HASHED_FLAT_HASH(insert_or_get_hashed_ ## container, \
+                                       container, it_ ## container, type, \
+                                       cmp_func, alloc_style, alloc_func, \
+                                       free_func, val_adr) \
+CAG_DEF_PUT_HASH(put_ ## container, container, it_ ## container, \
+                 type) \
+CAG_DEF_PUTP_HASH(putp_ ## container, container, it_ ## container, \
+                  type) \
+CAG_DEF_BEGIN_FLAT_HASH(begin_ ## container, container, it_ ## container) \
+CAG_DEF_END_FLAT_HASH(end_ ## container, container, it_ ## container) \
+CAG_DEF_NEXT_FLAT_HASH(next_ ## container, it_ ## container) \
+CAG_DEF_AT_HASH(at_ ## container, it_ ## container, next_ ## container) \
+CAG_DEF_DISTANCE(distance_ ## container, it_ ## container, next_ ## container) \
+CAG_DEF_CMP(cmp_ ## container, it_ ## container, it_ ## container, \
+            cmp_func, val_adr) \
+CAG_DEF_REMOVE_FLAT_HASH(remove_ ## container, container, it_ ## container, \
+                         type, next_ ## container, hash_func, length_func, \
+                         cmp_func, val_adr, free_func) \
+CAG_DEF_REMOVEP_FLAT_HASH(removep_ ## container, container, \
+                          it_ ## container, type, next_ ## container, \
+                          hash_func, length_func, cmp_func, val_adr, \
+                          free_func) \
+CAG_DEF_REMOVE_HASHED_FLAT_HASH(remove_hashed_ ## container, container, \
+                                it_ ## container, type, next_ ## container, \
+                                cmp_func, val_adr, free_func) \
+CAG_DEF_ERASE_FLAT_HASH(erase_ ## container, container, it_ ## container, \
+                        next_ ## container, free_func, val_adr) \
+CAG_DEF_ERASE_RANGE(erase_range_ ## container, container, \
+                    it_ ## container, erase_ ## container, CAG_NO_OP_3) \
+CAG_DEF_REHASH_FLAT_HASH(rehash_ ## container, container, it_ ## container, \
+                         hash_func, length_func) \
+CAG_DEF_SHRINK_TO_FIT_FLAT_HASH(shrink_to_fit_ ## container, container) \
+CAG_DEF_RESERVE_FLAT_HASH(reserve_ ## container, container) \
+CAG_DEF_INSERT_MANY_FLAT_HASH(insert_many_ ## container, container, type, \
+                              hash_func, length_func) \
+CAG_DEF_FREE_FLAT_HASH(free_ ## container, container, it_ ## container, \
+                       free_func, val_adr) \
+CAG_DEF_FORWARD(container, type) \
+typedef container CAG_P_CMB(container,  __LINE__)
+
+#define CAG_DEC_DEF_ALL_FLAT_HASH(container, type, cmp_func, val_adr, \
+                                  hash_func, length_func, alloc_style, \
+                                  alloc_func, free_func) \
+    CAG_DEC_FLAT_HASH(container, type); \
+    CAG_DEF_ALL_FLAT_HASH(container, type, cmp_func, val_adr, hash_func, \
+                          length_func, alloc_style, alloc_func, free_func)
+
+/*! \brief Flat hash table that does not manage the memory of its elements. */
+
+#define CAG_DEF_FLAT_HASH(container, type, cmp_func, hash_func, length_func) \
+    CAG_DEF_ALL_FLAT_HASH(container, type, cmp_func, CAG_BYVAL, \
+                          hash_func, length_func, \
+                          CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                          CAG_NO_FREE_FUNC)
+
+/*! \brief Same as CAG_DEF_FLAT_HASH but cmp_func takes parameters by address.
+*/
+
+#define CAG_DEF_FLATP_HASH(container, type, cmp_func, hash_func, length_func) \
+    CAG_DEF_ALL_FLAT_HASH(container, type, cmp_func, CAG_BYADR, \
+                          hash_func, length_func, \
+                          CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                          CAG_NO_FREE_FUNC)
+
+#define CAG_DEC_DEF_FLAT_HASH(container, type, cmp_func, hash_func, \
+                              length_func) \
+    CAG_DEC_FLAT_HASH(container, type); \
+    CAG_DEF_FLAT_HASH(container, type, cmp_func, hash_func, length_func)
+
+#define CAG_DEC_DEF_FLATP_HASH(container, type, cmp_func, hash_func, \
+                               length_func) \
+    CAG_DEC_FLAT_HASH(container, type); \
+    CAG_DEF_FLATP_HASH(container, type, cmp_func, hash_func, length_func)
+
+/*! \brief Flat hash tables of C strings and of structs with a string key and
+    string data. Memory is managed as for CAG_DEF_STR_HASH and
+    CAG_DEF_STR_STR_HASH.
+*/
+
+#define CAG_DEC_STR_FLAT_HASH(container) \
+    CAG_DEC_FLAT_HASH(container, char *)
+
+#define CAG_DEF_STR_FLAT_HASH(container) \
+    CAG_DEF_ALL_FLAT_HASH(container, char *, strcmp, CAG_BYVAL, \
+                          cag_fast_hash, strlen, CAG_SIMPLE_ALLOC_STYLE, \
+                          cag_strdup, free)
+
+#define CAG_DEC_DEF_STR_FLAT_HASH(container) \
+    CAG_DEC_STR_FLAT_HASH(container); \
+    CAG_DEF_STR_FLAT_HASH(container)
+
+#define CAG_DEC_STR_STR_FLAT_HASH(container, type) \
+    CAG_DEC_FLAT_HASH(container, type)
+
+#define CAG_DEF_STR_STR_FLAT_HASH(container, type) \
+    CAG_DEF_ALL_FLAT_HASH(container, type, CAG_STRCMP_STRUCT_WITH_STR_KEY, \
+                          CAG_BYVAL, CAG_FAST_HASH_STRUCT_WITH_STR_KEY, \
+                          CAG_STRLEN_STRUCT_WITH_STR_KEY, \
+                          CAG_STRUCT_ALLOC_STYLE, cag_alloc_str_str, \
+                          CAG_FREE_STRUCT_STR_STR)
+
+#define CAG_DEC_DEF_STR_STR_FLAT_HASH(container, type) \
+    CAG_DEC_STR_STR_FLAT_HASH(container, type); \
+    CAG_DEF_STR_STR_FLAT_HASH(container, type)
+
+
+/*! \brief Insertion-ordered hash table.
+
+    The ordered hash table keeps its elements in a dense array in the order
+    they were inserted, together with a separate index: an open-addressing
+    array of positions in the element array, probed linearly from the
+    Fibonacci hash of the key. Each element stores its full hash value, so the
+    index can be rebuilt without calling the hash function.
+
+    Iteration walks the element array from the front, so it visits elements in
+    insertion order and in memory order, and its cost depends on the number of
+    elements rather than the size of the index. Removing an element leaves a
+    hole that iteration skips; the holes are squeezed out when the table next
+    runs out of room or is rehashed.
+
+    The generated functions have the same names and signatures as those of
+    CAG_DEC_FLAT_HASH. As for the flat hash table, inserting invalidates
+    iterators if the table is rehashed. Replacing an existing element keeps its
+    position.
+*/
+
+#define CAG_P_ORDERED_LIVE 0
+#define CAG_P_ORDERED_DEAD 1
+#define CAG_P_ORDERED_END 2
+
+/*! \brief Minimum number of index slots in an ordered hash table. */
+
+#define CAG_P_ORDERED_BUCKETS 8
+
+/*! \brief The element array holds up to 3/4 as many elements, including holes,
+    as there are index slots.
+*/
+
+#define CAG_P_ORDERED_CAPACITY(buckets) ((buckets) - (buckets) / 4)
+
+/*! \brief Fill the index of an ordered hash table whose element array has no
+    holes.
+*/
+
+#define CAG_P_INDEX_ORDERED_HASH(hash) \
+do { \
+    size_t cag_p_e, cag_p_i, cag_p_mask = (hash)->buckets - 1; \
+    for (cag_p_e = 0; cag_p_e < (hash)->used; ++cag_p_e) { \
+        cag_p_i = CAG_P_FLAT_INDEX(hash, (hash)->objects[cag_p_e].hash); \
+        while ((hash)->index[cag_p_i]) \
+            cag_p_i = (cag_p_i + 1) & cag_p_mask; \
+        (hash)->index[cag_p_i] = cag_p_e + 1; \
+    } \
+} while (0)
+
+/*! \brief Allocate the index and element array of an ordered hash table with
+    at least n index slots, rounded up to a power of two.
+*/
+
+#define CAG_P_ALLOC_ORDERED_HASH(hash, n) \
+do { \
+    size_t cag_p_b = CAG_P_ORDERED_BUCKETS; \
+    (hash)->shift = CAG_P_SIZE_T_BIT - 3; \
+    while (cag_p_b < (n) && cag_p_b * 2 > cag_p_b) { \
+        cag_p_b *= 2; \
+        --(hash)->shift; \
+    } \
+    (hash)->buckets = cag_p_b; \
+    (hash)->capacity = CAG_P_ORDERED_CAPACITY(cag_p_b); \
+    (hash)->size = (hash)->used = 0; \
+    (hash)->index = calloc(cag_p_b, sizeof(*(hash)->index)); \
+    (hash)->objects = (hash)->index ? \
+            CAG_MALLOC(((hash)->capacity + 1) * sizeof(*(hash)->objects)) : \
+            NULL; \
+    if ((hash)->objects) \
+        (hash)->objects[0].meta = CAG_P_ORDERED_END; \
+    else \
+        CAG_FREE((hash)->index); \
+} while (0)
+
+#define CAG_DEF_NEW_ORDERED_HASH_WITH_BUCKETS(function, container) \
+    CAG_DEC_NEW_HASH_WITH_BUCKETS(function, container) \
+    { \
+        hash->rehash = 1; \
+        CAG_P_ALLOC_ORDERED_HASH(hash, buckets); \
+        return hash->objects ? hash : NULL; \
+    }
+
+#define CAG_DEF_NEW_ORDERED_HASH(function, container) \
+    CAG_DEC_NEW_HASH(function, container) \
+    { \
+        return new_with_buckets_ ## container(hash, CAG_P_ORDERED_BUCKETS); \
+    }
+
+/*! \brief Private algorithm to look a key up in the index of an ordered hash
+    table. On exit *it* points to the matching element, or is NULL if there is
+    none, and *slot* is the index slot of the element, or the empty slot that
+    ended the probe.
+*/
+
+#define CAG_P_PROBE_ORDERED_HASH(hash, h, key, cmp_func, val_adr, it, slot) \
+do { \
+    size_t cag_p_mask = (hash)->buckets - 1; \
+    slot = CAG_P_FLAT_INDEX(hash, h); \
+    for (;;) { \
+        if ((hash)->index[slot] == 0) { \
+            it = NULL; \
+            break; \
+        } \
+        it = &(hash)->objects[(hash)->index[slot] - 1]; \
+        if (it->hash == (h) && \
+                cmp_func(val_adr (key), val_adr it->value) == 0) \
+            break; \
+        slot = (slot + 1) & cag_p_mask; \
+    } \
+} while (0)
+
+#define CAG_P_GET_ORDERED_HASH(iterator_type, hash, key, cmp_func, val_adr, \
+                               h) \
+do { \
+    iterator_type it; \
+    size_t slot; \
+    CAG_P_PROBE_ORDERED_HASH(hash, h, key, cmp_func, val_adr, it, slot); \
+    return it; \
+} while (0)
+
+#define CAG_DEF_GET_ORDERED_HASH(function, container, iterator_type, \
+                                 type, cmp_func, val_adr, hash_func, \
+                                 length_func) \
+CAG_DEC_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_GET_ORDERED_HASH(iterator_type, hash, element, cmp_func, val_adr, \
+                           h); \
+}
+
+#define CAG_DEF_GETP_ORDERED_HASH(function, container, iterator_type, \
+                                  type, cmp_func, val_adr, hash_func, \
+                                  length_func) \
+CAG_DEC_GETP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_GET_ORDERED_HASH(iterator_type, hash, *element, cmp_func, val_adr, \
+                           h); \
+}
+
+#define CAG_DEF_GET_HASHED_ORDERED_HASH(function, container, iterator_type, \
+                                        type, cmp_func, val_adr) \
+CAG_DEC_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_ORDERED_HASH(iterator_type, hash, element, cmp_func, val_adr, \
+                           h); \
+}
+
+/*! \brief Batched lookups for ordered hash tables. The index slots of a batch
+    are prefetched, then the elements they point to, and then the keys are
+    probed.
+*/
+
+#define CAG_P_GET_MANY_ORDERED_HASH(iterator_type, hash, keys, key_adr, \
+                                    hashes, n, results, cmp_func, val_adr, \
+                                    hash_func, length_func) \
+do { \
+    size_t h[CAG_P_GET_MANY_BATCH], i, j, m, slot, found = 0; \
+    iterator_type it; \
+    for (i = 0; i < n; i += m) { \
+        m = n - i < CAG_P_GET_MANY_BATCH ? n - i : CAG_P_GET_MANY_BATCH; \
+        for (j = 0; j < m; ++j) { \
+            h[j] = hashes ? hashes[i + j] \
+                   : (size_t) hash_func(key_adr keys[i + j], \
+                                        length_func(key_adr keys[i + j])); \
+            CAG_PREFETCH(&hash->index[CAG_P_FLAT_INDEX(hash, h[j])]); \
+        } \
+        for (j = 0; j < m; ++j) { \
+            slot = hash->index[CAG_P_FLAT_INDEX(hash, h[j])]; \
+            if (slot) \
+                CAG_PREFETCH(&hash->objects[slot - 1]); \
+        } \
+        for (j = 0; j < m; ++j) { \
+            CAG_P_PROBE_ORDERED_HASH(hash, h[j], key_adr keys[i + j], \
+                                     cmp_func, val_adr, it, slot); \
+            results[i + j] = it; \
+            found += it != NULL; \
+        } \
+    } \
+    return found; \
+} while (0)
+
+#define CAG_DEF_GET_MANY_ORDERED_HASH(function, container, iterator_type, \
+                                      type, cmp_func, val_adr, hash_func, \
+                                      length_func) \
+CAG_DEC_GET_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_ORDERED_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                                CAG_P_NO_HASHES, n, results, cmp_func, \
+                                val_adr, hash_func, length_func); \
+}
+
+#define CAG_DEF_GETP_MANY_ORDERED_HASH(function, container, iterator_type, \
+                                       type, cmp_func, val_adr, hash_func, \
+                                       length_func) \
+CAG_DEC_GETP_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_ORDERED_HASH(iterator_type, hash, keys, CAG_P_DEREF, \
+                                CAG_P_NO_HASHES, n, results, cmp_func, \
+                                val_adr, hash_func, length_func); \
+}
+
+#define CAG_DEF_GET_MANY_HASHED_ORDERED_HASH(function, container, \
+                                             iterator_type, type, cmp_func, \
+                                             val_adr, hash_func, length_func) \
+CAG_DEC_GET_MANY_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_ORDERED_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                                hashes, n, results, cmp_func, \
+                                val_adr, hash_func, length_func); \
+}
+
+/*! \brief Algorithm to insert into an ordered hash table. New elements are
+    appended to the element array. If the array is full the table is rehashed
+    first, which removes holes and grows the table if needed.
+*/
+
+#define CAG_P_INSERT_ORDERED_HASH(container, iterator_type, type, cmp_func, \
+                                  alloc_style, alloc_func, free_func, \
+                                  val_adr, val, h, inserted, replace) \
+do { \
+    iterator_type it; \
+    type replace_val; \
+    size_t slot; \
+    CAG_P_PROBE_ORDERED_HASH(hash, h, val, cmp_func, val_adr, it, slot); \
+    *(inserted) = (it == NULL); \
+    if (it) { \
+        if (replace) { \
+            alloc_style(replace_val, val, alloc_func, {return NULL;}); \
+            free_func(val_adr it->value); \
+            it->value = replace_val; \
+        } \
+        return it; \
+    } \
+    if (hash->used == hash->capacity) { \
+        rehash_ ## container(hash, 0); \
+        if (hash->used == hash->capacity) \
+            return NULL; \
+        CAG_P_PROBE_ORDERED_HASH(hash, h, val, cmp_func, val_adr, it, slot); \
+    } \
+    it = &hash->objects[hash->used]; \
+    alloc_style(it->value, val, alloc_func, {return NULL;}); \
+    it->hash = h; \
+    it->meta = CAG_P_ORDERED_LIVE; \
+    hash->index[slot] = ++hash->used; \
+    hash->objects[hash->used].meta = CAG_P_ORDERED_END; \
+    ++hash->size; \
+    return it; \
+} while (0)
+
+#define CAG_DEF_INSERT_ORDERED_HASH(function, container, iterator_type, \
+                                    type, cmp_func, hash_func, length_func, \
+                                    alloc_style, alloc_func, free_func, \
+                                    val_adr) \
+CAG_DEC_INSERT_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int inserted; \
+    CAG_P_INSERT_ORDERED_HASH(container, iterator_type, type, cmp_func, \
+                              alloc_style, alloc_func, free_func, val_adr, \
+                              element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERTP_ORDERED_HASH(function, container, iterator_type, \
+                                     type, cmp_func, hash_func, length_func, \
+                                     alloc_style, alloc_func, free_func, \
+                                     val_adr) \
+CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    int inserted; \
+    CAG_P_INSERT_ORDERED_HASH(container, iterator_type, type, cmp_func, \
+                              alloc_style, alloc_func, free_func, val_adr, \
+                              *element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERT_HASHED_ORDERED_HASH(function, container, \
+                                           iterator_type, type, cmp_func, \
+                                           alloc_style, alloc_func, \
+                                           free_func, val_adr) \
+CAG_DEC_INSERT_HASHED(function, container, iterator_type, type) \
+{ \
+    int inserted; \
+    CAG_P_INSERT_ORDERED_HASH(container, iterator_type, type, cmp_func, \
+                              alloc_style, alloc_func, free_func, val_adr, \
+                              element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERT_OR_GET_ORDERED_HASH(function, container, \
+                                           iterator_type, type, cmp_func, \
+                                           hash_func, length_func, \
+                                           alloc_style, alloc_func, \
+                                           free_func, val_adr) \
+CAG_DEC_INSERT_OR_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_ORDERED_HASH(container, iterator_type, type, cmp_func, \
+                              alloc_style, alloc_func, free_func, val_adr, \
+                              element, h, inserted, 0); \
+}
+
+#define CAG_DEF_INSERT_OR_GET_HASHED_ORDERED_HASH(function, container, \
+                                                  iterator_type, type, \
+                                                  cmp_func, alloc_style, \
+                                                  alloc_func, free_func, \
+                                                  val_adr) \
+CAG_DEC_INSERT_OR_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_ORDERED_HASH(container, iterator_type, type, cmp_func, \
+                              alloc_style, alloc_func, free_func, val_adr, \
+                              element, h, inserted, 0); \
+}
+
+/*! \brief Function declaration and definition for *begin*, *end* and *next*.
+    Iteration walks the element array, skipping holes left by removals, and
+    stops at the end marker.
+*/
+
+#define CAG_P_SKIP_ORDERED_HASH(it) \
+    while ((it)->meta == CAG_P_ORDERED_DEAD) \
+        ++(it)
+
+#define CAG_DEF_BEGIN_ORDERED_HASH(function, container, iterator_type) \
+    CAG_DEC_BEGIN_HASH(function, container, iterator_type) \
+    { \
+        iterator_type it = hash->objects; \
+        CAG_P_SKIP_ORDERED_HASH(it); \
+        return it; \
+    }
+
+#define CAG_DEF_END_ORDERED_HASH(function, container, iterator_type) \
+    CAG_DEC_END_HASH(function, container, iterator_type) \
+    { \
+        return hash->objects + hash->used; \
+    }
+
+#define CAG_DEF_NEXT_ORDERED_HASH(function, iterator_type) \
+    CAG_DEC_NEXT_HASH(function, iterator_type) \
+    { \
+        iterator_type n = it + 1; \
+        CAG_P_SKIP_ORDERED_HASH(n); \
+        return n; \
+    }
+
+/*! \brief Remove the index entry in slot and leave a hole in the element
+    array. Later entries of the probe sequence are shifted back into the freed
+    slot, so the index never needs tombstones.
+*/
+
+#define CAG_P_RELEASE_ORDERED_HASH(hash, it, slot, free_func, val_adr) \
+do { \
+    size_t cag_p_mask = (hash)->buckets - 1, cag_p_j = slot, cag_p_k; \
+    for (;;) { \
+        cag_p_j = (cag_p_j + 1) & cag_p_mask; \
+        if ((hash)->index[cag_p_j] == 0) \
+            break; \
+        cag_p_k = CAG_P_FLAT_INDEX(hash, \
+                (hash)->objects[(hash)->index[cag_p_j] - 1].hash); \
+        if ((cag_p_j > slot && (cag_p_k <= slot || cag_p_k > cag_p_j)) || \
+                (cag_p_j < slot && cag_p_k <= slot && cag_p_k > cag_p_j)) { \
+            (hash)->index[slot] = (hash)->index[cag_p_j]; \
+            slot = cag_p_j; \
+        } \
+    } \
+    (hash)->index[slot] = 0; \
+    free_func(val_adr (it)->value); \
+    (it)->meta = CAG_P_ORDERED_DEAD; \
+    --(hash)->size; \
+} while (0)
+
+#define CAG_DEF_ERASE_ORDERED_HASH(function, container, iterator_type, \
+                                   next_func, free_func, val_adr) \
+CAG_DEC_ERASE_HASH(function, container, iterator_type) \
+{ \
+    size_t slot = CAG_P_FLAT_INDEX(hash, it->hash); \
+    size_t pos = it - hash->objects + 1; \
+    while (hash->index[slot] != pos) \
+        slot = (slot + 1) & (hash->buckets - 1); \
+    CAG_P_RELEASE_ORDERED_HASH(hash, it, slot, free_func, val_adr); \
+    return next_func(it); \
+}
+
+#define CAG_P_REMOVE_ORDERED_HASH(iterator_type, next_func, cmp_func, \
+                                  val_adr, free_func, key, h) \
+do { \
+    iterator_type it; \
+    size_t slot; \
+    CAG_P_PROBE_ORDERED_HASH(hash, h, key, cmp_func, val_adr, it, slot); \
+    if (!it) \
+        return NULL; \
+    CAG_P_RELEASE_ORDERED_HASH(hash, it, slot, free_func, val_adr); \
+    return next_func(it); \
+} while (0)
+
+#define CAG_DEF_REMOVE_ORDERED_HASH(function, container, iterator_type, \
+                                    type, next_func, hash_func, \
+                                    length_func, cmp_func, val_adr, \
+                                    free_func) \
+CAG_DEC_REMOVE_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_REMOVE_ORDERED_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                              free_func, element, h); \
+}
+
+#define CAG_DEF_REMOVEP_ORDERED_HASH(function, container, iterator_type, \
+                                     type, next_func, hash_func, \
+                                     length_func, cmp_func, val_adr, \
+                                     free_func) \
+CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_REMOVE_ORDERED_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                              free_func, *element, h); \
+}
+
+#define CAG_DEF_REMOVE_HASHED_ORDERED_HASH(function, container, \
+                                           iterator_type, type, next_func, \
+                                           cmp_func, val_adr, free_func) \
+CAG_DEC_REMOVE_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_REMOVE_ORDERED_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                              free_func, element, h); \
+}
+
+/*! \brief Function definition to rebuild an ordered hash table. Holes are
+    squeezed out of the element array, keeping the order of the elements, and
+    the index is rebuilt from the stored hash values. If *buckets* is zero the
+    index doubles in size, unless the table is mostly holes, in which case it
+    keeps its size.
+*/
+
+#define CAG_DEF_REHASH_ORDERED_HASH(function, container, iterator_type) \
+CAG_DEC_REHASH(function, container) \
+{ \
+    iterator_type from, to, objects; \
+    size_t *index, b = CAG_P_ORDERED_BUCKETS, shift = CAG_P_SIZE_T_BIT - 3; \
+    if (!hash->rehash) \
+        return hash; \
+    if (buckets == 0) \
+        buckets = hash->size >= hash->capacity / 2 ? \
+                  hash->buckets * 2 : hash->buckets; \
+    while ((b < buckets || CAG_P_ORDERED_CAPACITY(b) <= hash->size) && \
+            b < (size_t) -1 / 2 / sizeof(*objects)) { \
+        b *= 2; \
+        --shift; \
+    } \
+    index = calloc(b, sizeof(*index)); \
+    if (!index) { \
+        hash->rehash = 0; \
+        return hash; \
+    } \
+    for (from = to = hash->objects; from != hash->objects + hash->used; \
+            ++from) \
+        if (from->meta == CAG_P_ORDERED_LIVE) \
+            *to++ = *from; \
+    hash->used = hash->size; \
+    hash->objects[hash->used].meta = CAG_P_ORDERED_END; \
+    objects = realloc(hash->objects, (CAG_P_ORDERED_CAPACITY(b) + 1) * \
+                      sizeof(*objects)); \
+    if (objects) { \
+        hash->objects = objects; \
+    } else if (CAG_P_ORDERED_CAPACITY(b) > hash->capacity) { \
+        CAG_FREE(index); \
+        memset(hash->index, 0, hash->buckets * sizeof(*hash->index)); \
+        CAG_P_INDEX_ORDERED_HASH(hash); \
+        hash->rehash = 0; \
+        return hash; \
+    } \
+    CAG_FREE(hash->index); \
+    hash->index = index; \
+    hash->buckets = b; \
+    hash->shift = shift; \
+    hash->capacity = CAG_P_ORDERED_CAPACITY(b); \
+    CAG_P_INDEX_ORDERED_HASH(hash); \
+    return hash; \
+}
+
+/*! \brief Function definition for *shrink_to_fit* of an ordered hash table.
+    The table is rebuilt at the smallest size whose element array is at most
+    half full, which also squeezes out the holes left by removals.
+*/
+
+#define CAG_DEF_SHRINK_TO_FIT_ORDERED_HASH(function, container) \
+CAG_DEC_SHRINK_TO_FIT_HASH(function, container) \
+{ \
+    size_t b = CAG_P_ORDERED_BUCKETS; \
+    while (CAG_P_ORDERED_CAPACITY(b) / 2 < hash->size && b < hash->buckets) \
+        b *= 2; \
+    if (b < hash->buckets || hash->used > hash->size) \
+        rehash_ ## container(hash, b); \
+    return hash; \
+}
+
+/*! \brief Function definitions for *reserve* and *insert_many* of an ordered
+    hash table. reserve also squeezes out holes if they would fill the element
+    array before it holds n elements.
+*/
+
+#define CAG_P_ORDERED_ROOM(hash, n) \
+    ((n) <= (hash)->size || \
+     (hash)->used + ((n) - (hash)->size) <= (hash)->capacity)
+
+#define CAG_DEF_RESERVE_ORDERED_HASH(function, container) \
+CAG_DEC_RESERVE_HASH(function, container) \
+{ \
+    size_t b = CAG_P_ORDERED_BUCKETS; \
+    while (CAG_P_ORDERED_CAPACITY(b) < n && b * 2 > b) \
+        b *= 2; \
+    if (b > hash->buckets || !CAG_P_ORDERED_ROOM(hash, n)) \
+        rehash_ ## container(hash, b > hash->buckets ? b : hash->buckets); \
+    return CAG_P_ORDERED_ROOM(hash, n) ? hash : NULL; \
+}
+
+#define CAG_P_PREFETCH_ORDERED_HASH(hash, h) \
+    CAG_PREFETCH(&(hash)->index[CAG_P_FLAT_INDEX(hash, h)])
+
+#define CAG_DEF_INSERT_MANY_ORDERED_HASH(function, container, type, \
+                                         hash_func, length_func) \
+CAG_DEC_INSERT_MANY_HASH(function, container, type) \
+{ \
+    CAG_P_INSERT_MANY_HASH(container, hash, elements, n, hash_func, \
+                           length_func, CAG_P_PREFETCH_ORDERED_HASH); \
+}
+
+/*! \brief Function definition for *free* of an ordered hash table. */
+
+#define CAG_DEF_FREE_ORDERED_HASH(function, container, iterator_type, \
+                                  free_func, val_adr) \
+CAG_DEC_FREE_HASH(function, container) \
+{ \
+    iterator_type it; \
+    for (it = hash->objects; it != hash->objects + hash->used; ++it) \
+        if (it->meta == CAG_P_ORDERED_LIVE) { \
+            free_func(val_adr it->value); \
+        } \
+    CAG_FREE(hash->objects); \
+    CAG_FREE(hash->index); \
+}
+
+/*! \brief Declaration of ordered hash table functions and data structures. */
+
+#define CAG_DEC_ORDERED_HASH(container, type) \
+    struct iterator_ ## container { \
+        type value; \
+        size_t hash; \
+        unsigned char meta; \
+    }; \
+    typedef struct iterator_ ## container iterator_ ## container; \
+    typedef iterator_ ## container * it_ ## container; \
+    struct container { \
+        it_ ## container objects; \
+        size_t *index; \
+        size_t buckets; \
+        size_t size; \
+        size_t used; \
+        size_t capacity; \
+        size_t shift; \
+        int rehash; \
+    }; \
+    typedef struct container container; \
+    CAG_DEC_NEW_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
+                                  container); \
+    CAG_DEC_NEW_HASH(new_ ## container, container); \
+    CAG_DEC_GET_HASH(get_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GETP_HASH(getp_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GET_HASHED(get_hashed_ ## container, container, it_ ## container, \
+                       type); \
+    CAG_DEC_GET_MANY_HASH(get_many_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_GETP_MANY_HASH(getp_many_ ## container, container, \
+                           it_ ## container, type); \
+    CAG_DEC_GET_MANY_HASHED(get_many_hashed_ ## container, container, \
+                            it_ ## container, type); \
+    CAG_DEC_INSERT_HASH(insert_ ## container, container, it_ ## container, \
+                        type); \
+    CAG_DEC_INSERTP_HASH(insertp_ ## container, container, it_ ## container, \
+                         type); \
+    CAG_DEC_INSERT_HASHED(insert_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASH(insert_or_get_ ## container, container, \
+                               it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASHED(insert_or_get_hashed_ ## container, \
+                                 container, it_ ## container, type); \
+    CAG_DEC_INSERT_MANY_HASH(insert_many_ ## container, container, type); \
+    CAG_DEC_PUT_HASH(put_ ## container, container, it_ ## container, \
+                     type); \
+    CAG_DEC_PUTP_HASH(putp_ ## container, container, it_ ## container, \
+                      type); \
+    CAG_DEC_BEGIN_HASH(begin_ ## container, container, it_ ## container); \
+    CAG_DEC_END_HASH(end_ ## container, container, it_ ## container); \
+    CAG_DEC_NEXT_HASH(next_ ## container, it_ ## container); \
+    CAG_DEC_AT_HASH(at_ ## container, it_ ## container); \
+    CAG_DEC_CMP(cmp_ ## container, it_ ## container, it_ ## container); \
+    CAG_DEC_DISTANCE(distance_ ## container, it_ ## container); \
+    CAG_DEC_REMOVE_HASH(remove_ ## container, container, it_ ## container, \
+                        type); \
+    CAG_DEC_REMOVEP_HASH(removep_ ## container, container, it_ ## container, \
+                         type); \
+    CAG_DEC_REMOVE_HASHED(remove_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_ERASE_HASH(erase_ ## container, container, it_ ## container); \
+    CAG_DEC_ERASE_RANGE(erase_range_ ## container, \
+                        container, it_ ## container); \
+    CAG_DEC_REHASH(rehash_ ## container, container); \
+    CAG_DEC_SHRINK_TO_FIT_HASH(shrink_to_fit_ ## container, container); \
+    CAG_DEC_RESERVE_HASH(reserve_ ## container, container); \
+    CAG_DEC_FREE_HASH(free_ ## container, container); \
+    CAG_DEC_FORWARD(container, type)
+
+/*! \brief Definitions of ordered hash table functions. */
+
+#define CAG_DEF_ALL_ORDERED_HASH(container, type, cmp_func, val_adr, \
+                                 hash_func, length_func, alloc_style, \
+                                 alloc_func, free_func) \
+CAG_DEF_NEW_ORDERED_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
+                                      container) \
+CAG_DEF_NEW_ORDERED_HASH(new_ ## container, container) \
+CAG_DEF_GET_ORDERED_HASH(get_ ## container, container, it_ ## container, \
+                         type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GETP_ORDERED_HASH(getp_ ## container, container, it_ ## container, \
+                          type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GET_HASHED_ORDERED_HASH(get_hashed_ ## container, container, \
+                                it_ ## container, type, cmp_func, val_adr) \
+CAG_DEF_GET_MANY_ORDERED_HASH(get_many_ ## container, container, \
+                              it_ ## container, type, cmp_func, val_adr, \
+                              hash_func, length_func) \
+CAG_DEF_GETP_MANY_ORDERED_HASH(getp_many_ ## container, container, \
+                               it_ ## container, type, cmp_func, val_adr, \
+                               hash_func, length_func) \
+CAG_DEF_GET_MANY_HASHED_ORDERED_HASH(get_many_hashed_ ## container, \
+                                     container, it_ ## container, type, \
+                                     cmp_func, val_adr, hash_func, \
+                                     length_func) \
+CAG_DEF_INSERT_ORDERED_HASH(insert_ ## container, container, \
+                            it_ ## container, type, cmp_func, hash_func, \
+                            length_func, alloc_style, alloc_func, free_func, \
+                            val_adr) \
+CAG_DEF_INSERTP_ORDERED_HASH(insertp_ ## container, container, \
+                             it_ ## container, type, cmp_func, hash_func, \
+                             length_func, alloc_style, alloc_func, \
+                             free_func, val_adr) \
+CAG_DEF_INSERT_HASHED_ORDERED_HASH(insert_hashed_ ## container, container, \
+                                   it_ ## container, type, cmp_func, \
+                                   alloc_style, alloc_func, free_func, \
+                                   val_adr) \
+CAG_DEF_INSERT_OR_GET_ORDERED_HASH(insert_or_get_ ## container, container, \
+                                   it_ ## container, type, cmp_func, \
+                                   hash_func, length_func, alloc_style, \
+                                   alloc_func, free_func, val_adr) \
+CAG_DEF_INSERT_OR_GET_HASHED_ORDERED_HASH( \
+    insert_or_get_hashed_ ## container, container, it_ ## container, type, \
+    cmp_func, alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEF_PUT_HASH(put_ ## container, container, it_ ## container, \
+                 type) \
+CAG_DEF_PUTP_HASH(putp_ ## container, container, it_ ## container, \
+                  type) \
+CAG_DEF_BEGIN_ORDERED_HASH(begin_ ## container, container, it_ ## container) \
+CAG_DEF_END_ORDERED_HASH(end_ ## container, container, it_ ## container) \
+CAG_DEF_NEXT_ORDERED_HASH(next_ ## container, it_ ## container) \
+CAG_DEF_AT_HASH(at_ ## container, it_ ## container, next_ ## container) \
+CAG_DEF_DISTANCE(distance_ ## container, it_ ## container, next_ ## container) \
+CAG_DEF_CMP(cmp_ ## container, it_ ## container, it_ ## container, \
+            cmp_func, val_adr) \
+CAG_DEF_REMOVE_ORDERED_HASH(remove_ ## container, container, \
+                            it_ ## container, type, next_ ## container, \
+                            hash_func, length_func, cmp_func, val_adr, \
+                            free_func) \
+CAG_DEF_REMOVEP_ORDERED_HASH(removep_ ## container, container, \
+                             it_ ## container, type, next_ ## container, \
+                             hash_func, length_func, cmp_func, val_adr, \
+                             free_func) \
+CAG_DEF_REMOVE_HASHED_ORDERED_HASH(remove_hashed_ ## container, container, \
+                                   it_ ## container, type, \
+                                   next_ ## container, cmp_func, val_adr, \
+                                   free_func) \
+CAG_DEF_ERASE_ORDERED_HASH(erase_ ## container, container, it_ ## container, \
+                           next_ ## container, free_func, val_adr) \
+CAG_DEF_ERASE_RANGE(erase_range_ ## container, container, \
+                    it_ ## container, erase_ ## container, CAG_NO_OP_3) \
+CAG_DEF_REHASH_ORDERED_HASH(rehash_ ## container, container, \
+                            it_ ## container) \
+CAG_DEF_SHRINK_TO_FIT_ORDERED_HASH(shrink_to_fit_ ## container, container) \
+CAG_DEF_RESERVE_ORDERED_HASH(reserve_ ## container, container) \
+CAG_DEF_INSERT_MANY_ORDERED_HASH(insert_many_ ## container, container, type, \
+                                 hash_func, length_func) \
+CAG_DEF_FREE_ORDERED_HASH(free_ ## container, container, it_ ## container, \
+                          free_func, val_adr) \
+CAG_DEF_FORWARD(container, type) \
+typedef container CAG_P_CMB(container,  __LINE__)
+
+#define CAG_DEC_DEF_ALL_ORDERED_HASH(container, type, cmp_func, val_adr, \
+                                     hash_func, length_func, alloc_style, \
+                                     alloc_func, free_func) \
+    CAG_DEC_ORDERED_HASH(container, type); \
+    CAG_DEF_ALL_ORDERED_HASH(container, type, cmp_func, val_adr, hash_func, \
+                             length_func, alloc_style, alloc_func, free_func)
+
+/*! \brief Ordered hash table that does not manage the memory of its elements.
+*/
+
+#define CAG_DEF_ORDERED_HASH(container, type, cmp_func, hash_func, \
+                             length_func) \
+    CAG_DEF_ALL_ORDERED_HASH(container, type, cmp_func, CAG_BYVAL, \
+                             hash_func, length_func, \
+                             CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                             CAG_NO_FREE_FUNC)
+
+/*! \brief Same as CAG_DEF_ORDERED_HASH but cmp_func takes parameters by
+    address.
+*/
+
+#define CAG_DEF_ORDEREDP_HASH(container, type, cmp_func, hash_func, \
+                              length_func) \
+    CAG_DEF_ALL_ORDERED_HASH(container, type, cmp_func, CAG_BYADR, \
+                             hash_func, length_func, \
+                             CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                             CAG_NO_FREE_FUNC)
+
+#define CAG_DEC_DEF_ORDERED_HASH(container, type, cmp_func, hash_func, \
+                                 length_func) \
+    CAG_DEC_ORDERED_HASH(container, type); \
+    CAG_DEF_ORDERED_HASH(container, type, cmp_func, hash_func, length_func)
+
+#define CAG_DEC_DEF_ORDEREDP_HASH(container, type, cmp_func, hash_func, \
+                                  length_func) \
+    CAG_DEC_ORDERED_HASH(container, type); \
+    CAG_DEF_ORDEREDP_HASH(container, type, cmp_func, hash_func, length_func)
+
+/*! \brief Ordered hash tables of C strings and of structs with a string key
+    and string data. Memory is managed as for CAG_DEF_STR_HASH and
+    CAG_DEF_STR_STR_HASH.
+*/
+
+#define CAG_DEC_STR_ORDERED_HASH(container) \
+    CAG_DEC_ORDERED_HASH(container, char *)
+
+#define CAG_DEF_STR_ORDERED_HASH(container) \
+    CAG_DEF_ALL_ORDERED_HASH(container, char *, strcmp, CAG_BYVAL, \
+                             cag_fast_hash, strlen, CAG_SIMPLE_ALLOC_STYLE, \
+                             cag_strdup, free)
+
+#define CAG_DEC_DEF_STR_ORDERED_HASH(container) \
+    CAG_DEC_STR_ORDERED_HASH(container); \
+    CAG_DEF_STR_ORDERED_HASH(container)
+
+#define CAG_DEC_STR_STR_ORDERED_HASH(container, type) \
+    CAG_DEC_ORDERED_HASH(container, type)
+
+#define CAG_DEF_STR_STR_ORDERED_HASH(container, type) \
+    CAG_DEF_ALL_ORDERED_HASH(container, type, \
+                             CAG_STRCMP_STRUCT_WITH_STR_KEY, CAG_BYVAL, \
+                             CAG_FAST_HASH_STRUCT_WITH_STR_KEY, \
+                             CAG_STRLEN_STRUCT_WITH_STR_KEY, \
+                             CAG_STRUCT_ALLOC_STYLE, cag_alloc_str_str, \
+                             CAG_FREE_STRUCT_STR_STR)
+
+#define CAG_DEC_DEF_STR_STR_ORDERED_HASH(container, type) \
+    CAG_DEC_STR_STR_ORDERED_HASH(container, type); \
+    CAG_DEF_STR_STR_ORDERED_HASH(container, type)
+
+
+/*! \brief Bucketized cuckoo hash table.
+
+    Every element may live in one of two buckets of CAG_P_CUCKOO_SLOTS slots,
+    chosen by two functions of its hash value, so a lookup examines at most two
+    buckets whatever the keys or the load. Slots carry the same metadata byte
+    as those of the flat hash table and the comparison function is only called
+    when the metadata matches. When both buckets of a new element are full,
+    insert moves elements to their other bucket, a cuckoo walk of at most
+    CAG_P_CUCKOO_KICKS moves. An element the walk cannot place goes into a
+    stash of CAG_P_CUCKOO_STASH slots, which lookups only examine while it is
+    not empty. The table grows when the stash is full or the table is 7/8
+    full, and rebuilding it empties the stash.
+
+    Lookups have a bounded cost and the table can be filled more than a flat
+    hash table, but inserts are slower and, as for the flat hash table,
+    inserting invalidates iterators. The generated functions are those of
+    CAG_DEC_FLAT_HASH. *buckets* counts slots, excluding the stash.
+*/
+
+#define CAG_P_CUCKOO_SLOTS 4
+#define CAG_P_CUCKOO_STASH 8
+#define CAG_P_CUCKOO_KICKS 128
+#define CAG_P_CUCKOO_REBUILDS 4
+
+/*! \brief Index of the first slot of the two buckets of hash value h. */
+
+#define CAG_P_CUCKOO_FIRST(hash, h) \
+    ((((h) * CAG_P_GOLDEN_RATIO) >> (hash)->shift) * CAG_P_CUCKOO_SLOTS)
+
+#define CAG_P_CUCKOO_SECOND(hash, h) \
+    (cag_mix_hash(h) & ((hash)->buckets - CAG_P_CUCKOO_SLOTS))
+
+#define CAG_P_CUCKOO_END(hash) \
+    ((hash)->objects + (hash)->buckets + CAG_P_CUCKOO_STASH)
+
+/*! \brief Allocate slots and stash for a cuckoo hash table. The number of
+    slots is rounded up to a power of two.
+*/
+
+#define CAG_P_ALLOC_CUCKOO_HASH(hash, n) \
+do { \
+    size_t cag_p_i, cag_p_b = CAG_P_FLAT_BUCKETS; \
+    (hash)->shift = CAG_P_SIZE_T_BIT - 2; \
+    while (cag_p_b < (n) && cag_p_b * 2 > cag_p_b) { \
+        cag_p_b *= 2; \
+        --(hash)->shift; \
+    } \
+    (hash)->objects = CAG_MALLOC((cag_p_b + CAG_P_CUCKOO_STASH + 1) * \
+                                 sizeof(*(hash)->objects)); \
+    if ((hash)->objects) { \
+        for (cag_p_i = 0; cag_p_i < cag_p_b + CAG_P_CUCKOO_STASH; ++cag_p_i) \
+            (hash)->objects[cag_p_i].meta = CAG_P_FLAT_EMPTY; \
+        (hash)->objects[cag_p_b + CAG_P_CUCKOO_STASH].meta = CAG_P_FLAT_END; \
+        (hash)->buckets = cag_p_b; \
+        (hash)->size = 0; \
+        (hash)->stashed = 0; \
+    } \
+} while (0)
+
+#define CAG_DEF_NEW_CUCKOO_HASH_WITH_BUCKETS(function, container) \
+    CAG_DEC_NEW_HASH_WITH_BUCKETS(function, container) \
+    { \
+        hash->rehash = 1; \
+        CAG_P_ALLOC_CUCKOO_HASH(hash, buckets); \
+        return hash->objects ? hash : NULL; \
+    }
+
+/*! \brief Private algorithm to look up a key in a cuckoo hash table. On exit
+    *it* points to the matching slot or is NULL.
+*/
+
+#define CAG_P_PROBE_CUCKOO_HASH(hash, h, key, cmp_func, val_adr, it) \
+do { \
+    size_t cag_p_b, cag_p_i, cag_p_n; \
+    unsigned char cag_p_h2 = CAG_P_FLAT_H2(h); \
+    it = NULL; \
+    for (cag_p_n = 0; cag_p_n < 2 && !it; ++cag_p_n) { \
+        cag_p_b = cag_p_n ? CAG_P_CUCKOO_SECOND(hash, h) : \
+                  CAG_P_CUCKOO_FIRST(hash, h); \
+        for (cag_p_i = cag_p_b; cag_p_i < cag_p_b + CAG_P_CUCKOO_SLOTS; \
+                ++cag_p_i) \
+            if ((hash)->objects[cag_p_i].meta == cag_p_h2 && \
+                    cmp_func(val_adr (key), \
+                             val_adr (hash)->objects[cag_p_i].value) == 0) { \
+                it = &(hash)->objects[cag_p_i]; \
+                break; \
+            } \
+    } \
+    if (!it && (hash)->stashed) \
+        for (cag_p_i = (hash)->buckets; \
+                cag_p_i < (hash)->buckets + CAG_P_CUCKOO_STASH; ++cag_p_i) \
+            if ((hash)->objects[cag_p_i].meta == cag_p_h2 && \
+                    cmp_func(val_adr (key), \
+                             val_adr (hash)->objects[cag_p_i].value) == 0) { \
+                it = &(hash)->objects[cag_p_i]; \
+                break; \
+            } \
+} while (0)
+
+#define CAG_P_GET_CUCKOO_HASH(iterator_type, hash, key, cmp_func, val_adr, h) \
+do { \
+    iterator_type it; \
+    CAG_P_PROBE_CUCKOO_HASH(hash, h, key, cmp_func, val_adr, it); \
+    return it; \
+} while (0)
+
+#define CAG_DEF_GET_CUCKOO_HASH(function, container, iterator_type, \
+                                type, cmp_func, val_adr, hash_func, \
+                                length_func) \
+CAG_DEC_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_GET_CUCKOO_HASH(iterator_type, hash, element, cmp_func, val_adr, h); \
+}
+
+#define CAG_DEF_GETP_CUCKOO_HASH(function, container, iterator_type, \
+                                 type, cmp_func, val_adr, hash_func, \
+                                 length_func) \
+CAG_DEC_GETP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_GET_CUCKOO_HASH(iterator_type, hash, *element, cmp_func, val_adr, \
+                          h); \
+}
+
+#define CAG_DEF_GET_HASHED_CUCKOO_HASH(function, container, iterator_type, \
+                                       type, cmp_func, val_adr) \
+CAG_DEC_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_CUCKOO_HASH(iterator_type, hash, element, cmp_func, val_adr, h); \
+}
+
+/*! \brief Batched lookups for cuckoo hash tables. Both buckets of every key in
+    a batch are prefetched before any of them is examined.
+*/
+
+#define CAG_P_GET_MANY_CUCKOO_HASH(iterator_type, hash, keys, key_adr, \
+                                   hashes, n, results, cmp_func, val_adr, \
+                                   hash_func, length_func) \
+do { \
+    size_t h[CAG_P_GET_MANY_BATCH], i, j, m, found = 0; \
+    iterator_type it; \
+    for (i = 0; i < n; i += m) { \
+        m = n - i < CAG_P_GET_MANY_BATCH ? n - i : CAG_P_GET_MANY_BATCH; \
+        for (j = 0; j < m; ++j) { \
+            h[j] = hashes ? hashes[i + j] \
+                   : (size_t) hash_func(key_adr keys[i + j], \
+                                        length_func(key_adr keys[i + j])); \
+            CAG_PREFETCH(&hash->objects[CAG_P_CUCKOO_FIRST(hash, h[j])]); \
+            CAG_PREFETCH(&hash->objects[CAG_P_CUCKOO_SECOND(hash, h[j])]); \
+        } \
+        for (j = 0; j < m; ++j) { \
+            CAG_P_PROBE_CUCKOO_HASH(hash, h[j], key_adr keys[i + j], \
+                                    cmp_func, val_adr, it); \
+            results[i + j] = it; \
+            found += it != NULL; \
+        } \
+    } \
+    return found; \
+} while (0)
+
+#define CAG_DEF_GET_MANY_CUCKOO_HASH(function, container, iterator_type, \
+                                     type, cmp_func, val_adr, hash_func, \
+                                     length_func) \
+CAG_DEC_GET_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_CUCKOO_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                               CAG_P_NO_HASHES, n, results, cmp_func, \
+                               val_adr, hash_func, length_func); \
+}
+
+#define CAG_DEF_GETP_MANY_CUCKOO_HASH(function, container, iterator_type, \
+                                      type, cmp_func, val_adr, hash_func, \
+                                      length_func) \
+CAG_DEC_GETP_MANY_HASH(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_CUCKOO_HASH(iterator_type, hash, keys, CAG_P_DEREF, \
+                               CAG_P_NO_HASHES, n, results, cmp_func, \
+                               val_adr, hash_func, length_func); \
+}
+
+#define CAG_DEF_GET_MANY_HASHED_CUCKOO_HASH(function, container, \
+                                            iterator_type, type, cmp_func, \
+                                            val_adr, hash_func, length_func) \
+CAG_DEC_GET_MANY_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_GET_MANY_CUCKOO_HASH(iterator_type, hash, keys, CAG_BYVAL, \
+                               hashes, n, results, cmp_func, \
+                               val_adr, hash_func, length_func); \
+}
+
+/*! \brief Private function to put an element that is not in the table into a
+    free slot of one of its buckets, moving other elements to their other
+    bucket if both are full. The element that is left over when the walk gives
+    up goes into the stash, which must have a free slot. The element is moved,
+    not copied. Returns the index of the slot the element ends up in, which the
+    walk keeps track of in case the element is moved again.
+*/
+
+#define CAG_P_DEC_PLACE_CUCKOO_HASH(function, container, type) \
+    size_t function(container *hash, type value, size_t h)
+
+#define CAG_P_DEF_PLACE_CUCKOO_HASH(function, container, type, hash_func, \
+                                    length_func) \
+CAG_P_DEC_PLACE_CUCKOO_HASH(function, container, type) \
+{ \
+    size_t b[2], from, i, k, n, pos = 0; \
+    int mine = 1, was_mine; \
+    type victim; \
+    from = (size_t) -1; \
+    for (k = 0; k < CAG_P_CUCKOO_KICKS; ++k) { \
+        b[0] = CAG_P_CUCKOO_FIRST(hash, h); \
+        b[1] = CAG_P_CUCKOO_SECOND(hash, h); \
+        for (n = 0; n < 2; ++n) \
+            for (i = b[n]; i < b[n] + CAG_P_CUCKOO_SLOTS; ++i) \
+                if (hash->objects[i].meta == CAG_P_FLAT_EMPTY) { \
+                    hash->objects[i].value = value; \
+                    hash->objects[i].meta = CAG_P_FLAT_H2(h); \
+                    ++hash->size; \
+                    return mine ? i : pos; \
+                } \
+        from = b[0] == from ? b[1] : b[0]; \
+        i = from + (k + h) % CAG_P_CUCKOO_SLOTS; \
+        victim = hash->objects[i].value; \
+        hash->objects[i].value = value; \
+        hash->objects[i].meta = CAG_P_FLAT_H2(h); \
+        was_mine = mine; \
+        mine = !mine && i == pos; \
+        if (was_mine) \
+            pos = i; \
+        value = victim; \
+        h = hash_func(value, length_func(value)); \
+    } \
+    for (i = hash->buckets; hash->objects[i].meta != CAG_P_FLAT_EMPTY; ++i) \
+        ; \
+    hash->objects[i].value = value; \
+    hash->objects[i].meta = CAG_P_FLAT_H2(h); \
+    ++hash->stashed; \
+    ++hash->size; \
+    return mine ? i : pos; \
+}
+
+/*! \brief Algorithm to insert into a cuckoo hash table. If the key is already
+    present its element is replaced if replace is non-zero, as for the chained
+    hash table. The table is grown before the element is placed, so the stash
+    always has room for it.
+*/
+
+#define CAG_P_INSERT_CUCKOO_HASH(container, iterator_type, type, cmp_func, \
+                                 alloc_style, alloc_func, free_func, \
+                                 val_adr, val, h, inserted, replace) \
+do { \
+    iterator_type it; \
+    type new_val; \
+    CAG_P_PROBE_CUCKOO_HASH(hash, h, val, cmp_func, val_adr, it); \
+    *(inserted) = (it == NULL); \
+    if (it) { \
+        if (replace) { \
+            alloc_style(new_val, val, alloc_func, {return NULL;}); \
+            free_func(val_adr it->value); \
+            it->value = new_val; \
+        } \
+        return it; \
+    } \
+    if (hash->stashed == CAG_P_CUCKOO_STASH || \
+            CAG_P_FLAT_FULL(hash->size + 1, hash->buckets)) { \
+        rehash_ ## container(hash, 0); \
+        if (hash->stashed == CAG_P_CUCKOO_STASH) \
+            return NULL; \
+    } \
+    alloc_style(new_val, val, alloc_func, {return NULL;}); \
+    return &hash->objects[place_p_ ## container(hash, new_val, h)]; \
+} while (0)
+
+#define CAG_DEF_INSERT_CUCKOO_HASH(function, container, iterator_type, \
+                                   type, cmp_func, hash_func, length_func, \
+                                   alloc_style, alloc_func, free_func, \
+                                   val_adr) \
+CAG_DEC_INSERT_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int inserted; \
+    CAG_P_INSERT_CUCKOO_HASH(container, iterator_type, type, cmp_func, \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERTP_CUCKOO_HASH(function, container, iterator_type, \
+                                    type, cmp_func, hash_func, length_func, \
+                                    alloc_style, alloc_func, free_func, \
+                                    val_adr) \
+CAG_DEC_INSERTP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    int inserted; \
+    CAG_P_INSERT_CUCKOO_HASH(container, iterator_type, type, cmp_func, \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             *element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERT_HASHED_CUCKOO_HASH(function, container, \
+                                          iterator_type, type, cmp_func, \
+                                          alloc_style, alloc_func, \
+                                          free_func, val_adr) \
+CAG_DEC_INSERT_HASHED(function, container, iterator_type, type) \
+{ \
+    int inserted; \
+    CAG_P_INSERT_CUCKOO_HASH(container, iterator_type, type, cmp_func, \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             element, h, &inserted, 1); \
+}
+
+#define CAG_DEF_INSERT_OR_GET_CUCKOO_HASH(function, container, \
+                                          iterator_type, type, cmp_func, \
+                                          hash_func, length_func, \
+                                          alloc_style, alloc_func, \
+                                          free_func, val_adr) \
+CAG_DEC_INSERT_OR_GET_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_CUCKOO_HASH(container, iterator_type, type, cmp_func, \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             element, h, inserted, 0); \
+}
+
+#define CAG_DEF_INSERT_OR_GET_HASHED_CUCKOO_HASH(function, container, \
+                                                 iterator_type, type, \
+                                                 cmp_func, alloc_style, \
+                                                 alloc_func, free_func, \
+                                                 val_adr) \
+CAG_DEC_INSERT_OR_GET_HASHED(function, container, iterator_type, type) \
+{ \
+    int ignore; \
+    if (!inserted) \
+        inserted = &ignore; \
+    CAG_P_INSERT_CUCKOO_HASH(container, iterator_type, type, cmp_func, \
+                             alloc_style, alloc_func, free_func, val_adr, \
+                             element, h, inserted, 0); \
+}
+
+/*! \brief Function definition for *end*. Iteration scans the slots and then
+    the stash, as for the flat hash table.
+*/
+
+#define CAG_DEF_END_CUCKOO_HASH(function, container, iterator_type) \
+    CAG_DEC_END_HASH(function, container, iterator_type) \
+    { \
+        return CAG_P_CUCKOO_END(hash); \
+    }
+
+/*! \brief Mark a slot as free. Cuckoo hash tables need no tombstones. */
+
+#define CAG_P_RELEASE_CUCKOO_HASH(hash, it) \
+do { \
+    (it)->meta = CAG_P_FLAT_EMPTY; \
+    if ((it) >= (hash)->objects + (hash)->buckets) \
+        --(hash)->stashed; \
+    --(hash)->size; \
+} while (0)
+
+#define CAG_DEF_ERASE_CUCKOO_HASH(function, container, iterator_type, \
+                                  next_func, free_func, val_adr) \
+CAG_DEC_ERASE_HASH(function, container, iterator_type) \
+{ \
+    free_func(val_adr it->value); \
+    CAG_P_RELEASE_CUCKOO_HASH(hash, it); \
+    return next_func(it); \
+}
+
+#define CAG_P_REMOVE_CUCKOO_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                                 free_func, key, h) \
+do { \
+    iterator_type it; \
+    CAG_P_PROBE_CUCKOO_HASH(hash, h, key, cmp_func, val_adr, it); \
+    if (!it) \
+        return NULL; \
+    free_func(val_adr it->value); \
+    CAG_P_RELEASE_CUCKOO_HASH(hash, it); \
+    return next_func(it); \
+} while (0)
+
+#define CAG_DEF_REMOVE_CUCKOO_HASH(function, container, iterator_type, \
+                                   type, next_func, hash_func, \
+                                   length_func, cmp_func, val_adr, \
+                                   free_func) \
+CAG_DEC_REMOVE_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(element, length_func(element)); \
+    CAG_P_REMOVE_CUCKOO_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                             free_func, element, h); \
+}
+
+#define CAG_DEF_REMOVEP_CUCKOO_HASH(function, container, iterator_type, \
+                                    type, next_func, hash_func, \
+                                    length_func, cmp_func, val_adr, \
+                                    free_func) \
+CAG_DEC_REMOVEP_HASH(function, container, iterator_type, type) \
+{ \
+    const size_t h = (size_t) hash_func(*element, length_func(*element)); \
+    CAG_P_REMOVE_CUCKOO_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                             free_func, *element, h); \
+}
+
+#define CAG_DEF_REMOVE_HASHED_CUCKOO_HASH(function, container, \
+                                          iterator_type, type, next_func, \
+                                          cmp_func, val_adr, free_func) \
+CAG_DEC_REMOVE_HASHED(function, container, iterator_type, type) \
+{ \
+    CAG_P_REMOVE_CUCKOO_HASH(iterator_type, next_func, cmp_func, val_adr, \
+                             free_func, element, h); \
+}
+
+/*! \brief Function definition to rebuild a cuckoo hash table. Elements are
+    moved into the new slots without being copied by *alloc_func*. If
+    *buckets* is zero the table doubles in size. If the stash of the new table
+    fills up, the build starts again at twice the size. After
+    CAG_P_CUCKOO_REBUILDS attempts the table is left as it was, as so many
+    collisions mean the hash function cannot tell the keys apart.
+*/
+
+#define CAG_DEF_REHASH_CUCKOO_HASH(function, container, iterator_type, \
+                                   hash_func, length_func) \
+CAG_DEC_REHASH(function, container) \
+{ \
+    container tmp; \
+    iterator_type it; \
+    int tries; \
+    if (!hash->rehash) \
+        return hash; \
+    if (buckets == 0) \
+        buckets = hash->buckets * 2; \
+    if (buckets < hash->size + hash->size / 7 + 1) \
+        buckets = hash->size + hash->size / 7 + 1; \
+    for (tries = 1; ; ++tries) { \
+        CAG_P_ALLOC_CUCKOO_HASH(&tmp, buckets); \
+        if (!tmp.objects) { \
+            hash->rehash = 0; \
+            return hash; \
+        } \
+        for (it = hash->objects; it != CAG_P_CUCKOO_END(hash); ++it) { \
+            if (!CAG_P_FLAT_OCCUPIED(*it)) \
+                continue; \
+            place_p_ ## container(&tmp, it->value, \
+                                  hash_func(it->value, \
+                                            length_func(it->value))); \
+            if (tmp.stashed == CAG_P_CUCKOO_STASH) \
+                break; \
+        } \
+        if (it == CAG_P_CUCKOO_END(hash)) \
+            break; \
+        CAG_FREE(tmp.objects); \
+        if (tries == CAG_P_CUCKOO_REBUILDS || tmp.buckets * 2 < tmp.buckets) \
+            return hash; \
+        buckets = tmp.buckets * 2; \
+    } \
+    CAG_FREE(hash->objects); \
+    hash->objects = tmp.objects; \
+    hash->buckets = tmp.buckets; \
+    hash->shift = tmp.shift; \
+    hash->stashed = tmp.stashed; \
+    return hash; \
+}
+
+/*! \brief Function definition for *shrink_to_fit* of a cuckoo hash table. The
+    table is rebuilt at the smallest size that leaves it at most half full,
+    which also empties the stash.
+*/
+
+#define CAG_DEF_SHRINK_TO_FIT_CUCKOO_HASH(function, container) \
+CAG_DEC_SHRINK_TO_FIT_HASH(function, container) \
+{ \
+    size_t b = CAG_P_FLAT_BUCKETS; \
+    while (b / 2 < hash->size && b < hash->buckets) \
+        b *= 2; \
+    if (b < hash->buckets || hash->stashed) \
+        rehash_ ## container(hash, b); \
+    return hash; \
+}
+
+/*! \brief Function definitions for *reserve* and *insert_many* of a cuckoo
+    hash table. A reserved table can still grow during insert_many if its
+    stash fills up.
+*/
+
+#define CAG_DEF_RESERVE_CUCKOO_HASH(function, container) \
+CAG_DEC_RESERVE_HASH(function, container) \
+{ \
+    size_t b = CAG_P_FLAT_BUCKETS; \
+    while (CAG_P_FLAT_FULL(n, b) && b * 2 > b) \
+        b *= 2; \
+    if (b > hash->buckets) \
+        rehash_ ## container(hash, b); \
+    return CAG_P_FLAT_FULL(n, hash->buckets) ? NULL : hash; \
+}
+
+#define CAG_P_PREFETCH_CUCKOO_HASH(hash, h) \
+do { \
+    CAG_PREFETCH(&(hash)->objects[CAG_P_CUCKOO_FIRST(hash, h)]); \
+    CAG_PREFETCH(&(hash)->objects[CAG_P_CUCKOO_SECOND(hash, h)]); \
+} while (0)
+
+#define CAG_DEF_INSERT_MANY_CUCKOO_HASH(function, container, type, \
+                                        hash_func, length_func) \
+CAG_DEC_INSERT_MANY_HASH(function, container, type) \
+{ \
+    CAG_P_INSERT_MANY_HASH(container, hash, elements, n, hash_func, \
+                           length_func, CAG_P_PREFETCH_CUCKOO_HASH); \
+}
+
+/*! \brief Function definition for *free* of a cuckoo hash table. */
+
+#define CAG_DEF_FREE_CUCKOO_HASH(function, container, iterator_type, \
+                                 free_func, val_adr) \
+CAG_DEC_FREE_HASH(function, container) \
+{ \
+    iterator_type it; \
+    for (it = hash->objects; it != CAG_P_CUCKOO_END(hash); ++it) \
+        if (CAG_P_FLAT_OCCUPIED(*it)) { \
+            free_func(val_adr it->value); \
+        } \
+    CAG_FREE(hash->objects); \
+}
+
+/*! \brief Declaration of cuckoo hash table functions and data structures. */
+
+#define CAG_DEC_CUCKOO_HASH(container, type) \
+    struct iterator_ ## container { \
+        type value; \
+        unsigned char meta; \
+    }; \
+    typedef struct iterator_ ## container iterator_ ## container; \
+    typedef iterator_ ## container * it_ ## container; \
+    struct container { \
+        it_ ## container objects; \
+        size_t buckets; \
+        size_t size; \
+        size_t stashed; \
+        size_t shift; \
+        int rehash; \
+    }; \
+    typedef struct container container; \
+    CAG_DEC_NEW_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
+                                  container); \
+    CAG_DEC_NEW_HASH(new_ ## container, container); \
+    CAG_DEC_GET_HASH(get_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GETP_HASH(getp_ ## container, container, it_ ## container, type); \
+    CAG_DEC_GET_HASHED(get_hashed_ ## container, container, it_ ## container, \
+                       type); \
+    CAG_DEC_GET_MANY_HASH(get_many_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_GETP_MANY_HASH(getp_many_ ## container, container, \
+                           it_ ## container, type); \
+    CAG_DEC_GET_MANY_HASHED(get_many_hashed_ ## container, container, \
+                            it_ ## container, type); \
+    CAG_P_DEC_PLACE_CUCKOO_HASH(place_p_ ## container, container, type); \
+    CAG_DEC_INSERT_HASH(insert_ ## container, container, it_ ## container, \
+                        type); \
+    CAG_DEC_INSERTP_HASH(insertp_ ## container, container, it_ ## container, \
+                         type); \
+    CAG_DEC_INSERT_HASHED(insert_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASH(insert_or_get_ ## container, container, \
+                               it_ ## container, type); \
+    CAG_DEC_INSERT_OR_GET_HASHED(insert_or_get_hashed_ ## container, \
+                                 container, it_ ## container, type); \
+    CAG_DEC_INSERT_MANY_HASH(insert_many_ ## container, container, type); \
+    CAG_DEC_PUT_HASH(put_ ## container, container, it_ ## container, \
+                     type); \
+    CAG_DEC_PUTP_HASH(putp_ ## container, container, it_ ## container, \
+                      type); \
+    CAG_DEC_BEGIN_HASH(begin_ ## container, container, it_ ## container); \
+    CAG_DEC_END_HASH(end_ ## container, container, it_ ## container); \
+    CAG_DEC_NEXT_HASH(next_ ## container, it_ ## container); \
+    CAG_DEC_AT_HASH(at_ ## container, it_ ## container); \
+    CAG_DEC_CMP(cmp_ ## container, it_ ## container, it_ ## container); \
+    CAG_DEC_DISTANCE(distance_ ## container, it_ ## container); \
+    CAG_DEC_REMOVE_HASH(remove_ ## container, container, it_ ## container, \
+                        type); \
+    CAG_DEC_REMOVEP_HASH(removep_ ## container, container, it_ ## container, \
+                         type); \
+    CAG_DEC_REMOVE_HASHED(remove_hashed_ ## container, container, \
+                          it_ ## container, type); \
+    CAG_DEC_ERASE_HASH(erase_ ## container, container, it_ ## container); \
+    CAG_DEC_ERASE_RANGE(erase_range_ ## container, \
+                        container, it_ ## container); \
+    CAG_DEC_REHASH(rehash_ ## container, container); \
+    CAG_DEC_SHRINK_TO_FIT_HASH(shrink_to_fit_ ## container, container); \
+    CAG_DEC_RESERVE_HASH(reserve_ ## container, container); \
+    CAG_DEC_FREE_HASH(free_ ## container, container); \
+    CAG_DEC_FORWARD(container, type)
+
+/*! \brief Definitions of cuckoo hash table functions. */
+
+#define CAG_DEF_ALL_CUCKOO_HASH(container, type, cmp_func, val_adr, \
+                                hash_func, length_func, alloc_style, \
+                                alloc_func, free_func) \
+CAG_DEF_NEW_CUCKOO_HASH_WITH_BUCKETS(new_with_buckets_ ## container, \
+                                     container) \
+CAG_DEF_NEW_FLAT_HASH(new_ ## container, container) \
+CAG_DEF_GET_CUCKOO_HASH(get_ ## container, container, it_ ## container, \
+                        type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GETP_CUCKOO_HASH(getp_ ## container, container, it_ ## container, \
+                         type, cmp_func, val_adr, hash_func, length_func) \
+CAG_DEF_GET_HASHED_CUCKOO_HASH(get_hashed_ ## container, container, \
+                               it_ ## container, type, cmp_func, val_adr) \
+CAG_DEF_GET_MANY_CUCKOO_HASH(get_many_ ## container, container, \
+                             it_ ## container, type, cmp_func, val_adr, \
+                             hash_func, length_func) \
+CAG_DEF_GETP_MANY_CUCKOO_HASH(getp_many_ ## container, container, \
+                              it_ ## container, type, cmp_func, val_adr, \
+                              hash_func, length_func) \
+CAG_DEF_GET_MANY_HASHED_CUCKOO_HASH(get_many_hashed_ ## container, \
+                                    container, it_ ## container, type, \
+                                    cmp_func, val_adr, hash_func, \
+                                    length_func) \
+CAG_P_DEF_PLACE_CUCKOO_HASH(place_p_ ## container, container, type, \
+                            hash_func, length_func) \
+CAG_DEF_INSERT_CUCKOO_HASH(insert_ ## container, container, \
+                           it_ ## container, type, cmp_func, hash_func, \
+                           length_func, alloc_style, alloc_func, free_func, \
+                           val_adr) \
+CAG_DEF_INSERTP_CUCKOO_HASH(insertp_ ## container, container, \
+                            it_ ## container, type, cmp_func, hash_func, \
+                            length_func, alloc_style, alloc_func, \
+                            free_func, val_adr) \
+CAG_DEF_INSERT_HASHED_CUCKOO_HASH(insert_hashed_ ## container, container, \
+                                  it_ ## container, type, cmp_func, \
+                                  alloc_style, alloc_func, free_func, \
+                                  val_adr) \
+CAG_DEF_INSERT_OR_GET_CUCKOO_HASH(insert_or_get_ ## container, container, \
+                                  it_ ## container, type, cmp_func, \
+                                  hash_func, length_func, alloc_style, \
+                                  alloc_func, free_func, val_adr) \
+CAG_DEF_INSERT_OR_GET_HASHED_CUCKOO_HASH( \
+    insert_or_get_hashed_ ## container, container, it_ ## container, type, \
+    cmp_func, alloc_style, alloc_func, free_func, val_adr) \
+CAG_DEF_PUT_HASH(put_ ## container, container, it_ ## container, \
+                 type) \
+CAG_DEF_PUTP_HASH(putp_ ## container, container, it_ ## container, \
+                  type) \
+CAG_DEF_BEGIN_FLAT_HASH(begin_ ## container, container, it_ ## container) \
+CAG_DEF_END_CUCKOO_HASH(end_ ## container, container, it_ ## container) \
+CAG_DEF_NEXT_FLAT_HASH(next_ ## container, it_ ## container) \
+CAG_DEF_AT_HASH(at_ ## container, it_ ## container, next_ ## container) \
+CAG_DEF_DISTANCE(distance_ ## container, it_ ## container, next_ ## container) \
+CAG_DEF_CMP(cmp_ ## container, it_ ## container, it_ ## container, \
+            cmp_func, val_adr) \
+CAG_DEF_REMOVE_CUCKOO_HASH(remove_ ## container, container, \
+                           it_ ## container, type, next_ ## container, \
+                           hash_func, length_func, cmp_func, val_adr, \
+                           free_func) \
+CAG_DEF_REMOVEP_CUCKOO_HASH(removep_ ## container, container, \
+                            it_ ## container, type, next_ ## container, \
+                            hash_func, length_func, cmp_func, val_adr, \
+                            free_func) \
+CAG_DEF_REMOVE_HASHED_CUCKOO_HASH(remove_hashed_ ## container, container, \
+                                  it_ ## container, type, \
+                                  next_ ## container, cmp_func, val_adr, \
+                                  free_func) \
+CAG_DEF_ERASE_CUCKOO_HASH(erase_ ## container, container, it_ ## container, \
+                          next_ ## container, free_func, val_adr) \
+CAG_DEF_ERASE_RANGE(erase_range_ ## container, container, \
+                    it_ ## container, erase_ ## container, CAG_NO_OP_3) \
+CAG_DEF_REHASH_CUCKOO_HASH(rehash_ ## container, container, \
+                           it_ ## container, hash_func, length_func) \
+CAG_DEF_SHRINK_TO_FIT_CUCKOO_HASH(shrink_to_fit_ ## container, container) \
+CAG_DEF_RESERVE_CUCKOO_HASH(reserve_ ## container, container) \
+CAG_DEF_INSERT_MANY_CUCKOO_HASH(insert_many_ ## container, container, type, \
+                                hash_func, length_func) \
+CAG_DEF_FREE_CUCKOO_HASH(free_ ## container, container, it_ ## container, \
+                         free_func, val_adr) \
+CAG_DEF_FORWARD(container, type) \
+typedef container CAG_P_CMB(container,  __LINE__)
+
+#define CAG_DEC_DEF_ALL_CUCKOO_HASH(container, type, cmp_func, val_adr, \
+                                    hash_func, length_func, alloc_style, \
+                                    alloc_func, free_func) \
+    CAG_DEC_CUCKOO_HASH(container, type); \
+    CAG_DEF_ALL_CUCKOO_HASH(container, type, cmp_func, val_adr, hash_func, \
+                            length_func, alloc_style, alloc_func, free_func)
+
+/*! \brief Cuckoo hash table that does not manage the memory of its elements.
+*/
+
+#define CAG_DEF_CUCKOO_HASH(container, type, cmp_func, hash_func, \
+                            length_func) \
+    CAG_DEF_ALL_CUCKOO_HASH(container, type, cmp_func, CAG_BYVAL, \
+                            hash_func, length_func, \
+                            CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                            CAG_NO_FREE_FUNC)
+
+/*! \brief Same as CAG_DEF_CUCKOO_HASH but cmp_func takes parameters by
+    address.
+*/
+
+#define CAG_DEF_CUCKOOP_HASH(container, type, cmp_func, hash_func, \
+                             length_func) \
+    CAG_DEF_ALL_CUCKOO_HASH(container, type, cmp_func, CAG_BYADR, \
+                            hash_func, length_func, \
+                            CAG_NO_ALLOC_STYLE, CAG_ALLOC_DEFAULT, \
+                            CAG_NO_FREE_FUNC)
+
+#define CAG_DEC_DEF_CUCKOO_HASH(container, type, cmp_func, hash_func, \
+                                length_func) \
+    CAG_DEC_CUCKOO_HASH(container, type); \
+    CAG_DEF_CUCKOO_HASH(container, type, cmp_func, hash_func, length_func)
+
+#define CAG_DEC_DEF_CUCKOOP_HASH(container, type, cmp_func, hash_func, \
+                                 length_func) \
+    CAG_DEC_CUCKOO_HASH(container, type); \
+    CAG_DEF_CUCKOOP_HASH(container, type, cmp_func, hash_func, length_func)
+
+/*! \brief Cuckoo hash tables of C strings and of structs with a string key
+    and string data. Memory is managed as for CAG_DEF_STR_HASH and
+    CAG_DEF_STR_STR_HASH.
+*/
+
+#define CAG_DEC_STR_CUCKOO_HASH(container) \
+    CAG_DEC_CUCKOO_HASH(container, char *)
+
+#define CAG_DEF_STR_CUCKOO_HASH(container) \
+    CAG_DEF_ALL_CUCKOO_HASH(container, char *, strcmp, CAG_BYVAL, \
+                            cag_fast_hash, strlen, CAG_SIMPLE_ALLOC_STYLE, \
+                            cag_strdup, free)
+
+#define CAG_DEC_DEF_STR_CUCKOO_HASH(container) \
+    CAG_DEC_STR_CUCKOO_HASH(container); \
+    CAG_DEF_STR_CUCKOO_HASH(container)
+
+#define CAG_DEC_STR_STR_CUCKOO_HASH(container, type) \
+    CAG_DEC_CUCKOO_HASH(container, type)
+
+#define CAG_DEF_STR_STR_CUCKOO_HASH(container, type) \
+    CAG_DEF_ALL_CUCKOO_HASH(container, type, \
+                            CAG_STRCMP_STRUCT_WITH_STR_KEY, CAG_BYVAL, \
+                            CAG_FAST_HASH_STRUCT_WITH_STR_KEY, \
+                            CAG_STRLEN_STRUCT_WITH_STR_KEY, \
+                            CAG_STRUCT_ALLOC_STYLE, cag_alloc_str_str, \
+                            CAG_FREE_STRUCT_STR_STR)
+
+#define CAG_DEC_DEF_STR_STR_CUCKOO_HASH(container, type) \
+    CAG_DEC_STR_STR_CUCKOO_HASH(container, type); \
+    CAG_DEF_STR_STR_CUCKOO_HASH(container, type)
+
 
 #endif /* CAG_HASH_H */
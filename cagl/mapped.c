@@ -0,0 +1,267 @@
+/*! Read-only string dictionaries that are mapped from disk.
+
+  \copyright Copyright 2014 Nathan Geffen.
+
+  \license GNU Lesser General Public License Copyright.
+
+  See COPYING for the license text.
+*/
+
+#if !defined(_POSIX_C_SOURCE) && !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__unix) || \
+	(defined(__APPLE__) && defined(__MACH__))
+#define CAG_P_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cagl/common.h"
+#include "cagl/mapped.h"
+
+/* File layout. All fields are size_t in the byte order of the machine that
+   wrote the file. order holds CAG_P_MAPPED_ORDER, which reads differently on
+   machines with another size_t width or byte order. Each slot takes
+   CAG_P_MAPPED_SLOT words: key offset, key length, value offset and value
+   length. Offsets are from the start of the file.
+*/
+
+#define CAG_P_MAPPED_MAGIC "CAGLMAP1"
+#define CAG_P_MAPPED_ORDER ((size_t) 0x01020304UL)
+#define CAG_P_MAPPED_SLOT 4
+
+struct cag_p_mapped_header {
+	char magic[8];
+	size_t order;
+	size_t length;
+	size_t size;
+	size_t groups;
+	size_t seed;
+	size_t checksum;
+};
+
+static size_t cag_p_mapped_checksum(const unsigned char *base,
+				    const size_t length)
+{
+	return cag_seeded_hash(base + sizeof(struct cag_p_mapped_header),
+			       length - sizeof(struct cag_p_mapped_header), 0);
+}
+
+int cag_save_mapped(const char *path, const size_t n,
+		    const char *const *keys, const size_t *key_lengths,
+		    const char *const *values, const size_t *value_lengths)
+{
+	struct cag_p_mapped_header header;
+	size_t *hashes = NULL, *pos = NULL, *disp, *slots;
+	size_t i, j, offset, tables;
+	unsigned char *image = NULL;
+	FILE *file = NULL;
+
+	memcpy(header.magic, CAG_P_MAPPED_MAGIC, sizeof(header.magic));
+	header.order = CAG_P_MAPPED_ORDER;
+	header.size = n;
+	header.groups = CAG_P_FROZEN_GROUPS(n);
+	header.seed = cag_hash_seed;
+	tables = sizeof(header) + (header.groups + CAG_P_MAPPED_SLOT * n) *
+		sizeof(size_t);
+	header.length = tables;
+	for (i = 0; i < n; ++i)
+		header.length += key_lengths[i] + value_lengths[i] + 2;
+
+	if (!(image = calloc(header.length, 1)))
+		goto error;
+	if (!(hashes = malloc((n ? n : 1) * sizeof(*hashes))))
+		goto error;
+	if (!(pos = malloc((n ? n : 1) * sizeof(*pos))))
+		goto error;
+	for (i = 0; i < n; ++i)
+		hashes[i] = cag_seeded_hash(keys[i], key_lengths[i],
+					    header.seed);
+	disp = (size_t *) (image + sizeof(header));
+	slots = disp + header.groups;
+	/* An empty table keeps the zeroed displacements from calloc. */
+	if (n && !cag_perfect_hash(hashes, n, disp, header.groups, pos))
+		goto error;
+	for (i = 0, offset = tables; i < n; ++i) {
+		j = CAG_P_MAPPED_SLOT * pos[i];
+		slots[j] = offset;
+		slots[j + 1] = key_lengths[i];
+		memcpy(image + offset, keys[i], key_lengths[i]);
+		offset += key_lengths[i] + 1;
+		slots[j + 2] = offset;
+		slots[j + 3] = value_lengths[i];
+		memcpy(image + offset, values[i], value_lengths[i]);
+		offset += value_lengths[i] + 1;
+	}
+	header.checksum = cag_p_mapped_checksum(image, header.length);
+	memcpy(image, &header, sizeof(header));
+
+	if (!(file = fopen(path, "wb")) ||
+	    fwrite(image, 1, header.length, file) != header.length)
+		goto error;
+	if (fclose(file) != 0) {
+		file = NULL;
+		goto error;
+	}
+	free(image);
+	free(hashes);
+	free(pos);
+	return CAG_SUCCESS;
+error:
+	if (file)
+		fclose(file);
+	free(image);
+	free(hashes);
+	free(pos);
+	return CAG_ERROR;
+}
+
+cag_mapped *cag_open_mapped(cag_mapped *mapped, const char *path)
+{
+	struct cag_p_mapped_header header;
+	unsigned char *base = NULL;
+	size_t length = 0;
+#ifdef CAG_P_MMAP
+	struct stat st;
+	void *p;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		goto error;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(header)) {
+		close(fd);
+		goto error;
+	}
+	length = (size_t) st.st_size;
+	p = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		goto error;
+	base = p;
+	mapped->mapped = 1;
+#else
+	FILE *file;
+	long end;
+
+	if (!(file = fopen(path, "rb")))
+		goto error;
+	if (fseek(file, 0, SEEK_END) != 0 || (end = ftell(file)) < 0 ||
+	    (size_t) end < sizeof(header) || fseek(file, 0, SEEK_SET) != 0 ||
+	    (base = malloc((size_t) end)) == NULL ||
+	    fread(base, 1, (size_t) end, file) != (size_t) end) {
+		fclose(file);
+		free(base);
+		base = NULL;
+		goto error;
+	}
+	fclose(file);
+	length = (size_t) end;
+	mapped->mapped = 0;
+#endif
+	mapped->base = base;
+	mapped->length = length;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, CAG_P_MAPPED_MAGIC, sizeof(header.magic)) ||
+	    header.order != CAG_P_MAPPED_ORDER || header.length != length ||
+	    header.groups != CAG_P_FROZEN_GROUPS(header.size) ||
+	    header.size > length / sizeof(size_t) ||
+	    sizeof(header) + (header.groups + CAG_P_MAPPED_SLOT * header.size) *
+	    sizeof(size_t) > length)
+		goto error;
+	mapped->size = header.size;
+	mapped->groups = header.groups;
+	mapped->seed = header.seed;
+	mapped->disp = (const size_t *) (base + sizeof(header));
+	mapped->slots = mapped->disp + header.groups;
+	return mapped;
+error:
+	if (base) {
+		mapped->base = base;
+		mapped->length = length;
+		cag_close_mapped(mapped);
+	}
+	return NULL;
+}
+
+/* Checks the checksum and that every key and value lies inside the file.
+   Opening a file only checks its header, so call this before looking up keys
+   in files that may be damaged.
+*/
+
+int cag_verify_mapped(const cag_mapped *mapped)
+{
+	const struct cag_p_mapped_header *header =
+		(const struct cag_p_mapped_header *) mapped->base;
+	const size_t *slot;
+	size_t i, j;
+
+	if (cag_p_mapped_checksum(mapped->base, mapped->length) !=
+	    header->checksum)
+		return 0;
+	for (i = 0; i < mapped->groups; ++i)
+		if (mapped->disp[i] & CAG_P_FROZEN_DIRECT &&
+		    (mapped->disp[i] & CAG_P_FROZEN_MASK) >= mapped->size)
+			return 0;
+	for (i = 0; i < mapped->size; ++i)
+		for (j = 0; j < CAG_P_MAPPED_SLOT; j += 2) {
+			slot = mapped->slots + CAG_P_MAPPED_SLOT * i + j;
+			if (slot[0] >= mapped->length ||
+			    slot[1] >= mapped->length - slot[0] ||
+			    mapped->base[slot[0] + slot[1]] != '\0')
+				return 0;
+		}
+	return 1;
+}
+
+/* Returns the stored copy of key, or NULL if the file does not hold it. If
+   value is not NULL, *value is set to the value stored with the key.
+*/
+
+const char *cag_get_mapped(const cag_mapped *mapped, const char *key,
+			   const size_t length, const char **value)
+{
+	const size_t *slot;
+	size_t h, i;
+	int run;
+
+	if (mapped->size == 0)
+		return NULL;
+	h = cag_seeded_hash(key, length, mapped->seed);
+	CAG_P_FROZEN_INDEX(i, run, mapped->disp, mapped->groups, h,
+			   mapped->size);
+	slot = mapped->slots + CAG_P_MAPPED_SLOT * i;
+	/* Groups with equal hash values lie in a block of adjacent slots. */
+	while (slot[1] != length ||
+	       memcmp(mapped->base + slot[0], key, length)) {
+		if (!run || ++i == mapped->size)
+			return NULL;
+		slot += CAG_P_MAPPED_SLOT;
+		if (CAG_P_FROZEN_GROUP(cag_seeded_hash(mapped->base + slot[0],
+						       slot[1], mapped->seed),
+				       mapped->groups) !=
+		    CAG_P_FROZEN_GROUP(h, mapped->groups))
+			return NULL;
+	}
+	if (value)
+		*value = (const char *) mapped->base + slot[2];
+	return (const char *) mapped->base + slot[0];
+}
+
+void cag_close_mapped(cag_mapped *mapped)
+{
+#ifdef CAG_P_MMAP
+	munmap((void *) mapped->base, mapped->length);
+#else
+	free((void *) mapped->base);
+#endif
+	mapped->base = NULL;
+	mapped->size = 0;
+}
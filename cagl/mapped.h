@@ -0,0 +1,58 @@
+/*! \file Read-only string dictionaries that are mapped from disk.
+
+    \copyright Copyright 2014 Nathan Geffen. All rights reserved.
+
+    \license This code is licensed under the GNU LESSER GENERAL PUBLIC LICENSE.
+
+    \sa COPYING for the license text.
+
+    \sa howtodev.rst to learn how this code works and how to modify it.
+
+    cag_save_mapped writes a set of string keys, each with a string value, to a
+    file that cag_open_mapped maps into memory with mmap, where available, and
+    otherwise reads in one go. Lookups are answered straight from the mapped
+    file, so opening a file takes constant time however many entries it holds,
+    and processes that open the same file share one copy of it in the page
+    cache.
+
+    The file contains no pointers. It is made up of a header, the displacement
+    table of a minimal perfect hash function over the keys (see
+    cag_perfect_hash in common.h), a table with the offset and length of the
+    key and value of each entry, and the packed key and value bytes. Every key
+    and value is followed by a '\0' so that lookups can return C strings that
+    point into the file. The keys are hashed with cag_seeded_hash and the seed
+    stored in the header, so files do not depend on cag_hash_seed of the
+    process that opens them. The header also holds a checksum of the rest of
+    the file, which cag_verify_mapped checks. Files are only portable between
+    machines with the same size_t width and byte order, which cag_open_mapped
+    checks.
+*/
+
+#ifndef CAG_MAPPED_H
+#define CAG_MAPPED_H
+
+#include <stddef.h>
+
+struct cag_mapped {
+	const unsigned char *base; /* The file contents */
+	size_t length;             /* Length of the file in bytes */
+	size_t size;               /* Number of entries. Treat as read-only. */
+	size_t groups;
+	size_t seed;
+	const size_t *disp;
+	const size_t *slots;
+	int mapped;
+};
+
+typedef struct cag_mapped cag_mapped;
+
+int cag_save_mapped(const char *path, const size_t n,
+		    const char *const *keys, const size_t *key_lengths,
+		    const char *const *values, const size_t *value_lengths);
+cag_mapped *cag_open_mapped(cag_mapped *mapped, const char *path);
+int cag_verify_mapped(const cag_mapped *mapped);
+const char *cag_get_mapped(const cag_mapped *mapped, const char *key,
+			   const size_t length, const char **value);
+void cag_close_mapped(cag_mapped *mapped);
+
+#endif /* CAG_MAPPED_H */
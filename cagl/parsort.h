@@ -0,0 +1,226 @@
+/*! \file CAGL parallel sorting of arrays.
+
+    \copyright Copyright 2014 Nathan Geffen. All rights reserved.
+
+    \license This code is licensed under the GNU LESSER GENERAL PUBLIC LICENSE.
+
+    \sa COPYING for the license text.
+
+    \sa howtodev.rst to learn how this code works and how to modify it.
+*/
+
+
+#ifndef CAG_PARSORT_H
+#define CAG_PARSORT_H
+
+#include <pthread.h>
+#include "cagl/array.h"
+
+/*! \brief Parallel sorts for arrays.
+
+   The range is split into one chunk per thread and each thread sorts its
+   chunk with the array's sequential sort_C or stable_sort_C. The sorted
+   chunks are then merged pairwise, in rounds, between the array and a
+   buffer of the same size. Every merge in a round is cut into pieces of
+   about equal size by binary searching for the position in each input that
+   starts a piece of the output (co-ranking), so that all threads take part in
+   every round, including the last. Ties go to the left chunk, so
+   par_stable_sort_C gives exactly the result of stable_sort_C, and par_sort_C
+   gives the same order of keys as sort_C.
+
+   Ranges shorter than CAG_PAR_SORT_MIN elements, or sorts asked to use fewer
+   than two threads, fall back to the sequential sort, as do sorts for which
+   the buffer cannot be allocated. If a thread cannot be started its work is
+   done by the calling thread.
+
+   Programs that use this header must be compiled and linked with POSIX
+   threads, e.g. with the -pthread option of gcc.
+*/
+
+#ifndef CAG_PAR_SORT_MIN
+
+#define CAG_PAR_SORT_MIN 65536
+
+#endif
+
+/*! \brief Private co-ranking for a stable merge of a (na elements) and b (nb
+   elements). Sets result to the number of elements of a among the first k
+   elements of the merged output.
+*/
+
+#define CAG_P_CO_RANK(a, na, b, nb, k, cmp, val_adr, result) \
+do { \
+    size_t cag_lo = (k) > (nb) ? (k) - (nb) : 0; \
+    size_t cag_hi = (k) < (na) ? (k) : (na); \
+    size_t cag_mid; \
+    while (cag_lo < cag_hi) { \
+        cag_mid = cag_lo + (cag_hi - cag_lo) / 2; \
+        if (cmp(val_adr (b)[(k) - cag_mid - 1].value, \
+                val_adr (a)[cag_mid].value) < 0) \
+            cag_hi = cag_mid; \
+        else \
+            cag_lo = cag_mid + 1; \
+    } \
+    result = cag_lo; \
+} while (0)
+
+/*! \brief Private running of count tasks, one per thread. The calling thread
+   runs the first task itself, and any task whose thread cannot be started.
+*/
+
+#define CAG_P_PAR_RUN(tasks, count, threads, task_func) \
+do { \
+    size_t cag_t; \
+    for (cag_t = 1; cag_t < (count); ++cag_t) \
+        if ((tasks)[cag_t].started = \
+                pthread_create(&(threads)[cag_t], NULL, task_func, \
+                               &(tasks)[cag_t]) == 0, \
+                !(tasks)[cag_t].started) \
+            task_func(&(tasks)[cag_t]); \
+    task_func(&(tasks)[0]); \
+    for (cag_t = 1; cag_t < (count); ++cag_t) \
+        if ((tasks)[cag_t].started) \
+            pthread_join((threads)[cag_t], NULL); \
+} while (0)
+
+/*! \brief Function declaration and definition of a parallel sort, where sort
+   is the sequential sort to use for each chunk.
+*/
+
+#define CAG_DEC_PAR_SORT_ARRAY(function, iterator_type) \
+    iterator_type function(iterator_type from, iterator_type to, \
+                           size_t nthreads)
+
+#define CAG_DEF_PAR_SORT_ARRAY(function, iterator_type, sort, cmp, val_adr) \
+struct CAG_P_CMB(function, _task) { \
+    iterator_type a; \
+    iterator_type b; \
+    iterator_type out; \
+    size_t na; \
+    size_t nb; \
+    int ok; \
+    int started; \
+}; \
+static void *CAG_P_CMB(function, _sort)(void *arg) \
+{ \
+    struct CAG_P_CMB(function, _task) *t = arg; \
+    t->ok = sort(t->a, t->a + t->na) != NULL; \
+    return NULL; \
+} \
+static void *CAG_P_CMB(function, _merge)(void *arg) \
+{ \
+    struct CAG_P_CMB(function, _task) *t = arg; \
+    iterator_type a = t->a; \
+    iterator_type b = t->b; \
+    iterator_type out = t->out; \
+    iterator_type a_end = a + t->na; \
+    iterator_type b_end = b + t->nb; \
+    while (a != a_end && b != b_end) { \
+        if (cmp(val_adr b->value, val_adr a->value) < 0) \
+            (out++)->value = (b++)->value; \
+        else \
+            (out++)->value = (a++)->value; \
+    } \
+    memcpy(out, a, (a_end - a) * sizeof(*a)); \
+    memcpy(out + (a_end - a), b, (b_end - b) * sizeof(*b)); \
+    return NULL; \
+} \
+CAG_DEC_PAR_SORT_ARRAY(function, iterator_type) \
+{ \
+    size_t n = to - from, runs, parts, r, q, k0, k1, i0, i1, count, *bounds; \
+    struct CAG_P_CMB(function, _task) *tasks, *t; \
+    pthread_t *threads; \
+    iterator_type buf; \
+    iterator_type src; \
+    iterator_type dst; \
+    iterator_type a; \
+    iterator_type b; \
+    int ok = 1; \
+    if (nthreads < 2 || n < CAG_PAR_SORT_MIN) \
+        return sort(from, to); \
+    tasks = CAG_MALLOC((nthreads + 1) * sizeof(*tasks)); \
+    threads = CAG_MALLOC((nthreads + 1) * sizeof(*threads)); \
+    bounds = CAG_MALLOC((nthreads + 1) * sizeof(*bounds)); \
+    buf = CAG_MALLOC(n * sizeof(*from)); \
+    if (!tasks || !threads || !bounds || !buf) { \
+        CAG_FREE(tasks); \
+        CAG_FREE(threads); \
+        CAG_FREE(bounds); \
+        CAG_FREE(buf); \
+        return sort(from, to); \
+    } \
+    for (r = 0; r <= nthreads; ++r) \
+        bounds[r] = n / nthreads * r + n % nthreads * r / nthreads; \
+    for (r = 0; r < nthreads; ++r) { \
+        tasks[r].a = from + bounds[r]; \
+        tasks[r].na = bounds[r + 1] - bounds[r]; \
+    } \
+    CAG_P_PAR_RUN(tasks, nthreads, threads, CAG_P_CMB(function, _sort)); \
+    for (r = 0; r < nthreads; ++r) \
+        ok = ok && tasks[r].ok; \
+    src = from; \
+    dst = buf; \
+    for (runs = nthreads; ok && runs > 1; runs = (runs + 1) / 2) { \
+        parts = nthreads / (runs / 2); \
+        for (r = 0, count = 0; r + 1 < runs; r += 2) { \
+            a = src + bounds[r]; \
+            b = src + bounds[r + 1]; \
+            n = bounds[r + 2] - bounds[r]; \
+            for (q = 0, k0 = 0, i0 = 0; q < parts; ++q, k0 = k1, i0 = i1) { \
+                k1 = n / parts * (q + 1) + n % parts * (q + 1) / parts; \
+                CAG_P_CO_RANK(a, bounds[r + 1] - bounds[r], b, \
+                              bounds[r + 2] - bounds[r + 1], k1, cmp, \
+                              val_adr, i1); \
+                t = &tasks[count++]; \
+                t->a = a + i0; \
+                t->na = i1 - i0; \
+                t->b = b + (k0 - i0); \
+                t->nb = (k1 - i1) - (k0 - i0); \
+                t->out = dst + bounds[r] + k0; \
+            } \
+        } \
+        if (r < runs) { \
+            t = &tasks[count++]; \
+            t->a = src + bounds[r]; \
+            t->na = bounds[r + 1] - bounds[r]; \
+            t->nb = 0; \
+            t->out = dst + bounds[r]; \
+        } \
+        CAG_P_PAR_RUN(tasks, count, threads, CAG_P_CMB(function, _merge)); \
+        for (r = 0; r < runs; r += 2) \
+            bounds[r / 2] = bounds[r]; \
+        bounds[(runs + 1) / 2] = bounds[runs]; \
+        a = src; \
+        src = dst; \
+        dst = a; \
+    } \
+    if (src != from) \
+        memcpy(from, src, (to - from) * sizeof(*from)); \
+    CAG_FREE(tasks); \
+    CAG_FREE(threads); \
+    CAG_FREE(bounds); \
+    CAG_FREE(buf); \
+    return ok ? from : NULL; \
+}
+
+/*! \brief Declaration and definition of par_sort_C and par_stable_sort_C for
+   an array container declared and defined with a CMP macro. cmp_func and
+   val_adr must be those the container was defined with.
+*/
+
+#define CAG_DEC_PAR_ARRAY(container) \
+    CAG_DEC_PAR_SORT_ARRAY(par_sort_ ## container, it_ ## container); \
+    CAG_DEC_PAR_SORT_ARRAY(par_stable_sort_ ## container, it_ ## container)
+
+#define CAG_DEF_PAR_ARRAY(container, cmp_func, val_adr) \
+CAG_DEF_PAR_SORT_ARRAY(par_sort_ ## container, it_ ## container, \
+                       sort_ ## container, cmp_func, val_adr) \
+CAG_DEF_PAR_SORT_ARRAY(par_stable_sort_ ## container, it_ ## container, \
+                       stable_sort_ ## container, cmp_func, val_adr) \
+typedef container CAG_P_CMB(container ## _par,  __LINE__)
+
+#define CAG_DEC_DEF_PAR_ARRAY(container, cmp_func, val_adr) \
+    CAG_DEC_PAR_ARRAY(container); \
+    CAG_DEF_PAR_ARRAY(container, cmp_func, val_adr)
+
+#endif /* CAG_PARSORT_H */
@@ -21,6 +21,45 @@
 
 #define CAG_AT_DEFAULT(a, i) a[i]
 
+/* Keys and key mappings for radix sorting the primitive arrays. Radix sort
+   is not available for long double, whose representation can have padding
+   and an explicit integer bit.
+*/
+
+#if CHAR_MIN < 0
+#define CAG_P_RADIX_KEY_CHAR CAG_RADIX_KEY_SIGNED
+#define CAG_P_RADIX_VALUE_CHAR CAG_RADIX_VALUE_SIGNED
+#else
+#define CAG_P_RADIX_KEY_CHAR CAG_RADIX_KEY_UNSIGNED
+#define CAG_P_RADIX_VALUE_CHAR CAG_RADIX_VALUE_UNSIGNED
+#endif
+
+#if UINT_MAX == 0xFFFFFFFFUL
+#define CAG_P_RADIX_FLOAT_KEY unsigned
+#elif ULONG_MAX == 0xFFFFFFFFUL
+#define CAG_P_RADIX_FLOAT_KEY unsigned long
+#endif
+
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define CAG_P_RADIX_DOUBLE_KEY unsigned long
+#elif __STDC_VERSION__ >= 199901L
+#define CAG_P_RADIX_DOUBLE_KEY unsigned long long
+#endif
+
+/* Sorting networks for short ranges of int, float and double. Each sorts the
+   n elements from a in place and returns 1, or returns 0 without changing
+   anything if n is more than CAG_NETWORK_SORT_MAX, if a float or double range
+   contains a NaN, or if prim.c was compiled without SSE2 or AVX2. The sort_C
+   functions of cag_int_array, cag_float_array and cag_double_array use them
+   for their small ranges.
+*/
+
+#define CAG_NETWORK_SORT_MAX 64
+
+int cag_network_sort_int(int *a, size_t n);
+int cag_network_sort_float(float *a, size_t n);
+int cag_network_sort_double(double *a, size_t n);
+
 CAG_DEC_CMP_DLIST(cag_char_dlist, char);
 CAG_DEC_CMP_DLIST(cag_uchar_dlist, unsigned char);
 CAG_DEC_CMP_DLIST(cag_schar_dlist, signed char);
@@ -55,5 +94,27 @@ CAG_DEC_CMP_ARRAY(cag_longlong_array, long long);
 CAG_DEC_CMP_ARRAY(cag_ulonglong_array, unsigned long long);
 #endif
 
+CAG_DEC_RADIX_ARRAY(cag_char_array);
+CAG_DEC_RADIX_ARRAY(cag_uchar_array);
+CAG_DEC_RADIX_ARRAY(cag_schar_array);
+CAG_DEC_RADIX_ARRAY(cag_int_array);
+CAG_DEC_RADIX_ARRAY(cag_uint_array);
+CAG_DEC_RADIX_ARRAY(cag_long_array);
+CAG_DEC_RADIX_ARRAY(cag_ulong_array);
+
+#ifdef CAG_P_RADIX_FLOAT_KEY
+CAG_DEC_RADIX_ARRAY(cag_float_array);
+#endif
+
+#ifdef CAG_P_RADIX_DOUBLE_KEY
+CAG_DEC_RADIX_ARRAY(cag_double_array);
+#endif
+
+#if __STDC_VERSION__ >= 199901L
+CAG_DEC_RADIX_ARRAY(cag_bool_array);
+CAG_DEC_RADIX_ARRAY(cag_longlong_array);
+CAG_DEC_RADIX_ARRAY(cag_ulonglong_array);
+#endif
+
 
 #endif /* CAG_PRIMITIVE_H */
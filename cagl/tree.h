@@ -186,7 +186,8 @@
  */
 
 #define CAG_INSERT_TREE(container, iterator_type, type, \
-                        cmp_func, val_adr, alloc_style, alloc_func, item) \
+                        cmp_func, val_adr, alloc_style, alloc_func, \
+                        node_extra, item) \
 { \
     iterator_type p;  /* Traverses tree looking for insertion point. */ \
     iterator_type q; /* Parent of p; node at which we are rebalancing. */ \
@@ -194,6 +195,7 @@
     int dir; /* Side of q on which n is inserted. */ \
     int leftmost = 0, rightmost = 0; \
     int result; \
+    char *cag_node_end; \
     assert (tree != NULL); \
     for (q = NULL, p = tree->root; CAG_IS_IT_TREE(p); \
             q = p, p = p->child[dir]) { \
@@ -202,9 +204,11 @@
             return p; \
         dir = result > 0; \
     } \
-    n = CAG_MALLOC(sizeof(*p)); \
+    n = CAG_MALLOC(sizeof(*p) + node_extra(item)); \
     if (!n) \
         return NULL; \
+    cag_node_end = (char *) n + sizeof(*n); \
+    (void) cag_node_end; \
     alloc_style(n->value, (item), alloc_func, \
                 { \
                         CAG_FREE(n); \
@@ -328,11 +332,13 @@
 
 
 #define CAG_DEF_INSERT_TREE(function, container, iterator_type, type, \
-                            cmp_func, val_adr, alloc_style, alloc_func) \
+                            cmp_func, val_adr, alloc_style, alloc_func, \
+                            node_extra) \
 CAG_DEC_INSERT_TREE(function, container, iterator_type, type) \
 { \
     CAG_INSERT_TREE(container, iterator_type, type, \
-                    cmp_func, val_adr, alloc_style, alloc_func, element); \
+                    cmp_func, val_adr, alloc_style, alloc_func, node_extra, \
+                    element); \
 }
 
 
@@ -341,11 +347,13 @@ CAG_DEC_INSERT_TREE(function, container, iterator_type, type) \
 
 
 #define CAG_DEF_INSERTP_TREE(function, container, iterator_type, type, \
-                             cmp_func, val_adr, alloc_style, alloc_func) \
+                             cmp_func, val_adr, alloc_style, alloc_func, \
+                             node_extra) \
 CAG_DEC_INSERTP_TREE(function, container, iterator_type, type) \
 { \
     CAG_INSERT_TREE(container, iterator_type, type, \
-                    cmp_func, val_adr, alloc_style, alloc_func, *element); \
+                    cmp_func, val_adr, alloc_style, alloc_func, node_extra, \
+                    *element); \
 }
 
 /*! \brief Function declaration and definition for *put* and *putp*. Every
@@ -922,10 +930,13 @@ CAG_DEC_CHECK_INTEGRITY_TREE(function, container, iterator_type) \
     CAG_DEC_CMP_BIDIRECTIONAL(container, type)
 
 
-/*! \brief Definitions of tree functions. */
+/*! \brief Private definition of the tree functions, shared by trees that
+   store elements in their nodes and those that store them inline. node_extra
+   gives the number of bytes to allocate after a new node.
+*/
 
-#define CAG_DEF_ALL_CMP_TREE(container, type, cmp_func, val_adr, \
-                             alloc_style, alloc_func, free_func) \
+#define CAG_P_DEF_ALL_TREE(container, type, cmp_func, val_adr, \
+                           alloc_style, alloc_func, free_func, node_extra) \
 CAG_DEF_NEW_TREE(new_ ## container, container) \
 CAG_DEF_BEGIN_TREE(begin_ ## container, container, it_ ## container, 0) \
 CAG_DEF_BEGIN_TREE(rbegin_ ## container, container, rit_ ## container, 1) \
@@ -946,9 +957,11 @@ CAG_DEF_DISTANCE_TREE(distance_ ## container, it_ ## container, \
 CAG_DEF_DISTANCE_TREE(rdistance_ ## container, rit_ ## container, \
                       rnext_ ## container) \
 CAG_DEF_INSERT_TREE(insert_ ## container, container, it_ ## container, \
-                    type, cmp_func, val_adr, alloc_style, alloc_func) \
+                    type, cmp_func, val_adr, alloc_style, alloc_func, \
+                    node_extra) \
 CAG_DEF_INSERTP_TREE(insertp_ ## container, container, it_ ## container, \
-                     type, cmp_func, val_adr, alloc_style, alloc_func) \
+                     type, cmp_func, val_adr, alloc_style, alloc_func, \
+                     node_extra) \
 CAG_DEF_PUT_TREE(put_ ## container, container, \
                  it_ ## container, type) \
 CAG_DEF_PUTP_TREE(putp_ ## container, container, \
@@ -980,6 +993,13 @@ CAG_DEF_BIDIRECTIONAL(container, type) \
 CAG_DEF_CMP_BIDIRECTIONAL(container, type, cmp_func, val_adr) \
 typedef container CAG_P_CMB(container,  __LINE__)
 
+/*! \brief Definitions of tree functions. */
+
+#define CAG_DEF_ALL_CMP_TREE(container, type, cmp_func, val_adr, \
+                             alloc_style, alloc_func, free_func) \
+    CAG_P_DEF_ALL_TREE(container, type, cmp_func, val_adr, \
+                       alloc_style, alloc_func, free_func, CAG_NO_NODE_EXTRA)
+
 
 #define CAG_DEC_DEF_ALL_CMP_TREE(container, type, cmp_func, val_adr, \
                                  alloc_style, alloc_func, free_func) \
@@ -1059,5 +1079,27 @@ CAG_DEF_ALL_CMP_TREE(container, type, cmp_func, val_adr, \
     CAG_DEF_STR_TREE(container)
 
 
+/*! \brief Declare and define macros for a tree of C strings stored inline.
+   Each string is copied into the end of its node, so an element takes one
+   allocation instead of two, and comparisons during a search read the string
+   next to the node's links instead of following another pointer. The functions
+   are those of CAG_DEC_STR_TREE. The elements point into their nodes, so they
+   must not be changed, moved to other nodes, e.g. with swap_C, or kept after
+   their node is erased.
+*/
+
+#define CAG_DEC_INLINE_STR_TREE(container) \
+    CAG_DEC_STR_TREE(container)
+
+#define CAG_DEF_INLINE_STR_TREE(container) \
+    CAG_P_DEF_ALL_TREE(container, char *, strcmp, CAG_BYVAL, \
+                       CAG_INLINE_STR_ALLOC_STYLE, CAG_NO_ALLOC_FUNC, \
+                       CAG_NO_FREE_FUNC, CAG_INLINE_STR_EXTRA)
+
+#define CAG_DEC_DEF_INLINE_STR_TREE(container) \
+    CAG_DEC_INLINE_STR_TREE(container); \
+    CAG_DEF_INLINE_STR_TREE(container)
+
+
 
 #endif /* CAG_TREE_H */
@@ -15,6 +15,7 @@
 #include "cagl/error.h"
 #include "cagl/test.h"
 #include "cagl/array.h"
+#include "cagl/prim.h"
 
 struct complex {
 	double real;
@@ -970,6 +971,305 @@ static void test_stable_sort(struct cag_test_series *tests)
 	free_complex_array(&ca);
 }
 
+/* Fill with one of several patterns of n keys, the imaginary part recording
+   the original position so that stability can be checked. */
+
+static double run_pattern(int pattern, int i, int n)
+{
+	switch (pattern) {
+	case 0:
+		return rand() % 50;
+	case 1:
+		return i / 3;
+	case 2:
+		return (n - i) / 3;
+	case 3:
+		return i % 100;
+	case 4:
+		return rand() % 10 == 0 ? rand() % n : i;
+	default:
+		return 7;
+	}
+}
+
+static int in_stable_order(struct complex prev, struct complex cur)
+{
+	return cmp_complex(prev, cur) < 0 ||
+	       (cmp_complex(prev, cur) == 0 && prev.imag < cur.imag);
+}
+
+static void test_stable_sort_runs(struct cag_test_series *tests)
+{
+	complex_array ca;
+	it_complex_array cit;
+	struct complex c;
+	int i, pattern, n = 5000, ordered = CAG_TRUE, rordered = CAG_TRUE;
+
+	new_complex_array(&ca);
+	for (pattern = 0; pattern < 6; ++pattern) {
+		for (i = 0; i < n; ++i) {
+			c.real = run_pattern(pattern, i, n);
+			c.imag = i;
+			appendp_complex_array(&ca, &c);
+		}
+		if (!stable_sort_complex_array(beg_complex_array(&ca),
+					       end_complex_array(&ca)))
+			ordered = CAG_FALSE;
+		for (cit = beg_complex_array(&ca) + 1;
+		     cit != end_complex_array(&ca); ++cit)
+			if (!in_stable_order((cit - 1)->value, cit->value))
+				ordered = CAG_FALSE;
+		for (cit = beg_complex_array(&ca); cit != end_complex_array(&ca);
+		     ++cit)
+			cit->value.imag = n - (cit - beg_complex_array(&ca));
+		if (!rstable_sort_complex_array(rbeg_complex_array(&ca),
+						rend_complex_array(&ca)))
+			rordered = CAG_FALSE;
+		for (cit = beg_complex_array(&ca) + 1;
+		     cit != end_complex_array(&ca); ++cit)
+			if (!in_stable_order(cit->value, (cit - 1)->value))
+				rordered = CAG_FALSE;
+		free_complex_array(&ca);
+		new_complex_array(&ca);
+	}
+	CAG_TEST(*tests, ordered,
+		 "cag_array: stable sort of runs, reversed runs and duplicates");
+	CAG_TEST(*tests, rordered,
+		 "cag_array: reverse stable sort of sorted array");
+	free_complex_array(&ca);
+}
+
+static void test_sort_patterns(struct cag_test_series *tests)
+{
+	complex_array ca;
+	it_complex_array cit;
+	struct complex c;
+	int i, pattern, n = 20000, ordered = CAG_TRUE, rordered = CAG_TRUE;
+	double sum;
+
+	for (pattern = 0; pattern < 6; ++pattern) {
+		new_complex_array(&ca);
+		for (i = 0; i < n; ++i) {
+			c.real = run_pattern(pattern, i, n);
+			c.imag = i;
+			appendp_complex_array(&ca, &c);
+		}
+		sort_all_complex_array(&ca);
+		sum = 0;
+		for (cit = beg_complex_array(&ca); cit != end_complex_array(&ca);
+		     ++cit) {
+			sum += cit->value.imag;
+			if (cit != beg_complex_array(&ca) &&
+			    cit->value.real < (cit - 1)->value.real)
+				ordered = CAG_FALSE;
+		}
+		if (sum != (double) n * (n - 1) / 2)
+			ordered = CAG_FALSE;
+		rsort_all_complex_array(&ca);
+		for (cit = beg_complex_array(&ca) + 1;
+		     cit != end_complex_array(&ca); ++cit)
+			if (cit->value.real > (cit - 1)->value.real)
+				rordered = CAG_FALSE;
+		free_complex_array(&ca);
+	}
+	CAG_TEST(*tests, ordered,
+		 "cag_array: sort of runs, reversed runs and duplicates");
+	CAG_TEST(*tests, rordered,
+		 "cag_array: reverse sort of sorted array");
+}
+
+static void test_select(struct cag_test_series *tests)
+{
+	cag_int_array ia;
+	cag_int_array ra;
+	it_cag_int_array it;
+	int i, out[20], selected = CAG_TRUE, sorted = CAG_TRUE;
+
+	new_cag_int_array(&ia);
+	for (i = 0; i < 5000; ++i)
+		append_cag_int_array(&ia, (i * 1237) % 5000);
+	it = at_cag_int_array(beg_cag_int_array(&ia), 1234);
+	CAG_TEST(*tests, nth_element_cag_int_array(beg_cag_int_array(&ia), it,
+						   end_cag_int_array(&ia)) == it &&
+		 it->value == 1234,
+		 "cag_array: nth_element puts nth element in place");
+	for (i = 0; i < 5000; ++i)
+		if ((i < 1234 && at_cag_int_array(beg_cag_int_array(&ia),
+						  i)->value > 1234) ||
+		    (i > 1234 && at_cag_int_array(beg_cag_int_array(&ia),
+						  i)->value < 1234))
+			selected = CAG_FALSE;
+	CAG_TEST(*tests, selected,
+		 "cag_array: nth_element partitions around nth element");
+	partial_sort_cag_int_array(beg_cag_int_array(&ia),
+				   at_cag_int_array(beg_cag_int_array(&ia),
+						    100),
+				   end_cag_int_array(&ia));
+	for (i = 0; i < 100; ++i)
+		if (at_cag_int_array(beg_cag_int_array(&ia), i)->value != i)
+			sorted = CAG_FALSE;
+	CAG_TEST(*tests, sorted, "cag_array: partial_sort");
+	new_with_size_cag_int_array(&ra, 20);
+	for (i = 0; i < 5000; ++i)
+		at_cag_int_array(beg_cag_int_array(&ia), i)->value = 4999 - i;
+	it = partial_sort_copy_cag_int_array(beg_cag_int_array(&ia),
+					     end_cag_int_array(&ia),
+					     beg_cag_int_array(&ra),
+					     end_cag_int_array(&ra));
+	for (sorted = CAG_TRUE, i = 0; i < 20; ++i)
+		if (at_cag_int_array(beg_cag_int_array(&ra), i)->value != i)
+			sorted = CAG_FALSE;
+	CAG_TEST(*tests, sorted && it == end_cag_int_array(&ra),
+		 "cag_array: partial_sort_copy");
+	CAG_TEST(*tests, top_k_cag_int_array(beg_cag_int_array(&ia),
+					     end_cag_int_array(&ia), out,
+					     20) == 20 &&
+		 out[0] == 0 && out[19] == 19 &&
+		 top_k_cag_int_array(beg_cag_int_array(&ia),
+				     at_cag_int_array(beg_cag_int_array(&ia),
+						      5), out, 20) == 5 &&
+		 out[0] == 4995 && out[4] == 4999,
+		 "cag_array: top_k");
+	free_cag_int_array(&ra);
+	free_cag_int_array(&ia);
+}
+
+static int cmp_int_ref(const void *a, const void *b)
+{
+	return (*(const int *) a > *(const int *) b) -
+	       (*(const int *) a < *(const int *) b);
+}
+
+static int cmp_double_ref(const void *a, const void *b)
+{
+	return (*(const double *) a > *(const double *) b) -
+	       (*(const double *) a < *(const double *) b);
+}
+
+static void test_network_sort(struct cag_test_series *tests)
+{
+	cag_int_array ia;
+	cag_float_array fa;
+	cag_double_array da;
+	it_cag_float_array fit;
+	it_cag_double_array dit;
+	int ref[200], same = CAG_TRUE, fsorted = CAG_TRUE, zeros = 0;
+	double dref[200], nan[5] = {3.0, 1.0, 0.0, 2.0, 0.0};
+	size_t n, i;
+
+	for (n = 0; n < 200; ++n) {
+		new_cag_int_array(&ia);
+		new_cag_double_array(&da);
+		for (i = 0; i < n; ++i) {
+			ref[i] = i % 7 == 3 ? INT_MAX : i % 5 == 1 ? INT_MIN :
+				 rand() % (int) (n / 2 + 1);
+			dref[i] = i % 4 ? -0.0 : (double) (rand() % 50) - 25.0;
+			append_cag_int_array(&ia, ref[i]);
+			append_cag_double_array(&da, dref[i]);
+		}
+		qsort(ref, n, sizeof(*ref), cmp_int_ref);
+		qsort(dref, n, sizeof(*dref), cmp_double_ref);
+		sort_all_cag_int_array(&ia);
+		sort_all_cag_double_array(&da);
+		for (i = 0; i < n; ++i)
+			if (at_cag_int_array(beg_cag_int_array(&ia), i)->value !=
+			    ref[i] ||
+			    at_cag_double_array(beg_cag_double_array(&da),
+						i)->value != dref[i])
+				same = CAG_FALSE;
+		for (dit = beg_cag_double_array(&da);
+		     dit != end_cag_double_array(&da); ++dit)
+			zeros += dit->value == 0.0 && 1.0 / dit->value < 0.0;
+		zeros -= (int) (n - (n + 3) / 4);
+		free_cag_int_array(&ia);
+		free_cag_double_array(&da);
+	}
+	CAG_TEST(*tests, same, "cag_array: sort of small int and double ranges");
+	CAG_TEST(*tests, zeros == 0,
+		 "cag_array: sort keeps the sign of negative zeros");
+	new_cag_float_array(&fa);
+	for (i = 0; i < 1000; ++i)
+		append_cag_float_array(&fa, (float) (rand() % 100) / 8.0f);
+	sort_all_cag_float_array(&fa);
+	for (fit = beg_cag_float_array(&fa);
+	     next_cag_float_array(fit) != end_cag_float_array(&fa); ++fit)
+		if (fit->value > next_cag_float_array(fit)->value)
+			fsorted = CAG_FALSE;
+	CAG_TEST(*tests, fsorted, "cag_array: sort of float array");
+	free_cag_float_array(&fa);
+	nan[2] = nan[2] / nan[4];
+	CAG_TEST(*tests, !cag_network_sort_double(nan, 5) && nan[0] == 3.0 &&
+		 !cag_network_sort_int(ref, CAG_NETWORK_SORT_MAX + 1),
+		 "cag_array: network sort declines NaNs and long ranges");
+}
+
+static void test_radix_sort(struct cag_test_series *tests)
+{
+	cag_int_array ia;
+	cag_double_array da;
+	cag_uchar_array ua;
+	it_cag_int_array iit;
+	it_cag_double_array dit;
+	it_cag_uchar_array uit;
+	int i, ordered = CAG_TRUE;
+
+	new_cag_int_array(&ia);
+	for (i = 0; i < 10000; ++i)
+		append_cag_int_array(&ia, rand() - RAND_MAX / 2);
+	append_cag_int_array(&ia, INT_MIN);
+	append_cag_int_array(&ia, INT_MAX);
+	CAG_TEST(*tests, radix_sort_all_cag_int_array(&ia) ==
+		 beg_cag_int_array(&ia) &&
+		 beg_cag_int_array(&ia)->value == INT_MIN &&
+		 (end_cag_int_array(&ia) - 1)->value == INT_MAX,
+		 "cag_array: radix sort of ints");
+	for (iit = beg_cag_int_array(&ia) + 1; iit != end_cag_int_array(&ia);
+	     ++iit)
+		if (iit->value < (iit - 1)->value)
+			ordered = CAG_FALSE;
+	CAG_TEST(*tests, ordered && size_cag_int_array(&ia) == 10002,
+		 "cag_array: radix sort of ints in order");
+	free_cag_int_array(&ia);
+
+	new_cag_int_array(&ia);
+	for (i = 0; i < 1000; ++i)
+		append_cag_int_array(&ia, 1000 - i);
+	radix_sort_all_cag_int_array(&ia);
+	for (ordered = CAG_TRUE, i = 0; i < 1000; ++i)
+		if (at_cag_int_array(beg_cag_int_array(&ia), i)->value != i + 1)
+			ordered = CAG_FALSE;
+	CAG_TEST(*tests, ordered,
+		 "cag_array: radix sort skipping digits that are all equal");
+	free_cag_int_array(&ia);
+
+	new_cag_double_array(&da);
+	for (i = 0; i < 5000; ++i)
+		append_cag_double_array(&da, (rand() - RAND_MAX / 2) / 7.0);
+	append_cag_double_array(&da, -0.5);
+	append_cag_double_array(&da, 0.0);
+	append_cag_double_array(&da, -1e300);
+	radix_sort_cag_double_array(beg_cag_double_array(&da),
+				    end_cag_double_array(&da));
+	for (ordered = CAG_TRUE, dit = beg_cag_double_array(&da) + 1;
+	     dit != end_cag_double_array(&da); ++dit)
+		if (dit->value < (dit - 1)->value)
+			ordered = CAG_FALSE;
+	CAG_TEST(*tests, ordered && beg_cag_double_array(&da)->value == -1e300,
+		 "cag_array: radix sort of doubles");
+	free_cag_double_array(&da);
+
+	new_cag_uchar_array(&ua);
+	for (i = 0; i < 3000; ++i)
+		append_cag_uchar_array(&ua, (unsigned char) rand());
+	radix_sort_all_cag_uchar_array(&ua);
+	for (ordered = CAG_TRUE, uit = beg_cag_uchar_array(&ua) + 1;
+	     uit != end_cag_uchar_array(&ua); ++uit)
+		if (uit->value < (uit - 1)->value)
+			ordered = CAG_FALSE;
+	CAG_TEST(*tests, ordered, "cag_array: radix sort of unsigned chars");
+	free_cag_uchar_array(&ua);
+}
+
 static void test_int_array(struct cag_test_series *tests)
 {
 	int i, total = 0;
@@ -1150,6 +1450,11 @@ void test_array(struct cag_test_series *tests)
 	test_shuffle(tests);
 	test_sort(tests);
 	test_stable_sort(tests);
+	test_stable_sort_runs(tests);
+	test_sort_patterns(tests);
+	test_radix_sort(tests);
+	test_select(tests);
+	test_network_sort(tests);
 	test_batch(tests);
 	test_abstract(tests);
 	test_int_array(tests);
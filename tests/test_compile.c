@@ -126,6 +126,7 @@ CAG_DEC_DEF_ALL_CMP_TREE(int_cdd_at, int, CAG_CMP_PRIMITIVE, CAG_BYVAL,
 CAG_DEC_STR_HASH(sh);
 CAG_DEF_STR_HASH(sh);
 CAG_DEC_DEF_STR_HASH(ddsh);
+CAG_DEC_DEF_MAPPED_STR_HASH(ddmsh);
 
 CAG_DEC_STR_TREE(st);
 CAG_DEF_STR_TREE(st);
@@ -151,6 +152,7 @@ struct dictionary {
 CAG_DEC_STR_STR_HASH(dh, struct dictionary);
 CAG_DEF_STR_STR_HASH(dh, struct dictionary);
 CAG_DEC_DEF_STR_STR_HASH(dddh, struct dictionary);
+CAG_DEC_DEF_MAPPED_STR_STR_HASH(ddmdh, struct dictionary);
 
 CAG_DEC_STR_STR_TREE(dt, struct dictionary );
 CAG_DEF_STR_STR_TREE(dt, struct dictionary);
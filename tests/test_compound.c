@@ -27,6 +27,20 @@ CAG_DEC_DEF_ARRAY(iarr, int);
 CAG_DEC_DEF_CMP_TREE(itree, int, CAG_CMP_PRIMITIVE);
 CAG_DEC_DEF_CMP_HASH(ihash, int, CAG_CMP_PRIMITIVE, CAG_INT_HASH, sizeof);
 
+struct group {
+	int key;
+	int count;
+	int sum;
+};
+
+#define GROUP_CMP(a, b) CAG_CMP_PRIMITIVE((a).key, (b).key)
+#define GROUP_HASH(g, len) CAG_MIX_HASH((g).key, len)
+#define GROUP_ADD(g, row) ((g)->count += (row).count, (g)->sum += (row).sum)
+
+CAG_DEC_DEF_CMP_HASH(group_hash, struct group, GROUP_CMP, GROUP_HASH, sizeof);
+CAG_DEC_DEF_FLAT_HASH(group_flat_hash, struct group, GROUP_CMP, GROUP_HASH,
+		      sizeof);
+
 
 CAG_DEC_ARRAY(adj_list, ilist);
 CAG_DEC_ARRAY(adj_slist, islist);
@@ -794,6 +808,177 @@ static void test_concat_if_macro(struct cag_test_series *tests)
 	free_ilist(&dlist);
 }
 
+static struct group group_mod_7(int x)
+{
+	struct group g;
+	g.key = x % 7;
+	g.count = 1;
+	g.sum = x;
+	return g;
+}
+
+static struct group group_mod_1000(int x)
+{
+	struct group g;
+	g.key = x % 1000;
+	g.count = 1;
+	g.sum = x;
+	return g;
+}
+
+static struct group group_left(int x)
+{
+	struct group g;
+	g.key = x;
+	g.count = x;
+	g.sum = 0;
+	return g;
+}
+
+static struct group group_right(int x)
+{
+	struct group g;
+	g.key = x;
+	g.count = 0;
+	g.sum = x;
+	return g;
+}
+
+static void test_group_by_macro(struct cag_test_series *tests)
+{
+	iarr arr;
+	ilist list;
+	group_hash h;
+	group_flat_hash fh;
+	struct group g;
+	it_group_hash it;
+	it_group_flat_hash fit;
+	int i, result, failures = 0;
+
+	new_iarr(&arr);
+	new_ilist(&list);
+	new_group_hash(&h);
+	new_group_flat_hash(&fh);
+	for (i = 0; i < 700; ++i)
+		append_ilist(&list, i);
+	CAG_GROUP_BY(ilist, &list, group_hash, &h, struct group, group_mod_7,
+		     GROUP_HASH, sizeof, GROUP_ADD, result);
+	for (i = 0; i < 7; ++i) {
+		g.key = i;
+		it = get_group_hash(&h, g);
+		if (!it || it->value.count != 100 ||
+		    it->value.sum != 100 * i + 7 * 4950)
+			++failures;
+	}
+	CAG_TEST(*tests, result && h.size == 7 && failures == 0,
+		 "cag_compound: group by list into hash");
+
+	for (i = 0; i < 50000; ++i)
+		append_iarr(&arr, i);
+	CAG_GROUP_BY(iarr, &arr, group_flat_hash, &fh, struct group,
+		     group_mod_1000, GROUP_HASH, sizeof, GROUP_ADD, result);
+	failures = 0;
+	for (i = 0; i < 1000; ++i) {
+		g.key = i;
+		fit = get_group_flat_hash(&fh, g);
+		if (!fit || fit->value.count != 50 ||
+		    fit->value.sum != 50 * i + 1000 * 1225)
+			++failures;
+	}
+	CAG_TEST(*tests, result && fh.size == 1000 && failures == 0,
+		 "cag_compound: partitioned group by array into flat hash");
+
+	free_group_flat_hash(&fh);
+	free_group_hash(&h);
+	free_ilist(&list);
+	free_iarr(&arr);
+}
+
+static void test_hash_join_macro(struct cag_test_series *tests)
+{
+	iarr arr;
+	ilist list;
+	struct group *v1, *v2;
+	int i, result, matches = 0, failures = 0;
+
+	new_iarr(&arr);
+	new_ilist(&list);
+	for (i = 0; i < 100; ++i)
+		append_iarr(&arr, i);
+	for (i = 0; i < 300; ++i)
+		append_ilist(&list, i % 150);
+	CAG_HASH_JOIN(iarr, &arr, ilist, &list, group_hash, struct group,
+		      group_left, group_right, GROUP_HASH, sizeof, v1, v2,
+	{
+		++matches;
+		if (v1->count != v2->sum)
+			++failures;
+	}, result);
+	CAG_TEST(*tests, result && matches == 200 && failures == 0,
+		 "cag_compound: hash join builds on smaller side");
+
+	matches = 0;
+	free_ilist(&list);
+	new_ilist(&list);
+	for (i = 0; i < 60; ++i)
+		append_ilist(&list, i % 30);
+	CAG_HASH_JOIN(ilist, &list, iarr, &arr, group_flat_hash, struct group,
+		      group_left, group_right, GROUP_HASH, sizeof, v1, v2,
+	{
+		++matches;
+		if (v1->count != v2->sum)
+			++failures;
+	}, result);
+	CAG_TEST(*tests, result && matches == 60 && failures == 0,
+		 "cag_compound: hash join builds on smaller side with duplicates");
+
+	matches = 0;
+	append_iarr(&arr, 0);
+	append_iarr(&arr, 0);
+	CAG_HASH_JOIN(ilist, &list, iarr, &arr, group_hash, struct group,
+		      group_left, group_right, GROUP_HASH, sizeof, v1, v2,
+	{
+		++matches;
+		if (v1->count != v2->sum)
+			++failures;
+	}, result);
+	CAG_TEST(*tests, result && matches == 64 && failures == 0,
+		 "cag_compound: many to many hash join");
+
+	matches = 0;
+	CAG_HASH_JOIN(iarr, &arr, ilist, &list, group_flat_hash, struct group,
+		      group_right, group_left, GROUP_HASH, sizeof, v1, v2,
+	{
+		++matches;
+		if (v1->sum != v2->count)
+			++failures;
+	}, result);
+	CAG_TEST(*tests, result && matches == 64 && failures == 0,
+		 "cag_compound: many to many hash join into flat hash");
+
+	matches = 0;
+	free_iarr(&arr);
+	new_iarr(&arr);
+	free_ilist(&list);
+	new_ilist(&list);
+	for (i = 0; i < 40000; ++i) {
+		append_iarr(&arr, i);
+		append_ilist(&list, 2 * i);
+	}
+	CAG_HASH_JOIN(iarr, &arr, ilist, &list, group_hash, struct group,
+		      group_left, group_right, GROUP_HASH, sizeof, v1, v2,
+	{
+		++matches;
+		if (v1->count != v2->sum)
+			++failures;
+	}, result);
+	CAG_TEST(*tests, result && matches == 20000 && failures == 0,
+		 "cag_compound: hash join with partitioned build");
+
+	free_ilist(&list);
+	free_iarr(&arr);
+}
+
 void test_compound(struct cag_test_series *tests)
 {
 	test_adj_list(tests);
@@ -812,6 +997,8 @@ void test_compound(struct cag_test_series *tests)
 	test_rcopy_if_macro(tests);
 	test_concat_macro(tests);
 	test_concat_if_macro(tests);
+	test_group_by_macro(tests);
+	test_hash_join_macro(tests);
 }
 
 CAG_DEF_ALL_ARRAY(adj_list, ilist, CAG_STRUCT_ALLOC_STYLE,
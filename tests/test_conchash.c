@@ -0,0 +1,134 @@
+/*! Tests for CAGL concurrent hash.
+
+  \copyright Copyright 2014 Nathan Geffen. All rights reserved.
+  \license GNU Lesser General Public License Copyright.
+  See COPYING for the license text.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CAG_SAFER 1
+#include "cagl/error.h"
+#include "cagl/test.h"
+#include "cagl/conchash.h"
+
+#define THREADS 4
+#define PER_THREAD 5000
+
+struct word_count {
+	char *key;
+	int count;
+};
+
+CAG_DEC_DEF_CONC_HASH(int_conc_hash, int, CAG_CMP_PRIMITIVE, CAG_MIX_HASH,
+		      sizeof);
+CAG_DEC_DEF_CONC_HASH(count_conc_hash, struct word_count,
+		      CAG_STRCMP_STRUCT_WITH_STR_KEY,
+		      CAG_FAST_HASH_STRUCT_WITH_STR_KEY,
+		      CAG_STRLEN_STRUCT_WITH_STR_KEY);
+CAG_DEC_DEF_STR_CONC_HASH(string_conc_hash);
+
+struct worker {
+	int_conc_hash *h;
+	count_conc_hash *counts;
+	int id;
+	int found;
+};
+
+static void increment(struct word_count *w, void *data)
+{
+	w->count += *(int *) data;
+}
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	struct word_count wc;
+	char *words[] = {"alpha", "beta", "gamma"};
+	int i, one = 1, value;
+
+	for (i = 0; i < PER_THREAD; ++i)
+		insert_int_conc_hash(w->h, w->id * PER_THREAD + i);
+	for (i = 0; i < 3 * PER_THREAD; ++i) {
+		wc.key = words[i % 3];
+		wc.count = 0;
+		update_with_count_conc_hash(w->counts, wc, increment, &one);
+	}
+	for (i = 0; i < PER_THREAD; ++i)
+		if (get_int_conc_hash(w->h, w->id * PER_THREAD + i, &value) &&
+		    value == w->id * PER_THREAD + i)
+			++w->found;
+	for (i = 0; i < PER_THREAD; i += 2)
+		remove_int_conc_hash(w->h, w->id * PER_THREAD + i);
+	return NULL;
+}
+
+static void test_threads(struct cag_test_series *tests)
+{
+	int_conc_hash h;
+	count_conc_hash counts;
+	struct worker workers[THREADS];
+	pthread_t threads[THREADS];
+	struct word_count wc, result;
+	int i, started = 1, found = 1;
+
+	new_int_conc_hash(&h);
+	new_with_shards_count_conc_hash(&counts, 4);
+	for (i = 0; i < THREADS; ++i) {
+		workers[i].h = &h;
+		workers[i].counts = &counts;
+		workers[i].id = i;
+		workers[i].found = 0;
+		if (pthread_create(&threads[i], NULL, work, &workers[i]) != 0)
+			started = 0;
+	}
+	for (i = 0; i < THREADS; ++i)
+		pthread_join(threads[i], NULL);
+	for (i = 0; i < THREADS; ++i)
+		if (workers[i].found != PER_THREAD)
+			found = 0;
+	CAG_TEST(*tests, started && found,
+		 "cag_conc_hash: concurrent inserts and gets");
+	CAG_TEST(*tests, size_int_conc_hash(&h) == THREADS * PER_THREAD / 2 &&
+		 !get_int_conc_hash(&h, 0, NULL) &&
+		 get_int_conc_hash(&h, 1, NULL),
+		 "cag_conc_hash: concurrent removes");
+	wc.key = "beta";
+	CAG_TEST(*tests, get_count_conc_hash(&counts, wc, &result) &&
+		 result.count == THREADS * PER_THREAD &&
+		 size_count_conc_hash(&counts) == 3,
+		 "cag_conc_hash: concurrent update_with");
+	free_int_conc_hash(&h);
+	free_count_conc_hash(&counts);
+}
+
+static void test_strings(struct cag_test_series *tests)
+{
+	string_conc_hash h;
+	char *copy = NULL;
+
+	new_with_shards_string_conc_hash(&h, 3);
+	CAG_TEST(*tests, insert_string_conc_hash(&h, "pear") &&
+		 insert_string_conc_hash(&h, "apple") &&
+		 insert_string_conc_hash(&h, "pear") &&
+		 size_string_conc_hash(&h) == 2,
+		 "cag_conc_hash: insert strings");
+	CAG_TEST(*tests, get_string_conc_hash(&h, "apple", &copy) &&
+		 strcmp(copy, "apple") == 0 &&
+		 !get_string_conc_hash(&h, "plum", NULL),
+		 "cag_conc_hash: get copies string");
+	free(copy);
+	CAG_TEST(*tests, remove_string_conc_hash(&h, "apple") &&
+		 !remove_string_conc_hash(&h, "apple") &&
+		 size_string_conc_hash(&h) == 1,
+		 "cag_conc_hash: remove string");
+	free_string_conc_hash(&h);
+}
+
+void test_conchash(struct cag_test_series *tests)
+{
+	test_threads(tests);
+	test_strings(tests);
+}
@@ -1131,6 +1131,138 @@ void test_stable_sort(struct cag_test_series *tests)
 	free_complex_list(&cl);
 }
 
+static void test_stable_sort_runs(struct cag_test_series *tests)
+{
+	complex_list cl;
+	it_complex_list cit;
+	struct complex c;
+	int i, pattern, n = 3000, ordered = CAG_TRUE;
+
+	for (pattern = 0; pattern < 6; ++pattern) {
+		new_complex_list(&cl);
+		for (i = 0; i < n; ++i) {
+			if (pattern % 3 == 0)
+				c.real = rand() % 40;
+			else if (pattern % 3 == 1)
+				c.real = i % 70;
+			else
+				c.real = (n - i) / 4;
+			c.imag = i;
+			appendp_complex_list(&cl, &c);
+		}
+		if (pattern >= 3)
+			relink_sort_all_complex_list(&cl);
+		else if (!stable_sort_complex_list(beg_complex_list(&cl),
+						   end_complex_list(&cl)))
+			ordered = CAG_FALSE;
+		for (cit = beg_complex_list(&cl)->next;
+		     cit != end_complex_list(&cl); cit = cit->next)
+			if (cmp_complex(cit->prev->value, cit->value) > 0 ||
+			    (cmp_complex(cit->prev->value, cit->value) == 0 &&
+			     cit->prev->value.imag > cit->value.imag))
+				ordered = CAG_FALSE;
+		free_complex_list(&cl);
+	}
+	CAG_TEST(*tests, ordered,
+		 "cag_dlist: stable and relink sort of runs and duplicates");
+}
+
+static void test_sort_relinks(struct cag_test_series *tests)
+{
+	ilist l;
+	it_ilist first;
+	it_ilist last;
+	it_ilist it;
+	it_ilist node;
+	rit_ilist rit;
+	int i, value, ordered = CAG_TRUE, linked = CAG_TRUE;
+
+	new_ilist(&l);
+	for (i = 0; i < 1000; ++i)
+		append_ilist(&l, (i * 37) % 1000);
+	first = at_ilist(beg_ilist(&l), 100);
+	last = at_ilist(beg_ilist(&l), 900);
+	node = at_ilist(beg_ilist(&l), 500);
+	value = node->value;
+	it = relink_sort_ilist(first, last);
+	CAG_TEST(*tests, it == at_ilist(beg_ilist(&l), 100) &&
+		 node->value == value && last->value == (900 * 37) % 1000,
+		 "cag_dlist: relink sort relinks nodes of range");
+	for (i = 0, it = beg_ilist(&l); it != end_ilist(&l);
+	     it = it->next, ++i) {
+		if (it->next->prev != it)
+			linked = CAG_FALSE;
+		if ((i < 100 || i >= 900) && it->value != (i * 37) % 1000)
+			ordered = CAG_FALSE;
+		if (i > 100 && i < 900 && it->prev->value > it->value)
+			ordered = CAG_FALSE;
+	}
+	CAG_TEST(*tests, ordered && linked && i == 1000,
+		 "cag_dlist: sort of sub-range keeps links and outside nodes");
+	rit = rrelink_sort_ilist(rbeg_ilist(&l), rend_ilist(&l));
+	CAG_TEST(*tests, rit == rbeg_ilist(&l) && rit->value == 0 &&
+		 beg_ilist(&l)->value == 999,
+		 "cag_dlist: reverse sort relinks whole list");
+	free_ilist(&l);
+	new_ilist(&l);
+	for (i = 0; i < 3000; ++i)
+		append_ilist(&l, i < 1000 ? i % 100 :
+			     (i < 2000 ? 2000 - i : i % 7));
+	relink_sort_all_ilist(&l);
+	for (i = 0, it = beg_ilist(&l); it != end_ilist(&l);
+	     it = it->next, ++i)
+		if (it->next->prev != it ||
+		    (it != beg_ilist(&l) && it->prev->value > it->value))
+			ordered = CAG_FALSE;
+	CAG_TEST(*tests, ordered && i == 3000,
+		 "cag_dlist: sort of ascending and descending runs");
+	free_ilist(&l);
+}
+
+static void test_relink_sort_scattered(struct cag_test_series *tests)
+{
+	complex_list cl, copy;
+	it_complex_list cit, it;
+	struct complex c;
+	int i, n = 5000, ordered = CAG_TRUE, same = CAG_TRUE;
+
+	new_complex_list(&cl);
+	new_complex_list(&copy);
+	for (i = 0; i < n; ++i) {
+		c.real = rand();
+		c.imag = i;
+		appendp_complex_list(&cl, &c);
+	}
+	/* Scatter the nodes in memory, then sort on new keys. */
+	relink_sort_all_complex_list(&cl);
+	for (i = 0, cit = beg_complex_list(&cl); cit != end_complex_list(&cl);
+	     cit = cit->next, ++i) {
+		cit->value.real = rand() % 50;
+		cit->value.imag = i;
+		appendp_complex_list(&copy, &cit->value);
+	}
+	relink_sort_all_complex_list(&cl);
+	stable_sort_all_complex_list(&copy);
+	for (i = 0, cit = beg_complex_list(&cl), it = beg_complex_list(&copy);
+	     cit != end_complex_list(&cl); cit = cit->next, it = it->next,
+	     ++i) {
+		if (cit->next->prev != cit)
+			ordered = CAG_FALSE;
+		if (cit != beg_complex_list(&cl) &&
+		    (cmp_complex(cit->prev->value, cit->value) > 0 ||
+		     (cmp_complex(cit->prev->value, cit->value) == 0 &&
+		      cit->prev->value.imag > cit->value.imag)))
+			ordered = CAG_FALSE;
+		if (cit->value.real != it->value.real ||
+		    cit->value.imag != it->value.imag)
+			same = CAG_FALSE;
+	}
+	CAG_TEST(*tests, ordered && same && i == n,
+		 "cag_dlist: relink sort of scattered nodes");
+	free_complex_list(&cl);
+	free_complex_list(&copy);
+}
+
 void test_stable_sort_macro(struct cag_test_series *tests)
 {
 	int i, inorder = CAG_TRUE;
@@ -1337,6 +1469,9 @@ void test_dlist(struct cag_test_series *tests)
 	test_shuffle(tests);
 	test_sort(tests);
 	test_stable_sort(tests);
+	test_stable_sort_runs(tests);
+	test_sort_relinks(tests);
+	test_relink_sort_scattered(tests);
 	test_stable_sort_macro(tests);
 	test_abstract(tests);
 	test_string(tests);
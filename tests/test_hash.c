@@ -10,6 +10,7 @@
 #include <stdlib.h>
 
 #define CAG_SAFER 1
+#define CAG_STATS 1
 #include "cagl/error.h"
 #include "cagl/test.h"
 #include "cagl/hash.h"
@@ -23,8 +24,51 @@ struct str_str {
 };
 
 CAG_DEC_DEF_CMP_HASH(str_hash, char *, strcmp, cag_oat_hash, strlen);
-CAG_DEC_STR_HASH(string_hash);
-CAG_DEC_DEF_STR_STR_HASH(str_str_hash, struct str_str);
+CAG_DEC_MAPPED_STR_HASH(string_hash);
+CAG_DEC_DEF_MAPPED_STR_STR_HASH(str_str_hash, struct str_str);
+CAG_DEC_DEF_INLINE_STR_HASH(inline_hash);
+CAG_DEC_DEF_CMP_HASH(int_hash, int, CAG_CMP_PRIMITIVE, CAG_INT_HASH, sizeof);
+
+CAG_DEC_DEF_FLAT_HASH(int_flat_hash, int, CAG_CMP_PRIMITIVE, CAG_INT_HASH,
+		      sizeof);
+CAG_DEC_DEF_STR_FLAT_HASH(string_flat_hash);
+CAG_DEC_DEF_STR_STR_FLAT_HASH(str_str_flat_hash, struct str_str);
+CAG_DEC_DEF_ORDERED_HASH(int_ordered_hash, int, CAG_CMP_PRIMITIVE,
+			 CAG_INT_HASH, sizeof);
+CAG_DEC_DEF_STR_ORDERED_HASH(string_ordered_hash);
+CAG_DEC_DEF_CUCKOO_HASH(int_cuckoo_hash, int, CAG_CMP_PRIMITIVE, CAG_INT_HASH,
+			sizeof);
+CAG_DEC_DEF_STR_STR_CUCKOO_HASH(str_str_cuckoo_hash, struct str_str);
+
+#define CAG_TEST_SAME_HASH(i, len) ((size_t) 42)
+
+CAG_DEC_DEF_CUCKOO_HASH(same_cuckoo_hash, int, CAG_CMP_PRIMITIVE,
+			CAG_TEST_SAME_HASH, sizeof);
+CAG_DEC_DEF_CMP_HASH(same_hash, int, CAG_CMP_PRIMITIVE, CAG_TEST_SAME_HASH,
+		     sizeof);
+
+#define CAG_TEST_FEW_HASHES(i, len) ((size_t) (i) % 1000)
+
+CAG_DEC_DEF_CMP_HASH(few_hashes_hash, int, CAG_CMP_PRIMITIVE,
+		     CAG_TEST_FEW_HASHES, sizeof);
+
+static size_t hash_calls;
+
+static size_t counted_hash(const int i, const size_t len)
+{
+	(void) len;
+	++hash_calls;
+	return (size_t) i * 2654435761UL;
+}
+
+CAG_DEC_DEF_CMP_HASH(counted_hash_table, int, CAG_CMP_PRIMITIVE,
+		     counted_hash, sizeof);
+CAG_DEC_DEF_FLAT_HASH(counted_flat_hash, int, CAG_CMP_PRIMITIVE,
+		      counted_hash, sizeof);
+CAG_DEC_DEF_ORDERED_HASH(counted_ordered_hash, int, CAG_CMP_PRIMITIVE,
+			 counted_hash, sizeof);
+CAG_DEC_DEF_CUCKOO_HASH(counted_cuckoo_hash, int, CAG_CMP_PRIMITIVE,
+			counted_hash, sizeof);
 
 struct cag_str_x {
 	char *key;
@@ -272,9 +316,398 @@ static void test_rehash(struct cag_test_series *tests)
 		 "cag_hash: rehash");
 	CAG_TEST(*tests, h.size == 70 && h.buckets == 509,
 		 "cag_hash: size and buckets after rehash");
+	it = get_string_hash(&h, "k35");
+	rehash_string_hash(&h, 0);
+	CAG_TEST(*tests, it == get_string_hash(&h, "k35") &&
+		 it->bucket == CAG_P_BUCKET_HASH(&h, it->hash) &&
+		 h.buckets == 1024 && h.shift != 0 && h.size == 70,
+		 "cag_hash: rehash relinks nodes in place");
+	free_string_hash(&h);
+}
+
+static void test_load_factor(struct cag_test_series *tests)
+{
+	int_hash h;
+	int i, found = 1;
+
+	new_int_hash(&h);
+	CAG_TEST(*tests, h.buckets == 32 && h.shift != 0,
+		 "cag_hash: default buckets are a power of two");
+	h.max_load = 4.0;
+	for (i = 0; i < 128; ++i)
+		insert_int_hash(&h, i * 64);
+	CAG_TEST(*tests, h.buckets == 32,
+		 "cag_hash: no growth below max load");
+	insert_int_hash(&h, -1);
+	insert_int_hash(&h, -2);
+	for (i = 0; i < 128; ++i)
+		if (get_int_hash(&h, i * 64) == NULL)
+			found = 0;
+	CAG_TEST(*tests, h.buckets == 64 && found && h.size == 130,
+		 "cag_hash: table doubles above max load");
+	free_int_hash(&h);
+}
+
+static void test_get_many(struct cag_test_series *tests)
+{
+	int_hash h;
+	int_flat_hash fh;
+	int_ordered_hash oh;
+	int keys[100];
+	const int *pkeys[100];
+	it_int_hash res[100];
+	it_int_flat_hash fres[100];
+	it_int_ordered_hash ores[100];
+	size_t found, ffound, ofound;
+	int i, failure = 0;
+
+	new_int_hash(&h);
+	new_int_flat_hash(&fh);
+	new_int_ordered_hash(&oh);
+	for (i = 0; i < 1000; i += 2) {
+		insert_int_hash(&h, i);
+		insert_int_flat_hash(&fh, i);
+		insert_int_ordered_hash(&oh, i);
+	}
+	for (i = 0; i < 100; ++i) {
+		keys[i] = i * 7;
+		pkeys[i] = &keys[i];
+	}
+	found = get_many_int_hash(&h, keys, 100, res);
+	ffound = get_many_int_flat_hash(&fh, keys, 100, fres);
+	ofound = get_many_int_ordered_hash(&oh, keys, 100, ores);
+	for (i = 0; i < 100; ++i)
+		if (res[i] != get_int_hash(&h, keys[i]) ||
+		    fres[i] != get_int_flat_hash(&fh, keys[i]) ||
+		    ores[i] != get_int_ordered_hash(&oh, keys[i]))
+			failure = 1;
+	CAG_TEST(*tests, failure == 0 && found == 50 && ffound == 50 &&
+		 ofound == 50,
+		 "cag_hash: get_many matches get");
+	found = getp_many_int_hash(&h, pkeys, 100, res);
+	ffound = getp_many_int_flat_hash(&fh, pkeys, 100, fres);
+	ofound = getp_many_int_ordered_hash(&oh, pkeys, 100, ores);
+	for (i = 0; i < 100; ++i)
+		if (res[i] != getp_int_hash(&h, pkeys[i]) ||
+		    fres[i] != getp_int_flat_hash(&fh, pkeys[i]) ||
+		    ores[i] != getp_int_ordered_hash(&oh, pkeys[i]))
+			failure = 1;
+	CAG_TEST(*tests, failure == 0 && found == 50 && ffound == 50 &&
+		 ofound == 50 && get_many_int_hash(&h, keys, 0, res) == 0,
+		 "cag_hash: getp_many matches getp");
+	free_int_hash(&h);
+	free_int_flat_hash(&fh);
+	free_int_ordered_hash(&oh);
+}
+
+static void test_insert_many(struct cag_test_series *tests)
+{
+	int_hash h;
+	int_flat_hash fh;
+	int_ordered_hash oh;
+	int_cuckoo_hash ch;
+	string_hash sh;
+	inline_hash ih;
+	struct cag_hash_stats stats;
+	char *words[] = {"pear", "apple", "plum", "apple", "fig"};
+	int keys[3000];
+	size_t buckets;
+	int i, failure = 0;
+
+	for (i = 0; i < 3000; ++i)
+		keys[i] = i % 2000;
+	new_int_hash(&h);
+	CAG_TEST(*tests, reserve_int_hash(&h, 1000) == &h &&
+		 h.buckets == 2048,
+		 "cag_hash: reserve sizes buckets");
+	buckets = h.buckets;
+	for (i = 0; i < 1000; ++i)
+		insert_int_hash(&h, i);
+	stats_int_hash(&h, &stats);
+	CAG_TEST(*tests, h.buckets == buckets && stats.rehashes == 1,
+		 "cag_hash: no rehash after reserve");
+	free_int_hash(&h);
+
+	new_int_hash(&h);
+	reserve_int_hash(&h, 100000);
+	buckets = h.buckets;
+	for (i = 0; i < 1000; ++i)
+		insert_int_hash(&h, i);
+	remove_int_hash(&h, 0);
+	shrink_to_fit_int_hash(&h);
+	CAG_TEST(*tests, buckets == 262144 && h.buckets == buckets &&
+		 h.size == 999,
+		 "cag_hash: no shrinking after reserve");
+	free_int_hash(&h);
+
+	new_int_hash(&h);
+	new_int_flat_hash(&fh);
+	new_int_ordered_hash(&oh);
+	new_int_cuckoo_hash(&ch);
+	insert_int_hash(&h, 5);
+	CAG_TEST(*tests, insert_many_int_hash(&h, keys, 3000) == &h &&
+		 insert_many_int_flat_hash(&fh, keys, 3000) == &fh &&
+		 insert_many_int_ordered_hash(&oh, keys, 3000) == &oh &&
+		 insert_many_int_cuckoo_hash(&ch, keys, 3000) == &ch &&
+		 h.size == 2000 && fh.size == 2000 && oh.size == 2000 &&
+		 ch.size == 2000,
+		 "cag_hash: insert_many skips duplicates");
+	for (i = 0; i < 2000; ++i)
+		if (!get_int_hash(&h, i) || !get_int_flat_hash(&fh, i) ||
+		    !get_int_ordered_hash(&oh, i) ||
+		    !get_int_cuckoo_hash(&ch, i))
+			failure = 1;
+	stats_int_hash(&h, &stats);
+	CAG_TEST(*tests, failure == 0 && stats.rehashes == 1 &&
+		 oh.objects[0].value == 0 && oh.objects[1999].value == 1999,
+		 "cag_hash: insert_many inserts all elements");
+	CAG_TEST(*tests, insert_many_int_hash(&h, keys, 0) == &h &&
+		 reserve_int_flat_hash(&fh, 10) == &fh &&
+		 reserve_int_ordered_hash(&oh, 10) == &oh &&
+		 reserve_int_cuckoo_hash(&ch, 10) == &ch && h.size == 2000,
+		 "cag_hash: reserve and insert_many of nothing");
+	free_int_hash(&h);
+	free_int_flat_hash(&fh);
+	free_int_ordered_hash(&oh);
+	free_int_cuckoo_hash(&ch);
+
+	new_string_hash(&sh);
+	new_inline_hash(&ih);
+	CAG_TEST(*tests, insert_many_string_hash(&sh, words, 5) &&
+		 insert_many_inline_hash(&ih, words, 5) &&
+		 sh.size == 4 && ih.size == 4 &&
+		 get_string_hash(&sh, "fig") && get_inline_hash(&ih, "plum"),
+		 "cag_hash: insert_many of strings");
+	free_string_hash(&sh);
+	free_inline_hash(&ih);
+}
+
+static void test_shrink(struct cag_test_series *tests)
+{
+	int_hash h;
+	int_flat_hash fh;
+	int_ordered_hash oh;
+	size_t peak;
+	int i, found = 1;
+
+	new_int_hash(&h);
+	for (i = 0; i < 4000; ++i)
+		insert_int_hash(&h, i);
+	peak = h.buckets;
+	for (i = 0; i < 3990; ++i)
+		remove_int_hash(&h, i);
+	for (i = 3990; i < 4000; ++i)
+		if (get_int_hash(&h, i) == NULL)
+			found = 0;
+	CAG_TEST(*tests, h.buckets < peak / 8 && h.size == 10 && found &&
+		 distance_all_int_hash(&h) == 10,
+		 "cag_hash: table shrinks below min load");
+	h.min_load = 0;
+	for (i = 0; i < 4000; ++i)
+		insert_int_hash(&h, i);
+	for (i = 0; i < 4000; ++i)
+		remove_int_hash(&h, i);
+	CAG_TEST(*tests, h.buckets == peak && h.size == 0,
+		 "cag_hash: no shrinking with min load of zero");
+	shrink_to_fit_int_hash(&h);
+	CAG_TEST(*tests, h.buckets == 32 && begin_int_hash(&h) == end_int_hash(&h),
+		 "cag_hash: shrink_to_fit");
+	free_int_hash(&h);
+
+	new_with_buckets_int_hash(&h, 4096);
+	for (i = 0; i < 100; ++i)
+		insert_int_hash(&h, i);
+	remove_int_hash(&h, 0);
+	shrink_to_fit_int_hash(&h);
+	CAG_TEST(*tests, h.buckets == 4096 && h.size == 99,
+		 "cag_hash: no shrinking below initial buckets");
+	free_int_hash(&h);
+
+	new_int_flat_hash(&fh);
+	new_int_ordered_hash(&oh);
+	for (i = 0; i < 4000; ++i) {
+		insert_int_flat_hash(&fh, i);
+		insert_int_ordered_hash(&oh, i);
+	}
+	for (i = 0; i < 3990; ++i) {
+		remove_int_flat_hash(&fh, i);
+		remove_int_ordered_hash(&oh, i);
+	}
+	shrink_to_fit_int_flat_hash(&fh);
+	shrink_to_fit_int_ordered_hash(&oh);
+	for (i = 3990; i < 4000; ++i)
+		if (get_int_flat_hash(&fh, i) == NULL ||
+		    get_int_ordered_hash(&oh, i) == NULL)
+			found = 0;
+	CAG_TEST(*tests, found && fh.buckets == 32 && fh.deleted == 0 &&
+		 oh.buckets == 32 && oh.used == 10 &&
+		 begin_int_ordered_hash(&oh)->value == 3990,
+		 "cag_hash: flat and ordered shrink_to_fit");
+	free_int_flat_hash(&fh);
+	free_int_ordered_hash(&oh);
+}
+
+static void test_incremental(struct cag_test_series *tests)
+{
+	string_hash h;
+	it_string_hash it;
+	char key[6];
+	int i, count = 0, found = 1, migrating = 0;
+
+	new_string_hash(&h);
+	h.incremental = 2;
+	for (i = 0; i < 1000; ++i) {
+		snprintf(key, 6, "k%d", i);
+		insert_string_hash(&h, key);
+		if (h.old)
+			migrating = 1;
+		if (h.old && i % 7 == 0) {
+			for (it = begin_string_hash(&h);
+			     it != end_string_hash(&h);
+			     it = next_string_hash(it))
+				++count;
+			if (count != i + 1)
+				found = 0;
+			count = 0;
+		}
+	}
+	CAG_TEST(*tests, migrating && found,
+		 "cag_hash: iterate during incremental rehash");
+	for (i = 0; i < 1000; ++i) {
+		snprintf(key, 6, "k%d", i);
+		if (get_string_hash(&h, key) == NULL)
+			found = 0;
+	}
+	CAG_TEST(*tests, found && h.size == 1000,
+		 "cag_hash: get during incremental rehash");
+	for (i = 0; i < 1000; i += 2) {
+		snprintf(key, 6, "k%d", i);
+		remove_string_hash(&h, key);
+	}
+	while (rehash_step_string_hash(&h, 1) > 0)
+		;
+	CAG_TEST(*tests, h.old == NULL && h.size == 500 &&
+		 get_string_hash(&h, "k1") && !get_string_hash(&h, "k2") &&
+		 distance_string_hash(begin_string_hash(&h),
+				      end_string_hash(&h)) == 500,
+		 "cag_hash: remove and drain incremental rehash");
+	rehash_string_hash(&h, 0);
+	CAG_TEST(*tests, h.old != NULL && get_string_hash(&h, "k999"),
+		 "cag_hash: explicit rehash starts incremental rehash");
+	free_string_hash(&h);
+}
+
+static void test_insert_or_get(struct cag_test_series *tests)
+{
+	string_hash h;
+	string_flat_hash fh;
+	it_string_hash it, it2;
+	it_string_flat_hash fit;
+	int inserted = -1;
+	size_t hv;
+
+	new_string_hash(&h);
+	it = insert_or_get_string_hash(&h, "apple", &inserted);
+	CAG_TEST(*tests, it && inserted == 1 && h.size == 1,
+		 "cag_hash: insert_or_get inserts new key");
+	it2 = insert_or_get_string_hash(&h, "apple", &inserted);
+	CAG_TEST(*tests, it2 == it && inserted == 0 && h.size == 1,
+		 "cag_hash: insert_or_get finds existing key");
+	hv = cag_fast_hash("pear", 4);
+	it = insert_hashed_string_hash(&h, "pear", hv);
+	CAG_TEST(*tests, it && it == get_string_hash(&h, "pear") &&
+		 it == get_hashed_string_hash(&h, "pear", hv),
+		 "cag_hash: insert_hashed and get_hashed");
+	remove_hashed_string_hash(&h, "pear", hv);
+	CAG_TEST(*tests, get_string_hash(&h, "pear") == NULL && h.size == 1,
+		 "cag_hash: remove_hashed");
 	free_string_hash(&h);
+
+	new_string_flat_hash(&fh);
+	fit = insert_or_get_string_flat_hash(&fh, "apple", &inserted);
+	CAG_TEST(*tests, fit && inserted == 1 &&
+		 insert_or_get_string_flat_hash(&fh, "apple", NULL) == fit,
+		 "cag_hash: flat insert_or_get");
+	fit = insert_hashed_string_flat_hash(&fh, "pear", hv);
+	CAG_TEST(*tests, fit == get_hashed_string_flat_hash(&fh, "pear", hv) &&
+		 fit == get_string_flat_hash(&fh, "pear"),
+		 "cag_hash: flat insert_hashed and get_hashed");
+	remove_hashed_string_flat_hash(&fh, "pear", hv);
+	CAG_TEST(*tests, get_string_flat_hash(&fh, "pear") == NULL &&
+		 fh.size == 1,
+		 "cag_hash: flat remove_hashed");
+	free_string_flat_hash(&fh);
+}
+
+static void test_hash_functions(struct cag_test_series *tests)
+{
+	const char *s = "The quick brown fox jumps over the lazy dog";
+	size_t h1, h2, len = strlen(s), seed = cag_hash_seed;
+	size_t i, buckets[64];
+	int distinct = 1, even = 1;
+
+	h1 = cag_fast_hash(s, len);
+	h2 = cag_fast_hash(s, len);
+	CAG_TEST(*tests, h1 == h2 && h1 != cag_fast_hash(s, len - 1) &&
+		 cag_fast_hash("a", 1) != cag_fast_hash("b", 1),
+		 "cag_hash: fast hash deterministic and length sensitive");
+	cag_hash_seed = 12345;
+	CAG_TEST(*tests, cag_fast_hash(s, len) != h1 &&
+		 cag_mix_int_hash(1, sizeof(int)) != cag_mix_hash(1),
+		 "cag_hash: hash seed changes hash values");
+	cag_hash_seed = seed;
+	for (i = 0; i < 64; ++i)
+		buckets[i] = 0;
+	for (i = 0; i < 64 * 64; ++i)
+		++buckets[CAG_MIX_HASH(i * 1024, sizeof(i)) % 64];
+	for (i = 0; i < 64; ++i)
+		if (buckets[i] < 32 || buckets[i] > 96)
+			even = 0;
+	for (i = 1; i < 100; ++i)
+		if (cag_mix_hash(i) == cag_mix_hash(i - 1))
+			distinct = 0;
+	CAG_TEST(*tests, even && distinct,
+		 "cag_hash: integer mixer spreads keys with equal low bits");
 }
 
+/* Counts the calls to the hash function made by ELEM gets, inserts of
+   elements already in the table and removes, which should be one each. */
+
+#define CAG_TEST_COUNT_HASH_CALLS(container, calls) \
+do { \
+	container t; \
+	int i; \
+	new_ ## container(&t); \
+	for (i = 0; i < ELEM; ++i) \
+		insert_ ## container(&t, i); \
+	hash_calls = 0; \
+	for (i = 0; i < ELEM; ++i) { \
+		get_ ## container(&t, i); \
+		insert_ ## container(&t, i); \
+	} \
+	for (i = 0; i < ELEM; ++i) \
+		remove_ ## container(&t, i); \
+	calls = hash_calls; \
+	free_ ## container(&t); \
+} while (0)
+
+static void test_hash_once(struct cag_test_series *tests)
+{
+	size_t calls;
+
+	CAG_TEST_COUNT_HASH_CALLS(counted_hash_table, calls);
+	CAG_TEST(*tests, calls == 3 * ELEM,
+		 "cag_hash: get, insert and remove hash the key once");
+	CAG_TEST_COUNT_HASH_CALLS(counted_flat_hash, calls);
+	CAG_TEST(*tests, calls == 3 * ELEM,
+		 "cag_hash: flat get, insert and remove hash the key once");
+	CAG_TEST_COUNT_HASH_CALLS(counted_ordered_hash, calls);
+	CAG_TEST(*tests, calls == 3 * ELEM,
+		 "cag_hash: ordered get, insert and remove hash the key once");
+	CAG_TEST_COUNT_HASH_CALLS(counted_cuckoo_hash, calls);
+	CAG_TEST(*tests, calls == 3 * ELEM,
+		 "cag_hash: cuckoo get, insert and remove hash the key once");
+}
 
 static void test_copy(struct cag_test_series *tests)
 {
@@ -388,6 +821,539 @@ static void test_str_str(struct cag_test_series *tests)
 	free_str_str_hash(&h);
 }
 
+static void test_flat(struct cag_test_series *tests)
+{
+	int_flat_hash ih;
+	string_flat_hash sh;
+	str_str_flat_hash ssh;
+	it_int_flat_hash iit;
+	it_string_flat_hash sit;
+	it_str_str_flat_hash ssit;
+	struct str_str x;
+	char key[6];
+	int i, failure = 0;
+	long sum = 0;
+
+	CAG_TEST(*tests, new_int_flat_hash(&ih) &&
+		 begin_int_flat_hash(&ih) == end_int_flat_hash(&ih),
+		 "cag_hash: flat begin == end after new");
+	for (i = 0; i < ELEM * 4; ++i)
+		if (!insert_int_flat_hash(&ih, i * 128))
+			failure = 1;
+	CAG_TEST(*tests, failure == 0 && ih.size == ELEM * 4 &&
+		 distance_all_int_flat_hash(&ih) == ELEM * 4,
+		 "cag_hash: flat inserts with growth");
+	for (i = 0; i < ELEM * 4; ++i) {
+		iit = get_int_flat_hash(&ih, i * 128);
+		if (!iit || iit->value != i * 128)
+			failure = 1;
+	}
+	CAG_TEST(*tests, failure == 0 && get_int_flat_hash(&ih, 1) == NULL,
+		 "cag_hash: flat get");
+	for (i = 0; i < ELEM * 4; i += 2)
+		remove_int_flat_hash(&ih, i * 128);
+	for (i = 0; i < ELEM * 4; ++i)
+		if ((get_int_flat_hash(&ih, i * 128) == NULL) != (i % 2 == 0))
+			failure = 1;
+	CAG_FOR_ALL(int_flat_hash, &ih, iit, sum += iit->value / 128);
+	CAG_TEST(*tests, failure == 0 && ih.size == ELEM * 2 &&
+		 sum == (long) ELEM * 2 * ELEM * 2,
+		 "cag_hash: flat remove");
+	iit = begin_int_flat_hash(&ih);
+	while (iit != end_int_flat_hash(&ih))
+		iit = erase_int_flat_hash(&ih, iit);
+	CAG_TEST(*tests, ih.size == 0 &&
+		 begin_int_flat_hash(&ih) == end_int_flat_hash(&ih),
+		 "cag_hash: flat empty after erases");
+	free_int_flat_hash(&ih);
+
+	new_string_flat_hash(&sh);
+	for (i = 0; i < ELEM; ++i) {
+		snprintf(key, 6, "k%d", i);
+		insert_string_flat_hash(&sh, key);
+		insert_string_flat_hash(&sh, key);
+	}
+	rehash_string_flat_hash(&sh, 4096);
+	for (i = 0; i < ELEM; ++i) {
+		snprintf(key, 6, "k%d", i);
+		sit = get_string_flat_hash(&sh, key);
+		if (!sit || strcmp(sit->value, key) != 0)
+			failure = 1;
+	}
+	CAG_TEST(*tests, failure == 0 && sh.size == ELEM &&
+		 sh.buckets == 4096,
+		 "cag_hash: flat string hash with rehash");
+	free_string_flat_hash(&sh);
+
+	new_str_str_flat_hash(&ssh);
+	x.key = "key";
+	x.data = "first";
+	insert_str_str_flat_hash(&ssh, x);
+	x.data = "second";
+	insertp_str_str_flat_hash(&ssh, &x);
+	ssit = getp_str_str_flat_hash(&ssh, &x);
+	CAG_TEST(*tests, ssit && ssh.size == 1 &&
+		 strcmp(ssit->value.data, "second") == 0,
+		 "cag_hash: flat insert with same key replaces element");
+	removep_str_str_flat_hash(&ssh, &x);
+	CAG_TEST(*tests, ssh.size == 0 && get_str_str_flat_hash(&ssh, x) == NULL,
+		 "cag_hash: flat remove struct element");
+	free_str_str_flat_hash(&ssh);
+}
+
+static void test_cuckoo(struct cag_test_series *tests)
+{
+	int_cuckoo_hash ih;
+	same_cuckoo_hash same;
+	str_str_cuckoo_hash ssh;
+	it_int_cuckoo_hash iit;
+	it_int_cuckoo_hash results[3];
+	it_same_cuckoo_hash sit;
+	it_str_str_cuckoo_hash ssit;
+	struct str_str x;
+	int i, keys[3], failure = 0;
+	long sum = 0;
+
+	CAG_TEST(*tests, new_int_cuckoo_hash(&ih) &&
+		 begin_int_cuckoo_hash(&ih) == end_int_cuckoo_hash(&ih),
+		 "cag_hash: cuckoo begin == end after new");
+	for (i = 0; i < ELEM * 4; ++i) {
+		iit = insert_int_cuckoo_hash(&ih, i * 128);
+		if (!iit || iit->value != i * 128)
+			failure = 1;
+	}
+	CAG_TEST(*tests, failure == 0 && ih.size == ELEM * 4 &&
+		 distance_all_int_cuckoo_hash(&ih) == ELEM * 4,
+		 "cag_hash: cuckoo inserts with growth");
+	for (i = 0; i < ELEM * 4; ++i) {
+		iit = get_int_cuckoo_hash(&ih, i * 128);
+		if (!iit || iit->value != i * 128)
+			failure = 1;
+	}
+	keys[0] = 0;
+	keys[1] = 1;
+	keys[2] = 256;
+	CAG_TEST(*tests, failure == 0 && get_int_cuckoo_hash(&ih, 1) == NULL &&
+		 get_many_int_cuckoo_hash(&ih, keys, 3, results) == 2 &&
+		 results[0]->value == 0 && results[1] == NULL,
+		 "cag_hash: cuckoo get");
+	for (i = 0; i < ELEM * 4; i += 2)
+		remove_int_cuckoo_hash(&ih, i * 128);
+	for (i = 0; i < ELEM * 4; ++i)
+		if ((get_int_cuckoo_hash(&ih, i * 128) == NULL) != (i % 2 == 0))
+			failure = 1;
+	CAG_FOR_ALL(int_cuckoo_hash, &ih, iit, sum += iit->value / 128);
+	CAG_TEST(*tests, failure == 0 && ih.size == ELEM * 2 &&
+		 sum == (long) ELEM * 2 * ELEM * 2,
+		 "cag_hash: cuckoo remove");
+	shrink_to_fit_int_cuckoo_hash(&ih);
+	for (i = 1; i < ELEM * 4; i += 2)
+		if (!get_int_cuckoo_hash(&ih, i * 128))
+			failure = 1;
+	CAG_TEST(*tests, failure == 0 && ih.buckets < ELEM * 8,
+		 "cag_hash: cuckoo shrink_to_fit");
+	free_int_cuckoo_hash(&ih);
+
+	/* Every key has the same two buckets, so once they are full the
+	   stash takes the overflow and then inserts fail. */
+	new_same_cuckoo_hash(&same);
+	for (i = 0; i < 32 && (sit = insert_same_cuckoo_hash(&same, i)); ++i)
+		if (sit->value != i)
+			failure = 1;
+	for (i = 0; i < (int) same.size; ++i)
+		if (!get_same_cuckoo_hash(&same, i))
+			failure = 1;
+	CAG_TEST(*tests, failure == 0 && same.size >= 12 && same.size <= 16 &&
+		 same.stashed == 8 && !get_same_cuckoo_hash(&same, 31),
+		 "cag_hash: cuckoo stash holds colliding keys");
+	free_same_cuckoo_hash(&same);
+
+	new_str_str_cuckoo_hash(&ssh);
+	x.key = "key";
+	x.data = "first";
+	insert_str_str_cuckoo_hash(&ssh, x);
+	x.data = "second";
+	insertp_str_str_cuckoo_hash(&ssh, &x);
+	ssit = getp_str_str_cuckoo_hash(&ssh, &x);
+	CAG_TEST(*tests, ssit && ssh.size == 1 &&
+		 strcmp(ssit->value.data, "second") == 0,
+		 "cag_hash: cuckoo insert with same key replaces element");
+	removep_str_str_cuckoo_hash(&ssh, &x);
+	CAG_TEST(*tests, ssh.size == 0 &&
+		 get_str_str_cuckoo_hash(&ssh, x) == NULL,
+		 "cag_hash: cuckoo remove struct element");
+	free_str_str_cuckoo_hash(&ssh);
+}
+
+static void test_ordered(struct cag_test_series *tests)
+{
+	int_ordered_hash ih;
+	string_ordered_hash sh;
+	it_int_ordered_hash iit;
+	it_string_ordered_hash sit;
+	char key[6];
+	int i, failure = 0;
+
+	CAG_TEST(*tests, new_int_ordered_hash(&ih) &&
+		 begin_int_ordered_hash(&ih) == end_int_ordered_hash(&ih),
+		 "cag_hash: ordered begin == end after new");
+	for (i = ELEM * 4; i > 0; --i)
+		if (!insert_int_ordered_hash(&ih, i * 128))
+			failure = 1;
+	i = ELEM * 4;
+	CAG_FOR_ALL(int_ordered_hash, &ih, iit,
+		    if (iit->value != i-- * 128) failure = 1);
+	CAG_TEST(*tests, failure == 0 && ih.size == ELEM * 4 && i == 0,
+		 "cag_hash: ordered iteration follows insertion order");
+	for (i = 1; i <= ELEM * 4; ++i) {
+		iit = get_int_ordered_hash(&ih, i * 128);
+		if (!iit || iit->value != i * 128)
+			failure = 1;
+	}
+	CAG_TEST(*tests, failure == 0 && get_int_ordered_hash(&ih, 1) == NULL,
+		 "cag_hash: ordered get");
+	for (i = 1; i <= ELEM * 4; i += 2)
+		remove_int_ordered_hash(&ih, i * 128);
+	insert_int_ordered_hash(&ih, 1);
+	for (i = 1; i <= ELEM * 4; ++i)
+		if ((get_int_ordered_hash(&ih, i * 128) == NULL) != (i % 2 == 1))
+			failure = 1;
+	i = ELEM * 4;
+	CAG_FOR_ALL(int_ordered_hash, &ih, iit,
+		    {
+			    if (iit->value != (i > 0 ? i * 128 : 1))
+				    failure = 1;
+			    i -= 2;
+		    });
+	CAG_TEST(*tests, failure == 0 && ih.size == ELEM * 2 + 1 && i == -2,
+		 "cag_hash: ordered remove keeps order of remaining elements");
+	rehash_int_ordered_hash(&ih, 0);
+	CAG_TEST(*tests, ih.used == ih.size &&
+		 begin_int_ordered_hash(&ih)->value == ELEM * 4 * 128 &&
+		 get_int_ordered_hash(&ih, 1) &&
+		 get_int_ordered_hash(&ih, 1)->value == 1,
+		 "cag_hash: ordered rehash squeezes out holes");
+	iit = begin_int_ordered_hash(&ih);
+	while (iit != end_int_ordered_hash(&ih))
+		iit = erase_int_ordered_hash(&ih, iit);
+	CAG_TEST(*tests, ih.size == 0 &&
+		 begin_int_ordered_hash(&ih) == end_int_ordered_hash(&ih),
+		 "cag_hash: ordered empty after erases");
+	free_int_ordered_hash(&ih);
+
+	new_string_ordered_hash(&sh);
+	for (i = 0; i < ELEM; ++i) {
+		snprintf(key, 6, "k%d", i);
+		insert_string_ordered_hash(&sh, key);
+		insert_string_ordered_hash(&sh, key);
+		if (i % 3 == 0)
+			remove_string_ordered_hash(&sh, key);
+	}
+	i = 0;
+	CAG_FOR_ALL(string_ordered_hash, &sh, sit,
+		    {
+			    if (i % 3 == 0)
+				    ++i;
+			    snprintf(key, 6, "k%d", i++);
+			    if (strcmp(key, sit->value) != 0)
+				    failure = 1;
+		    });
+	CAG_TEST(*tests, failure == 0 && sh.size == ELEM - (ELEM + 2) / 3,
+		 "cag_hash: ordered string hash with removals");
+	free_string_ordered_hash(&sh);
+}
+
+static void test_pool(struct cag_test_series *tests)
+{
+	int_hash h;
+	string_hash sh;
+	it_int_hash it, slab;
+	char key[5];
+	int i, slabs = 0;
+
+	new_int_hash(&h);
+	for (i = 0; i < 100; ++i)
+		insert_int_hash(&h, i);
+	for (slab = h.slabs; slab; slab = slab->next)
+		++slabs;
+	CAG_TEST(*tests, slabs == 3 && h.slabs->hash == 64,
+		 "cag_hash: nodes allocated in growing slabs");
+	it = get_int_hash(&h, 50);
+	remove_int_hash(&h, 50);
+	CAG_TEST(*tests, insert_int_hash(&h, 1000) == it && h.size == 100,
+		 "cag_hash: removed node reused by insert");
+	free_int_hash(&h);
+
+	new_string_hash(&sh);
+	populate_string_hash(&sh, 300);
+	for (i = 0; i < 300; i += 3) {
+		snprintf(key, 5, "k%d", i);
+		erase_string_hash(&sh, get_string_hash(&sh, key));
+	}
+	populate_string_hash(&sh, 60);
+	CAG_TEST(*tests, sh.size == 220 && get_string_hash(&sh, "k0") &&
+		 get_string_hash(&sh, "k57") && !get_string_hash(&sh, "k60"),
+		 "cag_hash: erase and reinsert with node pool");
+	free_string_hash(&sh);
+}
+
+static void test_frozen(struct cag_test_series *tests)
+{
+	int_hash h;
+	str_str_hash sh;
+	frozen_int_hash f;
+	frozen_str_str_hash fs;
+	struct str_str x, *p;
+	char key[6];
+	int i, found = 1;
+
+	new_int_hash(&h);
+	CAG_TEST(*tests, freeze_int_hash(&h, &f) && f.size == 0 &&
+		 get_frozen_int_hash(&f, 1) == NULL,
+		 "cag_hash: freeze empty table");
+	free_frozen_int_hash(&f);
+	for (i = 0; i < 10000; ++i)
+		insert_int_hash(&h, i * 3);
+	CAG_TEST(*tests, freeze_int_hash(&h, &f) == &f && f.size == 10000,
+		 "cag_hash: freeze");
+	for (i = 0; i < 10000; ++i)
+		if (get_frozen_int_hash(&f, i * 3) == NULL ||
+		    *get_frozen_int_hash(&f, i * 3) != i * 3)
+			found = 0;
+	CAG_TEST(*tests, found && get_frozen_int_hash(&f, 1) == NULL &&
+		 get_frozen_int_hash(&f, 30000) == NULL,
+		 "cag_hash: get from frozen table");
+	free_frozen_int_hash(&f);
+	free_int_hash(&h);
+
+	new_str_str_hash(&sh);
+	populate_str_str_hash(&sh, 500);
+	freeze_str_str_hash(&sh, &fs);
+	free_str_str_hash(&sh);
+	for (i = 0; i < 500; ++i) {
+		snprintf(key, 6, "k%d", i);
+		x.key = key;
+		p = getp_frozen_str_str_hash(&fs, &x);
+		if (p == NULL || atoi(p->data + 1) != i)
+			found = 0;
+	}
+	x.key = "k500";
+	CAG_TEST(*tests, found && get_frozen_str_str_hash(&fs, x) == NULL,
+		 "cag_hash: frozen string dictionary outlives source table");
+	free_frozen_str_str_hash(&fs);
+}
+
+static void test_frozen_collisions(struct cag_test_series *tests)
+{
+	few_hashes_hash h;
+	same_hash sh;
+	str_hash words;
+	frozen_few_hashes_hash f;
+	frozen_same_hash fs;
+	frozen_str_hash fw;
+	char key[16], *keys;
+	int i, frozen, found = 1;
+
+	new_few_hashes_hash(&h);
+	for (i = 0; i < 5000; ++i)
+		insert_few_hashes_hash(&h, i);
+	CAG_TEST(*tests, freeze_few_hashes_hash(&h, &f) == &f,
+		 "cag_hash: freeze table with equal hash values");
+	free_few_hashes_hash(&h);
+	for (i = 0; i < 5000; ++i)
+		if (get_frozen_few_hashes_hash(&f, i) == NULL ||
+		    *get_frozen_few_hashes_hash(&f, i) != i)
+			found = 0;
+	for (i = 5000; i < 6000; ++i)
+		if (get_frozen_few_hashes_hash(&f, i) != NULL)
+			found = 0;
+	CAG_TEST(*tests, found,
+		 "cag_hash: get from frozen table with equal hash values");
+	free_frozen_few_hashes_hash(&f);
+
+	new_same_hash(&sh);
+	for (i = 0; i < 300; ++i)
+		insert_same_hash(&sh, i);
+	CAG_TEST(*tests, freeze_same_hash(&sh, &fs) == &fs &&
+		 get_frozen_same_hash(&fs, 0) && get_frozen_same_hash(&fs, 299) &&
+		 *get_frozen_same_hash(&fs, 150) == 150 &&
+		 get_frozen_same_hash(&fs, 300) == NULL,
+		 "cag_hash: freeze table with a single hash value");
+	free_frozen_same_hash(&fs);
+	free_same_hash(&sh);
+
+	/* cag_oat_hash gives some of these keys the same hash value. */
+	keys = malloc(300000 * sizeof(key));
+	new_str_hash(&words);
+	for (i = 0; i < 300000; ++i) {
+		snprintf(keys + i * sizeof(key), sizeof(key), "key%d", i);
+		insert_str_hash(&words, keys + i * sizeof(key));
+	}
+	frozen = freeze_str_hash(&words, &fw) == &fw;
+	free_str_hash(&words);
+	for (i = 0; frozen && i < 300000; ++i) {
+		snprintf(key, sizeof(key), "key%d", i);
+		if (get_frozen_str_hash(&fw, key) == NULL ||
+		    *get_frozen_str_hash(&fw, key) != keys + i * sizeof(key))
+			found = 0;
+	}
+	CAG_TEST(*tests, frozen && found &&
+		 get_frozen_str_hash(&fw, "key300000") == NULL,
+		 "cag_hash: freeze many strings with colliding hash values");
+	if (frozen)
+		free_frozen_str_hash(&fw);
+	free(keys);
+}
+
+static void test_mapped(struct cag_test_series *tests)
+{
+	str_str_hash h;
+	string_hash sh;
+	cag_mapped m;
+	char filename[L_tmpnam], key[6];
+	const char *data;
+	FILE *f;
+	int i, found = 1;
+
+	new_str_str_hash(&h);
+	populate_str_str_hash(&h, 500);
+	CAG_TEST(*tests, tmpnam(filename) &&
+		 save_mapped_str_str_hash(&h, filename) == CAG_SUCCESS,
+		 "cag_hash: save mapped");
+	free_str_str_hash(&h);
+	CAG_TEST(*tests, open_mapped_str_str_hash(&m, filename) == &m &&
+		 m.size == 500 && cag_verify_mapped(&m),
+		 "cag_hash: open mapped");
+	for (i = 0; i < 500; ++i) {
+		snprintf(key, 6, "k%d", i);
+		data = get_mapped_str_str_hash(&m, key);
+		if (data == NULL || data[0] != 'd' || atoi(data + 1) != i)
+			found = 0;
+	}
+	CAG_TEST(*tests, found && get_mapped_str_str_hash(&m, "k500") == NULL &&
+		 get_mapped_str_str_hash(&m, "") == NULL,
+		 "cag_hash: get from mapped file");
+	close_mapped_str_str_hash(&m);
+
+	f = fopen(filename, "r+b");
+	fseek(f, -2, SEEK_END);
+	fputc('x', f);
+	fclose(f);
+	CAG_TEST(*tests, open_mapped_str_str_hash(&m, filename) &&
+		 !cag_verify_mapped(&m),
+		 "cag_hash: verify detects damaged mapped file");
+	close_mapped_str_str_hash(&m);
+
+	new_string_hash(&sh);
+	populate_string_hash(&sh, 50);
+	save_mapped_string_hash(&sh, filename);
+	free_string_hash(&sh);
+	CAG_TEST(*tests, open_mapped_string_hash(&m, filename) &&
+		 strcmp(get_mapped_string_hash(&m, "k49"), "k49") == 0 &&
+		 get_mapped_string_hash(&m, "k50") == NULL,
+		 "cag_hash: mapped string set");
+	close_mapped_string_hash(&m);
+
+	new_string_hash(&sh);
+	CAG_TEST(*tests, save_mapped_string_hash(&sh, filename) == CAG_SUCCESS &&
+		 open_mapped_string_hash(&m, filename) && m.size == 0 &&
+		 cag_verify_mapped(&m) &&
+		 get_mapped_string_hash(&m, "k0") == NULL,
+		 "cag_hash: mapped empty string set");
+	free_string_hash(&sh);
+	close_mapped_string_hash(&m);
+	remove(filename);
+}
+
+static void test_stats(struct cag_test_series *tests)
+{
+	int_hash h;
+	struct cag_hash_stats stats;
+	int i;
+
+	new_int_hash(&h);
+	for (i = 0; i < 100; ++i)
+		insert_int_hash(&h, i);
+	stats_int_hash(&h, &stats);
+	CAG_TEST(*tests, stats.size == 100 && stats.buckets == h.buckets &&
+		 stats.load_factor == 100.0 / h.buckets &&
+		 stats.rehashes == 3 && stats.hit_probes >= 1 &&
+		 stats.value_bytes == 100 * sizeof(int) &&
+		 stats.node_bytes > stats.value_bytes &&
+		 stats.bucket_bytes == (h.buckets + 1) * sizeof(it_int_hash),
+		 "cag_hash: stats of table");
+	get_int_hash(&h, 5);
+	get_int_hash(&h, 7);
+	get_int_hash(&h, 1000);
+	stats_int_hash(&h, &stats);
+	CAG_TEST(*tests, stats.hits == 2 && stats.misses == 1 &&
+		 stats.average_hit_probes >= 1 && stats.max_hit_probes >= 1,
+		 "cag_hash: stats count lookups");
+	free_int_hash(&h);
+
+	new_with_buckets_int_hash(&h, 100);
+	for (i = 0; i < 50; ++i)
+		insert_int_hash(&h, i * 100);
+	get_int_hash(&h, 0);
+	get_int_hash(&h, 5000);
+	stats_int_hash(&h, &stats);
+	CAG_TEST(*tests, stats.max_chain == 50 && stats.chains[0] == 99 &&
+		 stats.chains[CAG_HASH_STATS_CHAINS - 1] == 1 &&
+		 stats.hit_probes == 25.5 && stats.max_hit_probes == 50 &&
+		 stats.max_miss_probes == 50,
+		 "cag_hash: stats show strided keys in one bucket");
+	free_int_hash(&h);
+}
+
+static void test_inline(struct cag_test_series *tests)
+{
+	inline_hash h;
+	frozen_inline_hash frozen;
+	it_inline_hash it;
+	char key[8];
+	int i, failure = 0;
+
+	new_inline_hash(&h);
+	for (i = 0; i < 300; ++i) {
+		sprintf(key, "k%d", i);
+		it = insert_inline_hash(&h, key);
+		if (!it || it->value != (char *) (&it->value + 1) ||
+		    strcmp(it->value, key) != 0 ||
+		    insert_inline_hash(&h, key) != it)
+			failure = 1;
+	}
+	for (i = 0; i < 300; ++i) {
+		sprintf(key, "k%d", i);
+		it = get_inline_hash(&h, key);
+		if (!it || strcmp(it->value, key) != 0)
+			failure = 1;
+	}
+	CAG_TEST(*tests, failure == 0 && h.size == 300 && h.slabs == NULL &&
+		 get_inline_hash(&h, "k300") == NULL,
+		 "cag_hash: inline strings stored in nodes");
+	for (i = 0; i < 300; i += 3) {
+		sprintf(key, "k%d", i);
+		if (!remove_inline_hash(&h, key))
+			failure = 1;
+	}
+	it = begin_inline_hash(&h);
+	while (it != end_inline_hash(&h))
+		it = strcmp(it->value, "k1") == 0 ? erase_inline_hash(&h, it) :
+			next_inline_hash(it);
+	CAG_TEST(*tests, failure == 0 && h.size == 199 &&
+		 get_inline_hash(&h, "k3") == NULL &&
+		 get_inline_hash(&h, "k1") == NULL &&
+		 get_inline_hash(&h, "k2") != NULL,
+		 "cag_hash: inline strings remove and erase");
+	it = freeze_inline_hash(&h, &frozen) ? get_inline_hash(&h, "k2") : NULL;
+	free_inline_hash(&h);
+	CAG_TEST(*tests, it && get_frozen_inline_hash(&frozen, "k2") &&
+		 strcmp(*get_frozen_inline_hash(&frozen, "k2"), "k2") == 0 &&
+		 !get_frozen_inline_hash(&frozen, "k3"),
+		 "cag_hash: frozen inline strings outlive table");
+	free_frozen_inline_hash(&frozen);
+}
+
 void test_hash(struct cag_test_series *tests)
 {
 	test_new(tests);
@@ -396,8 +1362,25 @@ void test_hash(struct cag_test_series *tests)
 	test_remove(tests);
 	test_erase(tests);
 	test_rehash(tests);
+	test_load_factor(tests);
+	test_shrink(tests);
+	test_get_many(tests);
+	test_insert_many(tests);
+	test_incremental(tests);
+	test_pool(tests);
+	test_frozen(tests);
+	test_frozen_collisions(tests);
+	test_mapped(tests);
+	test_stats(tests);
+	test_inline(tests);
+	test_insert_or_get(tests);
+	test_hash_functions(tests);
+	test_hash_once(tests);
 	test_copy(tests);
 	test_str_str(tests);
+	test_flat(tests);
+	test_cuckoo(tests);
+	test_ordered(tests);
 }
 
-CAG_DEF_STR_HASH(string_hash);
+CAG_DEF_MAPPED_STR_HASH(string_hash);
@@ -0,0 +1,149 @@
+/*! Tests for CAGL parallel sorting of arrays.
+
+  \copyright Copyright 2014 Nathan Geffen. All rights reserved.
+  \license GNU Lesser General Public License Copyright.
+  See COPYING for the license text.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CAG_SAFER 1
+#include "cagl/error.h"
+#include "cagl/test.h"
+#include "cagl/parsort.h"
+
+#define ELEMENTS (CAG_PAR_SORT_MIN * 3 + 17)
+
+struct pair {
+	int key;
+	int index;
+};
+
+static int cmp_pair(const struct pair *a, const struct pair *b)
+{
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+CAG_DEC_DEF_CMPP_ARRAY(pair_array, struct pair, cmp_pair);
+CAG_DEC_DEF_PAR_ARRAY(pair_array, cmp_pair, CAG_BYADR);
+
+CAG_DEC_DEF_CMP_ARRAY(int_par_array, int, CAG_CMP_PRIMITIVE);
+CAG_DEC_DEF_PAR_ARRAY(int_par_array, CAG_CMP_PRIMITIVE, CAG_BYVAL);
+
+/* Fills data with n keys from one of a few patterns. */
+static void fill(struct pair *data, size_t n, int pattern)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		switch (pattern) {
+		case 0:
+			data[i].key = rand();
+			break;
+		case 1:
+			data[i].key = rand() % 100;
+			break;
+		case 2:
+			data[i].key = (int) i;
+			break;
+		default:
+			data[i].key = (int) (n - i) / 3;
+		}
+		data[i].index = (int) i;
+	}
+}
+
+static void load(pair_array *a, struct pair *data, size_t n)
+{
+	size_t i;
+
+	new_with_capacity_pair_array(a, n);
+	for (i = 0; i < n; ++i)
+		append_pair_array(a, data[i]);
+}
+
+/* Sorts copies of data sequentially and in parallel and compares the
+   results, including the order of equal keys when stable is set. */
+static int same_as_sequential(struct pair *data, size_t n, size_t nthreads,
+			      int stable)
+{
+	pair_array seq, par;
+	it_pair_array it;
+	it_pair_array jt;
+	int same = 1;
+
+	load(&seq, data, n);
+	load(&par, data, n);
+	if (stable) {
+		stable_sort_all_pair_array(&seq);
+		same = par_stable_sort_pair_array(begin_pair_array(&par),
+						  end_pair_array(&par),
+						  nthreads) != NULL;
+	} else {
+		sort_all_pair_array(&seq);
+		same = par_sort_pair_array(begin_pair_array(&par),
+					   end_pair_array(&par),
+					   nthreads) != NULL;
+	}
+	for (it = begin_pair_array(&seq), jt = begin_pair_array(&par);
+	     same && it != end_pair_array(&seq); ++it, ++jt)
+		same = it->value.key == jt->value.key &&
+		       (!stable || it->value.index == jt->value.index);
+	free_pair_array(&seq);
+	free_pair_array(&par);
+	return same;
+}
+
+static void test_par_sort(struct cag_test_series *tests)
+{
+	struct pair *data = malloc(ELEMENTS * sizeof(*data));
+	size_t threads[] = {0, 1, 2, 3, 4, 7, 8};
+	size_t i;
+	int pattern, same = 1, stable = 1;
+
+	for (pattern = 0; pattern < 4; ++pattern) {
+		fill(data, ELEMENTS, pattern);
+		for (i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+			same = same &&
+			       same_as_sequential(data, ELEMENTS, threads[i], 0);
+			stable = stable &&
+				 same_as_sequential(data, ELEMENTS, threads[i],
+						    1);
+		}
+	}
+	CAG_TEST(*tests, same, "cag_parsort: par_sort matches sort");
+	CAG_TEST(*tests, stable,
+		 "cag_parsort: par_stable_sort matches stable_sort");
+	fill(data, 1000, 1);
+	CAG_TEST(*tests, same_as_sequential(data, 1000, 4, 1),
+		 "cag_parsort: short range falls back to sequential");
+	free(data);
+}
+
+static void test_par_sort_primitive(struct cag_test_series *tests)
+{
+	int_par_array a;
+	it_int_par_array it;
+	int i, sorted = 1;
+
+	new_with_capacity_int_par_array(&a, ELEMENTS);
+	for (i = 0; i < ELEMENTS; ++i)
+		append_int_par_array(&a, (i * 7919) % ELEMENTS);
+	CAG_TEST(*tests, par_sort_int_par_array(begin_int_par_array(&a),
+						end_int_par_array(&a),
+						5) == begin_int_par_array(&a),
+		 "cag_parsort: par_sort returns from");
+	for (i = 0, it = begin_int_par_array(&a); it != end_int_par_array(&a);
+	     ++it, ++i)
+		sorted = sorted && it->value == i;
+	CAG_TEST(*tests, sorted, "cag_parsort: par_sort of int permutation");
+	free_int_par_array(&a);
+}
+
+void test_parsort(struct cag_test_series *tests)
+{
+	test_par_sort(tests);
+	test_par_sort_primitive(tests);
+}
@@ -470,6 +470,29 @@ static void test_find(struct cag_test_series *tests)
 }
 
 
+static void test_top_k(struct cag_test_series *tests)
+{
+	complex_slist l;
+	struct complex c, out[10];
+	int i, ordered = CAG_TRUE;
+
+	new_complex_slist(&l);
+	for (i = 0; i < 500; ++i) {
+		c.real = (i * 37) % 500;
+		c.imag = i;
+		prepend_complex_slist(&l, c);
+	}
+	CAG_TEST(*tests, top_k_complex_slist(beg_complex_slist(&l),
+					     end_complex_slist(&l), out,
+					     10) == 10,
+		 "cag_slist: top_k count");
+	for (i = 0; i < 10; ++i)
+		if (out[i].real != i)
+			ordered = CAG_FALSE;
+	CAG_TEST(*tests, ordered, "cag_slist: top_k smallest in order");
+	free_complex_slist(&l);
+}
+
 void test_slist(struct cag_test_series *tests)
 {
 	test_it(tests);
@@ -484,6 +507,7 @@ void test_slist(struct cag_test_series *tests)
 	test_reverse(tests);
 	test_copy_over(tests);
 	test_sort(tests);
+	test_top_k(tests);
 	test_find(tests);
 }
 
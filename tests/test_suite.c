@@ -20,6 +20,8 @@ void test_dlist(struct cag_test_series *tests);
 void test_slist(struct cag_test_series *tests);
 void test_array(struct cag_test_series *tests);
 void test_hash(struct cag_test_series *tests);
+void test_conchash(struct cag_test_series *tests);
+void test_parsort(struct cag_test_series *tests);
 void test_tree(struct cag_test_series *tests);
 void test_compound(struct cag_test_series *tests);
 
@@ -77,6 +79,8 @@ int main(void)
 	test_slist(&test);
 	test_array(&test);
 	test_hash(&test);
+	test_conchash(&test);
+	test_parsort(&test);
 	test_tree(&test);
 	test_compound(&test);
 	if (cag_test_summary(&test) > 0)
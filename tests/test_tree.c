@@ -47,6 +47,7 @@ static int cmpp_complex(const struct complex *x, const struct complex *y)
 CAG_DEC_CMP_TREE(complex_tree, struct complex);
 CAG_DEC_CMP_TREE(complexp_tree, struct complex);
 CAG_DEC_CMP_TREE(string_tree, char *);
+CAG_DEC_INLINE_STR_TREE(inline_tree);
 CAG_DEC_DEF_CMP_TREE(int_tree, int, CAG_CMP_PRIMITIVE);
 CAG_DEC_DEF_ARRAY(int_arr, int);
 
@@ -607,6 +608,42 @@ static void test_rb_insert_erase(struct cag_test_series *tests)
 		 free_int_tree(&tree);
 }
 
+static void test_inline(struct cag_test_series *tests)
+{
+	inline_tree tree;
+	it_inline_tree it;
+	char key[8], prev[8] = "";
+	int i, failure = 0;
+
+	new_inline_tree(&tree);
+	for (i = 0; i < 200; ++i) {
+		sprintf(key, "w%03d", (i * 37) % 200);
+		if (!insert_inline_tree(&tree, key))
+			failure = 1;
+	}
+	CAG_FOR_ALL(inline_tree, &tree, it, {
+			if (strcmp(prev, it->value) >= 0 ||
+			    it->value != (char *) (&it->value + 1))
+				failure = 1;
+			strcpy(prev, it->value);
+		});
+	CAG_TEST(*tests, failure == 0 && distance_all_inline_tree(&tree) == 200 &&
+		 check_integrity_inline_tree(&tree, tree.root),
+		 "cag_tree: inline strings stored in nodes in order");
+	for (i = 0; i < 200; i += 2) {
+		sprintf(key, "w%03d", i);
+		if (!remove_inline_tree(&tree, key))
+			failure = 1;
+	}
+	it = insert_inline_tree(&tree, "w001");
+	CAG_TEST(*tests, failure == 0 && it && strcmp(it->value, "w001") == 0 &&
+		 distance_all_inline_tree(&tree) == 100 &&
+		 get_inline_tree(&tree, "w002") == NULL &&
+		 get_inline_tree(&tree, "w199") != NULL,
+		 "cag_tree: inline strings remove");
+	free_inline_tree(&tree);
+}
+
 void test_tree(struct cag_test_series *tests)
 {
 	test_new(tests);
@@ -621,6 +658,7 @@ void test_tree(struct cag_test_series *tests)
 	test_find(tests);
 	test_front_back(tests);
 	test_rb_insert_erase(tests);
+	test_inline(tests);
 }
 
 CAG_DEF_CMP_TREE(complex_tree, struct complex, cmp_complex);
@@ -630,3 +668,5 @@ CAG_DEF_ALL_CMP_TREE(complexp_tree, struct complex, cmpp_complex, CAG_BYADR,
 
 CAG_DEF_ALL_CMP_TREE(string_tree, char *, strcmp, CAG_BYVAL,
 		     CAG_SIMPLE_ALLOC_STYLE, cag_strdup, free);
+
+CAG_DEF_INLINE_STR_TREE(inline_tree);